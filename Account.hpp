@@ -13,6 +13,7 @@ namespace hlcup {
 struct Account {
     const static constexpr u32 kInvalidOffset = std::numeric_limits<u32>::max();
     const static constexpr u32 kInvalidId     = std::numeric_limits<u32>::max();
+    const static constexpr u32 kStringCapacity = 8192;  // decoded strings of one account
 
     enum Sex : u8 {
         kFemale     = 0,
@@ -56,7 +57,7 @@ struct Account {
     }
 
     Account() {
-        string_data = reinterpret_cast<char *>(::malloc(8192));
+        string_data = reinterpret_cast<char *>(::malloc(kStringCapacity));
         assert(string_data != nullptr);
         clear();
     }
@@ -83,4 +84,25 @@ struct Account {
     inline std::string      getString(const StringRef &ref) const { return std::string(string_data + ref.offset, ref.size); }
 };
 
+// One like of a POST /accounts/likes/ batch
+struct LikeEdge {
+    u32       liker;
+    u32       likee;
+    Timestamp ts;
+};
+
+// One POST that passed validation. For kUpdate the account is a patch: id is the target and only the fields
+// present in the body change. kLikes carries a batch of likes and no account.
+struct AccountUpdate {
+    enum Kind : u8 {
+        kNew = 0,
+        kUpdate,
+        kLikes,
+    };
+
+    Kind                  kind = kNew;
+    Account               acc;
+    std::vector<LikeEdge> likes;
+};
+
 }  // namespace hlcup
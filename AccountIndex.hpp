@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "AccountStore.hpp"
+#include "common.hpp"
+#include "core/Published.hpp"
+
+namespace hlcup {
+
+// Accounts by the value of a key, what filter and group start from. The index is a snapshot rebuilt from the
+// store plus a delta of the rows written since: StoreWriter logs every id it changes, readers take the ids
+// logged after the snapshot as dirty and check those against the rows themselves. Once writes go quiet a
+// background thread rebuilds the snapshot from the store and swaps it in, so after the write phase the delta is
+// empty again and queries run off the posting lists alone.
+//
+// Snapshots are swapped in through one pointer and numbered by epoch; a View pins the one it uses, so the
+// rebuilder frees a replaced snapshot only after the readers that started on it are done.
+class AccountIndex {
+public:
+    enum Key : u8 {
+        kSex = 0,
+        kStatus,
+        kCountry,
+        kCity,
+        kKeyCount,
+    };
+
+    static const constexpr auto   kPoll        = std::chrono::milliseconds(10);
+    static const constexpr auto   kQuiet       = std::chrono::milliseconds(100);  // no writes for this long starts a rebuild
+    static const constexpr size_t kLogChunk    = size_t(1) << 14;                 // ids per change log chunk
+
+    static u16 value(const StoredAccount &acc, Key key) {
+        switch (key) {
+        case kSex: return acc.sex;
+        case kStatus: return acc.status;
+        case kCountry: return acc.country;
+        case kCity: return acc.city;
+        default: return 0;
+        }
+    }
+
+    explicit AccountIndex(const AccountStore &store) : store_(store) {}
+
+    AccountIndex(const AccountIndex &) = delete;
+    AccountIndex &operator=(const AccountIndex &) = delete;
+
+    ~AccountIndex() { stop(); }
+
+    // Builds the first snapshot in the calling thread. After loading, before start() and before any View
+    void build() { publish(rebuild()); }
+
+    void start() { thread_ = std::thread(&AccountIndex::run, this); }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        stop_.store(true, std::memory_order_release);
+        thread_.join();
+    }
+
+    // Writer thread only, after the row is published
+    void touch(u32 id) { log_.push_back(id); }
+
+    u64 rebuilds() const { return epoch_.load(std::memory_order_acquire) - 1; }
+
+    // Log chunks still allocated, what a rebuild trims
+    size_t logChunks() const { return log_.chunks(); }
+
+    class View;
+
+private:
+    // Ids in the order StoreWriter changed them, numbered from the start. Positions map onto a ring of chunks:
+    // the writer fills the chunk at size(), and once a snapshot is the oldest one pinned the rebuilder frees the
+    // chunks wholly below its log_start, so the log holds the changes since the last rebuild, not since the start
+    class ChangeLog {
+    public:
+        static const constexpr size_t kChunkSize = kLogChunk;
+        static const constexpr size_t kRing      = 4096;  // chunks, 64M changes between two rebuilds
+
+        ChangeLog() {
+            for (auto &chunk : chunks_) chunk.store(nullptr, std::memory_order_relaxed);
+        }
+
+        ChangeLog(const ChangeLog &) = delete;
+        ChangeLog &operator=(const ChangeLog &) = delete;
+
+        ~ChangeLog() {
+            for (auto &chunk : chunks_) delete[] chunk.load(std::memory_order_relaxed);
+        }
+
+        // Any thread, for positions from the log_start of a snapshot it pins up to a size() it has seen
+        u32 operator[](size_t i) const { return slot(i).load(std::memory_order_acquire)[i & (kChunkSize - 1)]; }
+
+        size_t size() const { return size_.load(std::memory_order_acquire); }
+
+        // Writer thread only. The id is written before the size that covers it is published
+        void push_back(u32 id) {
+            size_t n     = size_.load(std::memory_order_relaxed);
+            u32 *  chunk = slot(n).load(std::memory_order_relaxed);
+            if ((n & (kChunkSize - 1)) == 0) {
+                // The slot still holds the chunk a ring earlier: that many changes came without a rebuild
+                if (chunk != nullptr) std::abort();
+                chunk = new u32[kChunkSize];
+                slot(n).store(chunk, std::memory_order_release);
+                chunks_held_.fetch_add(1, std::memory_order_relaxed);
+            }
+            chunk[n & (kChunkSize - 1)] = id;
+            size_.store(n + 1, std::memory_order_release);
+        }
+
+        // Rebuilder (or build()), once no reader looks below `start`
+        void trim(size_t start) {
+            for (; trimmed_ + kChunkSize <= start; trimmed_ += kChunkSize) {
+                delete[] slot(trimmed_).exchange(nullptr, std::memory_order_acq_rel);
+                chunks_held_.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        size_t chunks() const { return chunks_held_.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<u32 *> &      slot(size_t i) { return chunks_[(i / kChunkSize) % kRing]; }
+        const std::atomic<u32 *> &slot(size_t i) const { return chunks_[(i / kChunkSize) % kRing]; }
+
+        std::atomic<u32 *>  chunks_[kRing];
+        std::atomic<size_t> size_{0};
+        std::atomic<size_t> chunks_held_{0};
+        size_t              trimmed_ = 0;  // chunks below this are freed
+    };
+
+    struct Keys {
+        u16  values[kKeyCount];
+        bool exists;
+    };
+
+    struct Postings {
+        std::vector<u32> offsets;  // ids of value v are ids[offsets[v], offsets[v + 1])
+        std::vector<u32> ids;      // descending within a value
+
+        u32 size(u16 v) const { return v + 1u < offsets.size() ? offsets[v + 1] - offsets[v] : 0; }
+    };
+
+    struct Snapshot {
+        u64               epoch     = 0;
+        size_t            log_start = 0;  // log entries from here on are not in the snapshot
+        u32               id_limit  = 0;
+        std::vector<Keys> keys;           // by id, below id_limit
+        Postings          postings[kKeyCount];
+    };
+
+    Snapshot *rebuild() const {
+        std::unique_ptr<Snapshot> snap(new Snapshot);
+        // Everything logged before this was published before it, the rows read below have it
+        snap->log_start = log_.size();
+        snap->id_limit  = store_.idLimit();
+        snap->keys.resize(snap->id_limit);
+
+        StoredAccount acc;
+        u16           max_value[kKeyCount] = {};
+        for (u32 id = 0; id < snap->id_limit; ++id) {
+            Keys &keys  = snap->keys[id];
+            keys.exists = store_.read(id, acc);
+            if (!keys.exists) continue;
+            for (u8 k = 0; k < kKeyCount; ++k) {
+                keys.values[k] = value(acc, static_cast<Key>(k));
+                max_value[k]   = std::max(max_value[k], keys.values[k]);
+            }
+        }
+
+        for (u8 k = 0; k < kKeyCount; ++k) {
+            Postings &p = snap->postings[k];
+            p.offsets.assign(max_value[k] + 2u, 0);
+            for (const Keys &keys : snap->keys) {
+                if (keys.exists) ++p.offsets[keys.values[k] + 1u];
+            }
+            for (size_t v = 1; v < p.offsets.size(); ++v) p.offsets[v] += p.offsets[v - 1];
+
+            p.ids.resize(p.offsets.back());
+            std::vector<u32> fill(p.offsets.begin(), p.offsets.end() - 1);
+            for (u32 id = snap->id_limit; id-- > 0;) {
+                const Keys &keys = snap->keys[id];
+                if (keys.exists) p.ids[fill[keys.values[k]]++] = id;
+            }
+        }
+        return snap.release();
+    }
+
+    // Rebuilder (or build()): only one thread publishes
+    void publish(Snapshot *next) {
+        next->epoch = epoch_.load(std::memory_order_relaxed) + 1;
+        snapshots_.publish(next);
+        epoch_.store(next->epoch, std::memory_order_release);
+        while (!snapshots_.reclaim()) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        // Every View now pins `next`, none reads the log below its start
+        log_.trim(next->log_start);
+    }
+
+    void run() {
+        size_t seen        = log_.size();
+        auto   last_change = std::chrono::steady_clock::now();
+        while (!stop_.load(std::memory_order_acquire)) {
+            std::this_thread::sleep_for(kPoll);
+
+            size_t logged = log_.size();
+            auto   now    = std::chrono::steady_clock::now();
+            if (logged != seen) {
+                seen        = logged;
+                last_change = now;
+            } else if (logged > snapshots_.current()->log_start && now - last_change >= kQuiet) {
+                publish(rebuild());
+            }
+        }
+    }
+
+    const AccountStore & store_;
+    ChangeLog            log_;
+    Published<Snapshot>  snapshots_;
+    std::atomic<u64>     epoch_{0};
+    std::thread          thread_;
+    std::atomic<bool>    stop_{false};
+};
+
+// A reader's pinned snapshot plus the delta as of construction. Views are meant to live for one request: the
+// rebuilder waits for the snapshot they pin before it frees it and starts on the next one.
+class AccountIndex::View {
+public:
+    explicit View(const AccountIndex &index) : index_(index), snap_(index.snapshots_) {
+        size_t end = index.log_.size();
+        dirty_.reserve(end - snap_->log_start);
+        for (size_t i = snap_->log_start; i < end; ++i) dirty_.push_back(index.log_[i]);
+        std::sort(dirty_.begin(), dirty_.end(), std::greater<u32>());
+        dirty_.erase(std::unique(dirty_.begin(), dirty_.end()), dirty_.end());
+    }
+
+    View(const View &) = delete;
+    View &operator=(const View &) = delete;
+
+    // Ids of the accounts with `key` == `v`, descending
+    void select(Key key, u16 v, std::vector<u32> &out) const {
+        out.clear();
+        const Postings &p     = snap_->postings[key];
+        const u32 *     it    = p.ids.data() + (p.size(v) ? p.offsets[v] : 0);
+        const u32 *     end   = it + p.size(v);
+        auto            dirty = dirty_.begin();
+
+        StoredAccount acc;
+        for (;;) {
+            while (it != end && dirty != dirty_.end() && *dirty > *it) {
+                if (matches(*dirty, key, v, acc)) out.push_back(*dirty);
+                ++dirty;
+            }
+            if (it == end) break;
+            if (dirty != dirty_.end() && *dirty == *it) {
+                if (matches(*dirty, key, v, acc)) out.push_back(*dirty);
+                ++dirty;
+            } else {
+                out.push_back(*it);
+            }
+            ++it;
+        }
+        for (; dirty != dirty_.end(); ++dirty) {
+            if (matches(*dirty, key, v, acc)) out.push_back(*dirty);
+        }
+    }
+
+    // Number of accounts with `key` == `v`, what group counts
+    u32 count(Key key, u16 v) const {
+        u32           n = snap_->postings[key].size(v);
+        StoredAccount acc;
+        for (u32 id : dirty_) {
+            if (id < snap_->id_limit && snap_->keys[id].exists && snap_->keys[id].values[key] == v) --n;
+            if (matches(id, key, v, acc)) ++n;
+        }
+        return n;
+    }
+
+    // Rows changed since the snapshot, 0 once a rebuild caught up
+    size_t deltaSize() const { return dirty_.size(); }
+
+private:
+    bool matches(u32 id, Key key, u16 v, StoredAccount &acc) const { return index_.store_.read(id, acc) && value(acc, key) == v; }
+
+    const AccountIndex &     index_;
+    Published<Snapshot>::Pin snap_;
+    std::vector<u32>         dirty_;  // descending
+};
+
+}  // namespace hlcup
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <string>
+
+#include "Account.hpp"
+#include "Dictionary.hpp"
+#include "common.hpp"
+#include "core/HashIndex.hpp"
+#include "core/SeqLock.hpp"
+#include "core/StableVector.hpp"
+
+namespace hlcup {
+
+// Account as it is kept after loading: repeated strings are dictionary ids, unique ones (email, phone) are
+// offsets of their JSON fragments in the store's string arena.
+struct StoredAccount {
+    u32 id = Account::kInvalidId;
+
+    StringRef email{0, 0};
+    StringRef phone{0, 0};
+
+    Timestamp birth          = kInvalidTimestamp;
+    Timestamp joined         = kInvalidTimestamp;
+    Timestamp premium_start  = kInvalidTimestamp;
+    Timestamp premium_finish = kInvalidTimestamp;
+
+    u16 fname   = Dictionary::kNull;
+    u16 sname   = Dictionary::kNull;
+    u16 country = Dictionary::kNull;
+    u16 city    = Dictionary::kNull;
+
+    Account::Sex    sex    = Account::kInvalidSex;
+    Account::Status status = Account::kInvalidStatus;
+
+    bool exists() const { return id != Account::kInvalidId; }
+};
+
+// Rows and strings for one writer and any number of readers. The writer (the loader, then StoreWriter's thread)
+// builds the new version of a row aside, interning its strings first, and publishes it through the row's
+// seqlock; readers copy rows out with read() and never wait. Nothing the store hands out moves or is freed:
+// replaced email and phone fragments stay in the arena, so a reader holding an old copy of a row still sees
+// valid strings.
+struct AccountStore {
+    Dictionary fnames{"fname"};
+    Dictionary snames{"sname"};
+    Dictionary countries{"country"};
+    Dictionary cities{"city"};
+
+    // Writer: stores a whole account, absent fields included
+    void add(const Account &acc) {
+        if (acc.id >= rows_.size()) rows_.resize(acc.id + 1);
+
+        StoredAccount dst;
+        dst.id             = acc.id;
+        dst.sex            = acc.sex;
+        dst.status         = acc.status;
+        dst.birth          = acc.birth;
+        dst.joined         = acc.joined;
+        dst.premium_start  = acc.premium.start;
+        dst.premium_finish = acc.premium.finish;
+
+        dst.fname   = intern(fnames, acc, acc.fname);
+        dst.sname   = intern(snames, acc, acc.sname);
+        dst.country = intern(countries, acc, acc.country);
+        dst.city    = intern(cities, acc, acc.city);
+
+        dst.email = addFragment("email", acc, acc.email, max_email_);
+        dst.phone = addFragment("phone", acc, acc.phone, max_phone_);
+
+        rows_[acc.id].store(dst);
+
+        if (!unique_indexed_) return;
+        if (dst.email.size != 0) emails_.insert(emailKey(dst), dst.id);
+        if (dst.phone.size != 0) phones_.insert(phoneKey(dst), dst.id);
+    }
+
+    // Writer: changes the fields present in `patch` of the existing account patch.id
+    void update(const Account &patch) {
+        StoredAccount dst = rows_[patch.id].unsafeRef();
+        assert(dst.exists());
+
+        if (patch.sex != Account::kInvalidSex) dst.sex = patch.sex;
+        if (patch.status != Account::kInvalidStatus) dst.status = patch.status;
+        if (patch.birth != kInvalidTimestamp) dst.birth = patch.birth;
+        if (patch.joined != kInvalidTimestamp) dst.joined = patch.joined;
+        if (patch.premium.start != kInvalidTimestamp) dst.premium_start = patch.premium.start;
+        if (patch.premium.finish != kInvalidTimestamp) dst.premium_finish = patch.premium.finish;
+
+        if (patch.fname.offset != Account::kInvalidOffset) dst.fname = intern(fnames, patch, patch.fname);
+        if (patch.sname.offset != Account::kInvalidOffset) dst.sname = intern(snames, patch, patch.sname);
+        if (patch.country.offset != Account::kInvalidOffset) dst.country = intern(countries, patch, patch.country);
+        if (patch.city.offset != Account::kInvalidOffset) dst.city = intern(cities, patch, patch.city);
+
+        if (patch.email.offset != Account::kInvalidOffset) dst.email = addFragment("email", patch, patch.email, max_email_);
+        if (patch.phone.offset != Account::kInvalidOffset) dst.phone = addFragment("phone", patch, patch.phone, max_phone_);
+
+        StringRef old_email = rows_[patch.id].unsafeRef().email, old_phone = rows_[patch.id].unsafeRef().phone;
+        rows_[patch.id].store(dst);
+
+        if (!unique_indexed_) return;
+        reindex(emails_, old_email, dst.email, kEmailPrefix, dst.id);
+        reindex(phones_, old_phone, dst.phone, kPhonePrefix, dst.id);
+    }
+
+    // Writer, once after loading: indexes every email and phone in one pass, add() and update() keep the
+    // indexes from then on
+    void buildUniqueIndexes() {
+        size_t emails = 0, phones = 0;
+        for (u32 id = 0; id < idLimit(); ++id) {
+            const StoredAccount &acc = rows_[id].unsafeRef();
+            emails += acc.email.size != 0;
+            phones += acc.phone.size != 0;
+        }
+        emails_.reserve(emails);
+        phones_.reserve(phones);
+
+        for (u32 id = 0; id < idLimit(); ++id) {
+            const StoredAccount &acc = rows_[id].unsafeRef();
+            if (acc.email.size != 0) emails_.insert(emailKey(acc), id);
+            if (acc.phone.size != 0) phones_.insert(phoneKey(acc), id);
+        }
+        unique_indexed_ = true;
+    }
+
+    // Any thread: the account that has this (unescaped) email or phone, Account::kInvalidId if none does
+    u32 findEmail(std::string_view email) const { return find(emails_, email); }
+    u32 findPhone(std::string_view phone) const { return find(phones_, phone); }
+
+    // Any thread: copies the row out, false if there is no such account
+    bool read(u32 id, StoredAccount &out) const {
+        if (id >= rows_.size()) return false;
+        out = rows_[id].load();
+        return out.exists();
+    }
+
+    bool exists(u32 id) const {
+        StoredAccount acc;
+        return read(id, acc);
+    }
+
+    // Any thread: every id of an account is below this
+    u32 idLimit() const { return static_cast<u32>(rows_.size()); }
+
+    // Any thread: whether a new account may take `id`. add() allocates every row up to the id, so it may run at
+    // most kIdHeadroom past the ids seen so far and never past the row table
+    bool acceptsNewId(u32 id) const { return id < std::min<size_t>(size_t(idLimit()) + kIdHeadroom, decltype(rows_)::kMaxSize); }
+
+    static const constexpr u32 kIdHeadroom = 1 << 20;
+
+    std::string_view fragment(const StringRef &ref) const {
+        if (ref.size == 0) return std::string_view();
+        return std::string_view(strings_.data(ref.offset), ref.size);
+    }
+
+    u32 maxEmailFragment() const { return max_email_.load(std::memory_order_relaxed); }
+    u32 maxPhoneFragment() const { return max_phone_.load(std::memory_order_relaxed); }
+
+private:
+    // Email and phone keys are their values as stored: the JSON-escaped text inside the fragment
+    static const constexpr u32 kEmailPrefix = sizeof(",\"email\":\"") - 1;
+    static const constexpr u32 kPhonePrefix = sizeof(",\"phone\":\"") - 1;
+
+    struct FragmentKey {
+        const AccountStore *store;
+        StringRef StoredAccount::*field;
+        u32                       prefix;
+
+        std::string_view operator()(u32 id) const {
+            StoredAccount acc;
+            if (!store->read(id, acc)) return std::string_view();
+            return store->key(acc.*field, prefix);
+        }
+    };
+
+    std::string_view key(const StringRef &ref, u32 prefix) const {
+        if (ref.size == 0) return std::string_view();
+        return fragment(ref).substr(prefix, ref.size - prefix - 1);
+    }
+    std::string_view emailKey(const StoredAccount &acc) const { return key(acc.email, kEmailPrefix); }
+    std::string_view phoneKey(const StoredAccount &acc) const { return key(acc.phone, kPhonePrefix); }
+
+    void reindex(HashIndex<FragmentKey> &index, const StringRef &old_ref, const StringRef &new_ref, u32 prefix, u32 id) {
+        if (old_ref.offset == new_ref.offset && old_ref.size == new_ref.size) return;
+        if (old_ref.size != 0) index.erase(key(old_ref, prefix), id);
+        if (new_ref.size != 0) index.insert(key(new_ref, prefix), id);
+    }
+
+    static u32 find(const HashIndex<FragmentKey> &index, std::string_view value) {
+        thread_local std::string escaped;
+        escaped.clear();
+        Json::escape(value, escaped);
+        u32 id = index.find(escaped);
+        return id == HashIndex<FragmentKey>::kNone ? Account::kInvalidId : id;
+    }
+
+    static u16 intern(Dictionary &dict, const Account &acc, const StringRef &ref) {
+        if (ref.offset == Account::kInvalidOffset) return Dictionary::kNull;
+        return dict.add(acc.getView(ref));
+    }
+
+    StringRef addFragment(const char *key, const Account &acc, const StringRef &ref, std::atomic<u32> &max_size) {
+        if (ref.offset == Account::kInvalidOffset) return StringRef{0, 0};
+
+        tmp_.assign(",\"");
+        tmp_ += key;
+        tmp_ += "\":\"";
+        Json::escape(acc.getView(ref), tmp_);
+        tmp_ += '"';
+
+        StringRef res{static_cast<u32>(strings_.append(tmp_.data(), tmp_.size())), static_cast<u32>(tmp_.size())};
+        if (res.size > max_size.load(std::memory_order_relaxed)) max_size.store(res.size, std::memory_order_relaxed);
+        return res;
+    }
+
+    StableVector<SeqLocked<StoredAccount>, 16, 1024> rows_;     // indexed by id, ids are dense
+    StableVector<char, 20, 4096>                     strings_;  // StringRef offsets are u32
+    std::string                                      tmp_;
+    std::atomic<u32>                                 max_email_{0};
+    std::atomic<u32>                                 max_phone_{0};
+
+    HashIndex<FragmentKey> emails_{FragmentKey{this, &StoredAccount::email, kEmailPrefix}};
+    HashIndex<FragmentKey> phones_{FragmentKey{this, &StoredAccount::phone, kPhonePrefix}};
+    bool                   unique_indexed_ = false;
+};
+
+}  // namespace hlcup
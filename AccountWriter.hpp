@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "AccountStore.hpp"
+#include "Dictionary.hpp"
+#include "common.hpp"
+#include "core/Buffer.hpp"
+#include "core/IntFormat.hpp"
+
+namespace hlcup {
+
+// Serializes accounts for filter/recommend/suggest answers. Strings are copied from their pre-escaped fragments,
+// numbers go through IntFormat, and a whole answer is written through a raw pointer into
+// space reserved once from its worst-case size.
+struct AccountWriter {
+    enum Field : u32 {
+        kSex     = 1 << 0,
+        kStatus  = 1 << 1,
+        kFname   = 1 << 2,
+        kSname   = 1 << 3,
+        kPhone   = 1 << 4,
+        kCountry = 1 << 5,
+        kCity    = 1 << 6,
+        kBirth   = 1 << 7,
+        kPremium = 1 << 8,
+    };
+
+    static const constexpr u32 kRecommendFields = kStatus | kFname | kSname | kBirth | kPremium;
+    static const constexpr u32 kSuggestFields   = kStatus | kFname | kSname;
+
+    explicit AccountWriter(const AccountStore &store) : store_(store) {
+        static const char *const kStatuses[] = {"свободны", "всё сложно", "заняты"};
+        for (size_t i = 0; i < get_size(kStatuses); ++i) {
+            status_[i].assign(",\"status\":\"");
+            Json::escape(kStatuses[i], status_[i]);
+            status_[i] += '"';
+        }
+    }
+
+    // Upper bound of one serialized account with every field present. It only grows, and a row read after it is
+    // computed may already use longer strings: writeList() checks again per account
+    size_t maxSize() const {
+        size_t size = sizeof("{\"id\":4294967295}") + store_.maxEmailFragment() + store_.maxPhoneFragment();
+        size += sizeof(",\"sex\":\"f\"") + status_[1].size();
+        size += store_.fnames.maxFragment() + store_.snames.maxFragment() + store_.countries.maxFragment() + store_.cities.maxFragment();
+        size += sizeof(",\"birth\":-2147483648") + sizeof(",\"premium\":{\"start\":-2147483648,\"finish\":-2147483648}");
+        return size;
+    }
+
+    // Writes {"accounts":[...]} for ids that exist in the store
+    void writeList(Buffer &out, const u32 *ids, size_t count, u32 fields) const {
+        size_t max_size = maxSize();
+        out.reserve(sizeof("{\"accounts\":[]}") + count * (max_size + 1));
+
+        char *begin = out.tail();
+        char *p     = put(begin, "{\"accounts\":[");
+        bool  first = true;
+        for (size_t i = 0; i < count; ++i) {
+            StoredAccount acc;
+            if (!store_.read(ids[i], acc)) continue;
+
+            // The writer raises the maxima before it publishes a row, so this sees whatever `acc` refers to
+            if (HLCUP_UNLIKELY(maxSize() > max_size)) {
+                out.commit(static_cast<size_t>(p - begin));
+                max_size = maxSize();
+                out.reserve((count - i) * (max_size + 1) + sizeof("]}"));
+                begin = p = out.tail();
+            }
+
+            if (!first) *p++ = ',';
+            p     = write(p, acc, fields);
+            first = false;
+        }
+        p = put(p, "]}");
+
+        out.commit(static_cast<size_t>(p - begin));
+    }
+
+    // `p` needs maxSize() bytes of space, returns the new end
+    char *write(char *p, const StoredAccount &acc, u32 fields) const {
+        p = put(p, "{\"id\":");
+        p = IntFormat::write(p, acc.id);
+        p = put(p, store_.fragment(acc.email));
+
+        if ((fields & kSex) != 0) p = put(p, acc.sex == Account::kMale ? std::string_view(",\"sex\":\"m\"") : std::string_view(",\"sex\":\"f\""));
+        if ((fields & kStatus) != 0 && acc.status != Account::kInvalidStatus) p = put(p, status_[acc.status]);
+        if ((fields & kFname) != 0) p = put(p, store_.fnames.fragment(acc.fname));
+        if ((fields & kSname) != 0) p = put(p, store_.snames.fragment(acc.sname));
+        if ((fields & kPhone) != 0) p = put(p, store_.fragment(acc.phone));
+        if ((fields & kCountry) != 0) p = put(p, store_.countries.fragment(acc.country));
+        if ((fields & kCity) != 0) p = put(p, store_.cities.fragment(acc.city));
+        if ((fields & kBirth) != 0 && acc.birth != kInvalidTimestamp) {
+            p = put(p, ",\"birth\":");
+            p = IntFormat::write(p, acc.birth);
+        }
+        if ((fields & kPremium) != 0 && acc.premium_start != kInvalidTimestamp) {
+            p = put(p, ",\"premium\":{\"start\":");
+            p = IntFormat::write(p, acc.premium_start);
+            p = put(p, ",\"finish\":");
+            p = IntFormat::write(p, acc.premium_finish);
+            *p++ = '}';
+        }
+
+        *p++ = '}';
+        return p;
+    }
+
+private:
+    static char *put(char *p, std::string_view s) {
+        ::memcpy(p, s.data(), s.size());
+        return p + s.size();
+    }
+
+    const AccountStore &store_;
+    std::string         status_[3];
+};
+
+}  // namespace hlcup
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "HttpParser.hpp"
+#include "Request.hpp"
+#include "Response.hpp"
+#include "TcpSocket.hpp"
+#include "core/Buffer.hpp"
+
+namespace hlcup {
+
+// Per-connection state shared by the server loops: socket, incremental parser and IO buffers.
+struct Connection {
+    TcpSocket     sock;
+    HttpParser    parser;
+    Request       req;
+    Buffer        in;
+    ResponseQueue out;
+    bool          peer_closed = false;  // read side hit EOF, the connection closes once `out` is drained
+
+    explicit Connection(int fd) : sock(fd) { parser.reset(); }
+
+    void reset(int fd) {
+        sock = TcpSocket(fd);
+        parser.reset();
+        req.mask = 0;
+        in.clear();
+        out.clear();
+        peer_closed = false;
+    }
+
+    // Answers every complete request buffered in `in`, incomplete ones stay in the parser state or in the buffer.
+    template <typename Handler>
+    u32 process(Handler &handler) {
+        u32 handled = 0;
+
+        for (;;) {
+            if (!parser.done()) {
+                if (in.empty()) break;
+
+                ssize_t n = parser.parse(in.data(), in.data() + in.size(), req);
+                in.consume(static_cast<size_t>(n));
+                if (!parser.done()) break;
+            }
+
+            if (in.size() < parser.content_length) break;
+
+            handler.handle(req, in.data(), parser.content_length, out);
+            in.consume(parser.content_length);
+            parser.reset();
+            req.mask = 0;
+            ++handled;
+        }
+
+        return handled;
+    }
+};
+
+}  // namespace hlcup
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+#include "core/StableVector.hpp"
+
+namespace hlcup {
+
+struct Json {
+    // Appends s as the contents of a JSON string: quotes, backslashes and control characters are escaped, and
+    // everything outside ASCII is written as \uXXXX (surrogate pairs above the BMP), as the reference answers are.
+    static void escape(std::string_view s, std::string &out) {
+        static const char kHex[] = "0123456789abcdef";
+
+        auto put_u = [&out](unsigned cp) {
+            out += "\\u";
+            out += kHex[(cp >> 12) & 0xf];
+            out += kHex[(cp >> 8) & 0xf];
+            out += kHex[(cp >> 4) & 0xf];
+            out += kHex[cp & 0xf];
+        };
+
+        const u8 *p  = reinterpret_cast<const u8 *>(s.data());
+        const u8 *pe = p + s.size();
+        while (p < pe) {
+            unsigned cp = *p++;
+            if (cp >= 0x80) {
+                unsigned extra = cp >= 0xf0 ? 3 : cp >= 0xe0 ? 2 : 1;
+                cp &= 0x3f >> extra;
+                for (; extra > 0 && p < pe; --extra) cp = (cp << 6) | (*p++ & 0x3f);
+            }
+
+            if (cp == '"' || cp == '\\') {
+                out += '\\';
+                out += static_cast<char>(cp);
+            } else if (cp < 0x20 || cp >= 0x80) {
+                if (cp >= 0x10000) {
+                    cp -= 0x10000;
+                    put_u(0xd800 + (cp >> 10));
+                    put_u(0xdc00 + (cp & 0x3ff));
+                } else {
+                    put_u(cp);
+                }
+            } else {
+                out += static_cast<char>(cp);
+            }
+        }
+    }
+};
+
+// Interned values of one account field. Next to the value every entry keeps its ready-to-emit JSON member,
+// e.g. `,"city":"Мо..."`, so the serializer copies it without looking at the characters again.
+// Id 0 means the field is absent and has an empty fragment.
+//
+// add() and find() belong to the store's writer; value(), fragment() and maxFragment() may be called from any
+// thread for ids taken from a published row, entries never move once added.
+struct Dictionary {
+    static const constexpr u16 kNull = 0;
+
+    explicit Dictionary(std::string_view key) : key_(key) {
+        values_.resize(1);
+        fragments_.resize(1);
+    }
+
+    Dictionary(const Dictionary &) = delete;
+    Dictionary &operator=(const Dictionary &) = delete;
+
+    u16 add(std::string_view value) {
+        auto it = ids_.find(value);
+        if (it != ids_.end()) return it->second;
+
+        u16 id = static_cast<u16>(values_.size());
+
+        std::string fragment(",\"");
+        fragment += key_;
+        fragment += "\":\"";
+        Json::escape(value, fragment);
+        fragment += '"';
+        if (fragment.size() > maxFragment()) max_fragment_.store(static_cast<u32>(fragment.size()), std::memory_order_relaxed);
+
+        fragments_.resize(id + 1u);
+        fragments_[id] = std::move(fragment);
+        values_.resize(id + 1u);
+        values_[id] = std::string(value);
+        ids_.emplace(values_[id], id);
+
+        return id;
+    }
+
+    u16 find(std::string_view value) const {
+        auto it = ids_.find(value);
+        return it == ids_.end() ? kNull : it->second;
+    }
+
+    std::string_view value(u16 id) const { return values_[id]; }
+    std::string_view fragment(u16 id) const { return fragments_[id]; }
+
+    size_t size() const { return values_.size(); }
+    u32    maxFragment() const { return max_fragment_.load(std::memory_order_relaxed); }
+
+private:
+    std::string      key_;
+    std::atomic<u32> max_fragment_{0};
+
+    // Strings stay in place, ids_ points into values_
+    StableVector<std::string, 8, 256>         values_;
+    StableVector<std::string, 8, 256>         fragments_;
+    std::unordered_map<std::string_view, u16> ids_;
+};
+
+}  // namespace hlcup
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "epoll.hpp"
+#include "io.hpp"
+#include "sched.hpp"
+
+#include "Connection.hpp"
+#include "RequestHandler.hpp"
+#include "Server.hpp"
+#include "TcpSocket.hpp"
+#include "common.hpp"
+
+#include "fmt/format.hpp"
+
+namespace hlcup {
+
+// One loop per core: every worker owns a SO_REUSEPORT listener and an edge-triggered epoll set, so connections
+// never move between threads and nothing is shared on the hot path.
+struct EpollWorker {
+    static const constexpr int      kMaxEvents       = 256;
+    static const constexpr size_t   kReadChunk       = 16384;
+    static const constexpr u32      kConnEvents      = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    static const constexpr unsigned kClockCheckPolls = 64;  // empty spins between idle checks, power of two
+    static const constexpr unsigned kMaxIov          = 64;
+
+    EpollWorker(const ServerConfig &config, unsigned cpu) : config_(config), cpu_(cpu), handler_(config.writer) {}
+
+    ~EpollWorker() {
+        if (epfd_ >= 0) ef::platform::close(epfd_);
+        if (listener_.fd() >= 0) listener_.close();
+    }
+
+    bool init() {
+        listener_ = TcpSocket();
+        if (listener_.fd() < 0) {
+            fmt::print(stderr, "worker {}: socket() failed: {}\n", cpu_, errno);
+            return false;
+        }
+
+        listener_.setoption(SOL_SOCKET, SO_REUSEADDR, 1);
+        listener_.setoption(SOL_SOCKET, SO_REUSEPORT, 1);
+        listener_.setoption(IPPROTO_TCP, TCP_NODELAY, 1);
+
+        // accepted sockets inherit the budget; values above net.core.busy_read need CAP_NET_ADMIN
+        if (config_.busy_poll_us > 0 && listener_.setoption(SOL_SOCKET, SO_BUSY_POLL, static_cast<int>(config_.busy_poll_us)) < 0) {
+            fmt::print(stderr, "worker {}: SO_BUSY_POLL failed: {}\n", cpu_, strerror(listener_.lastError()));
+        }
+
+        if (listener_.bind(config_.port) < 0 || listener_.listen(config_.backlog) < 0) {
+            fmt::print(stderr, "worker {}: bind/listen on port {} failed: {}\n", cpu_, config_.port, strerror(listener_.lastError()));
+            return false;
+        }
+
+        epfd_ = ef::platform::epoll_create1(EPOLL_CLOEXEC);
+        if (epfd_ < 0) {
+            fmt::print(stderr, "worker {}: epoll_create1() failed: {}\n", cpu_, epfd_);
+            return false;
+        }
+
+        epoll_event ev{};
+        ev.events   = EPOLLIN | EPOLLET;
+        ev.data.ptr = nullptr;
+        int err     = ef::platform::epoll_ctl(epfd_, EPOLL_CTL_ADD, listener_.fd(), &ev);
+        if (err < 0) {
+            fmt::print(stderr, "worker {}: epoll_ctl(listener) failed: {}\n", cpu_, err);
+            return false;
+        }
+
+        return true;
+    }
+
+    const WorkerStats &stats() const { return stats_; }
+
+    void run() {
+        int err = ef::platform::set_affinity(static_cast<int>(cpu_));
+        if (err < 0) { fmt::print(stderr, "worker {}: sched_setaffinity() failed: {}\n", cpu_, err); }
+
+        epoll_event events[kMaxEvents];
+
+        // Busy-poll mode spins on non-blocking epoll_wait() while requests keep coming and parks in a blocking
+        // wait once nothing has arrived for idle_ms, the first event after that switches spinning back on.
+        using Clock = std::chrono::steady_clock;
+
+        const bool        busy        = config_.busy_poll_us > 0;
+        const auto        idle        = std::chrono::milliseconds(config_.idle_ms);
+        bool              spinning    = busy;
+        unsigned          empty_polls = 0;
+        Clock::time_point last_event  = Clock::now();
+
+        while (true) {
+            int n = ef::platform::epoll_wait(epfd_, events, kMaxEvents, spinning ? 0 : -1);
+            stats_.addSyscalls(1);
+            if (HLCUP_UNLIKELY(n < 0)) {
+                if (n == -EINTR) continue;
+                fmt::print(stderr, "worker {}: epoll_wait() failed: {}\n", cpu_, n);
+                break;
+            }
+
+            if (busy) {
+                if (n > 0) {
+                    spinning    = true;
+                    empty_polls = 0;
+                    last_event  = Clock::now();
+                } else if ((++empty_polls & (kClockCheckPolls - 1)) == 0 && Clock::now() - last_event > idle) {
+                    spinning = false;
+                }
+            }
+
+            for (int i = 0; i < n; ++i) {
+                Connection *conn = reinterpret_cast<Connection *>(events[i].data.ptr);
+                if (conn == nullptr) {
+                    acceptAll();
+                    continue;
+                }
+
+                u32 ev = events[i].events;
+                if (HLCUP_UNLIKELY(ev & EPOLLERR)) {
+                    close(conn);
+                    continue;
+                }
+                if (ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+                    if (!onReadable(conn)) continue;
+                }
+                if ((ev & EPOLLOUT) && (!flush(conn) || (conn->peer_closed && conn->out.empty()))) close(conn);
+            }
+        }
+    }
+
+private:
+    void acceptAll() {
+        while (true) {
+            long fd = listener_.accept();
+            stats_.addSyscalls(1);
+            if (fd < 0) {
+                int err = listener_.lastError();
+                if (err != EAGAIN && err != EWOULDBLOCK && err != ECONNABORTED) { fmt::print(stderr, "worker {}: accept4() failed: {}\n", cpu_, err); }
+                if (err == ECONNABORTED) continue;
+                return;
+            }
+
+            Connection *conn = allocConnection(static_cast<int>(fd));
+
+            epoll_event ev{};
+            ev.events   = kConnEvents;
+            ev.data.ptr = conn;
+            int err     = ef::platform::epoll_ctl(epfd_, EPOLL_CTL_ADD, static_cast<int>(fd), &ev);
+            stats_.addSyscalls(1);
+            if (err < 0) {
+                fmt::print(stderr, "worker {}: epoll_ctl(conn) failed: {}\n", cpu_, err);
+                close(conn);
+            }
+        }
+    }
+
+    // Reads until EAGAIN as edge-triggered mode requires, answers everything that was read. Returns false if the
+    // connection was closed.
+    bool onReadable(Connection *conn) {
+        while (true) {
+            conn->in.reserve(kReadChunk);
+            long n = conn->sock.read(conn->in.tail(), conn->in.space());
+            stats_.addSyscalls(1);
+            if (n > 0) {
+                conn->in.commit(static_cast<size_t>(n));
+                continue;
+            }
+            if (n == 0) {
+                conn->peer_closed = true;
+                break;
+            }
+
+            int err = conn->sock.lastError();
+            if (err == EAGAIN || err == EWOULDBLOCK) break;
+            if (err == EINTR) continue;
+            close(conn);
+            return false;
+        }
+
+        stats_.addRequests(conn->process(handler_));
+
+        // a half-closed client still gets its answers, what the socket didn't take goes out on EPOLLOUT
+        if (!flush(conn) || (conn->peer_closed && conn->out.empty())) {
+            close(conn);
+            return false;
+        }
+        return true;
+    }
+
+    // Writes as much of the pending output as the socket takes, the rest goes out on the next EPOLLOUT.
+    bool flush(Connection *conn) {
+        IoVec iov[kMaxIov];
+
+        while (!conn->out.empty()) {
+            unsigned cnt = conn->out.fill(iov, kMaxIov);
+            long     n   = conn->sock.writev(iov, cnt);
+            stats_.addSyscalls(1);
+            if (n > 0) {
+                conn->out.consume(static_cast<size_t>(n));
+                continue;
+            }
+
+            int err = conn->sock.lastError();
+            if (err == EAGAIN || err == EWOULDBLOCK) return true;
+            if (err == EINTR) continue;
+            return false;
+        }
+        return true;
+    }
+
+    Connection *allocConnection(int fd) {
+        if (free_.empty()) {
+            connections_.emplace_back(std::make_unique<Connection>(fd));
+            return connections_.back().get();
+        }
+
+        Connection *conn = free_.back();
+        free_.pop_back();
+        conn->reset(fd);
+        return conn;
+    }
+
+    void close(Connection *conn) {
+        // closing the descriptor drops it from the epoll set as well
+        conn->sock.close();
+        stats_.addSyscalls(1);
+        free_.push_back(conn);
+    }
+
+    const ServerConfig &config_;
+    unsigned            cpu_;
+    TcpSocket           listener_{-1};
+    int                 epfd_ = -1;
+    RequestHandler      handler_;
+    WorkerStats         stats_;
+
+    std::vector<std::unique_ptr<Connection>> connections_;
+    std::vector<Connection *>                free_;
+};
+
+struct EpollServer {
+    explicit EpollServer(const ServerConfig &config) : config_(config) {}
+
+    // Starts a pinned worker per thread and blocks until they exit
+    int run() { return run_workers<EpollWorker>(config_, "epoll"); }
+
+private:
+    ServerConfig config_;
+};
+
+}  // namespace hlcup
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include "ParseUtils.hpp"
+#include "common.hpp"
+
+namespace hlcup {
+
+// Skips header lines without the state machine: '\n' positions are found 16 bytes at a time and only line starts
+// are inspected, either for the terminating empty line or for a case-insensitive "content-length".
+struct HeaderScanner {
+    // p must point to the beginning of a header line. Returns position right after the empty line, or nullptr if
+    // it isn't buffered yet. content_length is only looked for when the pointer is not null.
+    static inline const char *scan(const char *p, const char *pe, u32 *content_length) {
+        if (HLCUP_UNLIKELY(pe - p < 2)) return nullptr;
+        const char *end = checkLine(p, pe, content_length);
+        if (end != nullptr) return end;
+
+        const __m128i lf = _mm_set1_epi8('\n');
+        const char *  q  = p;
+
+        while (pe - q >= 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(q));
+            u32     m = static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, lf)));
+
+            while (m != 0) {
+                const char *line = q + __builtin_ctz(m) + 1;
+                m &= m - 1;
+
+                if (HLCUP_UNLIKELY(pe - line < 2)) return nullptr;
+                end = checkLine(line, pe, content_length);
+                if (end != nullptr) return end;
+            }
+            q += 16;
+        }
+
+        for (; q < pe; ++q) {
+            if (*q != '\n') continue;
+            if (pe - q < 3) return nullptr;
+            end = checkLine(q + 1, pe, content_length);
+            if (end != nullptr) return end;
+        }
+
+        return nullptr;
+    }
+
+private:
+    HLCUP_ALWAYS_INLINE static inline const char *checkLine(const char *line, const char *pe, u32 *content_length) {
+        if (line[0] == '\r' && line[1] == '\n') return line + 2;
+        if (content_length != nullptr && (line[0] | 0x20) == 'c') parseContentLength(line, pe, *content_length);
+        return nullptr;
+    }
+
+    static inline void parseContentLength(const char *p, const char *pe, u32 &content_length) {
+        static const constexpr size_t kNameLength = 14;
+
+        if (HLCUP_LIKELY(pe - p >= 16)) {
+            // '|0x20' lowercases letters and keeps '-' as is
+            const __m128i name  = _mm_setr_epi8('c', 'o', 'n', 't', 'e', 'n', 't', '-', 'l', 'e', 'n', 'g', 't', 'h', 0, 0);
+            const __m128i lower = _mm_set1_epi8(0x20);
+            __m128i       v     = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), lower);
+            u32           eq    = static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, name)));
+            if ((eq & 0x3fff) != 0x3fff) return;
+        } else {
+            static const char kName[] = "content-length";
+            if (pe - p < static_cast<ssize_t>(kNameLength)) return;
+            for (size_t i = 0; i < kNameLength; ++i) {
+                if ((p[i] | 0x20) != kName[i]) return;
+            }
+        }
+
+        p += kNameLength;
+        while (p < pe && *p == ' ') ++p;
+        if (p == pe || *p != ':') return;
+        ++p;
+        while (p < pe && *p == ' ') ++p;
+
+        u32 val;
+        if (ParseUtils::parseUint(p, pe, val)) content_length = val;
+    }
+};
+
+}  // namespace hlcup
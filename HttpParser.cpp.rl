@@ -2,6 +2,9 @@
 
 #include <iostream>
 
+#include "HeaderScanner.hpp"
+#include "RequestRouter.hpp"
+
 namespace hlcup {
 namespace {
 
@@ -59,12 +62,7 @@ namespace {
 
     proto = "HTTP/1.1";
 
-    skip_line := [^\n]** '\n' @{ fgoto headers; };
-
-    headers := (
-    (/content-length/i space** ':' space** unsigned_number %{ content_length = tmp.u32_val; } crlf) |
-    (crlf @{ fbreak; })
-    )** @{ fgoto skip_line; };
+    skip_line := [^\n]** '\n' @{ stage = kHeaders; fbreak; };
 
     request_line = [\r\n ]** (
         ("GET /accounts/" entity_id "/suggest/?" basic_params " " proto crlf %{ req.type = R::Type::kSuggest; } ) |
@@ -73,16 +71,34 @@ namespace {
         ("GET /accounts/group/?" basic_params " " proto crlf %{ req.type = R::Type::kGroup;  } )
     ) @!{ req.type = R::Type::kInvalid; fgoto skip_line; };
 
-    main := ( request_line >{ out_buf = req.string_data; offset = 0; } @{ fgoto headers; } );
+    main := ( request_line >{ out_buf = req.string_data; offset = 0; } @{ stage = kHeaders; fbreak; } );
+
+    # entry points for RequestRouter, method and path are already consumed
+    # headers are left to HeaderScanner
+    filter_query := ( filter_params " " proto crlf ) @{ stage = kHeaders; fbreak; } @!{ req.type = R::Type::kInvalid; fgoto skip_line; };
+    basic_query  := ( basic_params " " proto crlf ) @{ stage = kHeaders; fbreak; } @!{ req.type = R::Type::kInvalid; fgoto skip_line; };
+    post_query   := ( filter_params " " proto crlf ) @{ stage = kHeaders; fbreak; } @!{ req.type = R::Type::kInvalid; fgoto skip_line; };
 
     write data;
 }%%
 
+int entry_state(Request::Type type) {
+    switch (type) {
+    case Request::kFilter: return http_parser_en_filter_query;
+    case Request::kGroup:
+    case Request::kRecommend:
+    case Request::kSuggest: return http_parser_en_basic_query;
+    default: return http_parser_en_post_query;
+    }
+}
+
 }  // namespace
 
     // clang-format on
 
     void HttpParser::reset() {
+        stage          = kRequestLine;
+        content_length = 0;
         // clang-format off
     %% write init;
         // clang-format on
@@ -93,13 +109,44 @@ namespace {
         using F = R::Filter;
         using B = R::Basic;
 
-        const char *eof = nullptr;
-
-        // clang-format off
-        %% write exec;
-        // clang-format on
-
-        return 0;
+        const char *start = p;
+        const char *eof   = nullptr;
+
+        if (stage == kRequestLine) {
+            if (cs == http_parser_start) {
+                RequestRouter::Route route = RequestRouter::route(p, pe);
+                if (HLCUP_LIKELY(route.status == RequestRouter::kMatched)) {
+                    req.type                  = route.type;
+                    req.query.basic.entity_id = route.entity_id;
+                    out_buf                   = req.string_data;
+                    offset                    = 0;
+                    p                         = route.params;
+                    cs                        = entry_state(route.type);
+                } else if (route.status == RequestRouter::kUnknown) {
+                    req.type = R::Type::kNotFound;
+                    cs       = http_parser_en_skip_line;
+                } else {
+                    // nothing consumed, the line is routed again with the next read
+                    return 0;
+                }
+            }
+
+            // clang-format off
+            %% write exec;
+            // clang-format on
+        }
+
+        if (stage == kHeaders) {
+            bool        is_get = req.type >= R::Type::kFilter && req.type <= R::Type::kSuggest;
+            const char *end    = HeaderScanner::scan(p, pe, is_get ? nullptr : &content_length);
+            if (HLCUP_LIKELY(end != nullptr)) {
+                stage = kDone;
+                p     = end;
+            }
+            // otherwise the header lines are left unconsumed and scanned again once the rest of them arrives
+        }
+
+        return p - start;
     }
 
     }  // namespace hlcup
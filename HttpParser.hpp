@@ -5,12 +5,22 @@
 namespace hlcup {
 
 struct HttpParser {
+    enum Stage : u8 {
+        kRequestLine = 0,
+        kHeaders,
+        kDone,
+    };
+
     u32 content_length;
 
     void reset();
 
+    // Returns how many bytes it consumed, the request head is complete once done(). Header lines are only
+    // consumed together with the empty line after them, so the caller keeps the rest buffered.
     ssize_t parse(const char *p, const char *pe, Request &req);
 
+    bool done() const { return stage == kDone; }
+
 private:
     union {
         u64       u64_val;
@@ -22,6 +32,7 @@ private:
     int   cs;
     char *out_buf;
     u32   offset;
+    Stage stage;
 };
 
 }  // namespace hlcup
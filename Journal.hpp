@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "io.hpp"
+#include "mman.hpp"
+
+#include "Account.hpp"
+#include "common.hpp"
+
+namespace hlcup {
+
+// Write-ahead log of the POSTs StoreWriter applies, so that a restart replays them on top of the loaded data
+// instead of losing them. The file is preallocated and mapped once; records are binary accounts or like batches
+// appended by the writer thread with plain stores, and a group of them becomes durable with one store of the
+// committed length in the header. A record past the committed length does not exist, so a process killed
+// halfway through a record or a group leaves a journal that replays cleanly. The page cache keeps what was
+// committed across a process restart, flush() also puts it on disk.
+class Journal {
+public:
+    static const constexpr u64    kMagic           = 0x314c4e524a434c48;  // "HLCJRNL1"
+    static const constexpr size_t kHeaderSize      = 4096;
+    static const constexpr size_t kDefaultCapacity = size_t(1) << 28;
+
+    Journal() = default;
+
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    ~Journal() {
+        if (base_ != nullptr) ef::platform::munmap(base_, capacity_);
+        if (fd_ >= 0) ef::platform::close(fd_);
+    }
+
+    // Opens the journal at `path` or creates it with room for `capacity` bytes. Returns 0 or -errno
+    int open(const char *path, size_t capacity = kDefaultCapacity) {
+        fd_ = ef::platform::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd_ < 0) return fd_;
+
+        struct stat st;
+        int         err = ef::platform::fstat(fd_, &st);
+        if (err < 0) return err;
+
+        capacity_ = std::max(capacity, static_cast<size_t>(st.st_size));
+        if (capacity_ < kHeaderSize * 2) return -EINVAL;
+        // Blocks are allocated now, so appending never hits ENOSPC as a SIGBUS
+        err = ef::platform::fallocate(fd_, 0, 0, static_cast<off_t>(capacity_));
+        if (err < 0) return err;
+
+        void *base = ef::platform::mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (ef::platform::is_mmap_error(base)) return static_cast<int>(reinterpret_cast<long>(base));
+        base_   = reinterpret_cast<char *>(base);
+        header_ = reinterpret_cast<Header *>(base_);
+
+        if (st.st_size == 0) {
+            header_->magic     = kMagic;
+            header_->committed = 0;
+        } else if (header_->magic != kMagic || header_->committed > capacity_ - kHeaderSize) {
+            return -EINVAL;  // not ours, leave it alone
+        }
+        tail_ = kHeaderSize + header_->committed;
+        return 0;
+    }
+
+    // Calls apply(const AccountUpdate &) for every committed record in order, returns how many there were.
+    // Before the writer starts appending
+    template <typename F>
+    u64 replay(F &&apply) const {
+        const char *p   = base_ + kHeaderSize;
+        const char *end = base_ + kHeaderSize + __atomic_load_n(&header_->committed, __ATOMIC_ACQUIRE);
+
+        AccountUpdate u;
+        u64           n = 0;
+        for (; p < end; p += reinterpret_cast<const Record *>(p)->size) {
+            if (!decode(p, end, u)) break;
+            apply(static_cast<const AccountUpdate &>(u));
+            ++n;
+        }
+        return n;
+    }
+
+    // Writer thread: false when the journal is full
+    bool append(const AccountUpdate &u) {
+        if (u.kind == AccountUpdate::kLikes) return appendLikes(u.likes);
+
+        const Account &acc  = u.acc;
+        const StringRef *refs[kStrings] = {&acc.fname, &acc.sname, &acc.country, &acc.city, &acc.email, &acc.phone};
+
+        size_t interests = acc.getInterestsCount();
+        size_t size      = sizeof(Record) + acc.likes.size() * sizeof(Account::Like) + interests * sizeof(u16);
+        for (const StringRef *ref : refs) {
+            if (ref->offset != Account::kInvalidOffset) size += ref->size;
+        }
+        if (interests != 0) size += acc.interests.back() - acc.interests.front();
+        size = (size + 7) & ~size_t(7);
+        if (HLCUP_UNLIKELY(tail_ + size > capacity_)) return false;
+
+        char *  p   = base_ + tail_;
+        Record *rec = reinterpret_cast<Record *>(p);
+        rec->size           = static_cast<u32>(size);
+        rec->kind           = u.kind;
+        rec->sex            = acc.sex;
+        rec->status         = acc.status;
+        rec->fields         = 0;
+        rec->id             = acc.id;
+        rec->birth          = acc.birth;
+        rec->joined         = acc.joined;
+        rec->premium_start  = acc.premium.start;
+        rec->premium_finish = acc.premium.finish;
+        rec->interests      = static_cast<u16>(interests);
+        rec->reserved       = 0;
+        rec->likes          = static_cast<u32>(acc.likes.size());
+        p += sizeof(Record);
+
+        std::memcpy(p, acc.likes.data(), acc.likes.size() * sizeof(Account::Like));
+        p += acc.likes.size() * sizeof(Account::Like);
+        for (size_t i = 0; i < interests; ++i, p += sizeof(u16)) {
+            u16 len = static_cast<u16>(acc.interests[i + 1] - acc.interests[i]);
+            std::memcpy(p, &len, sizeof(len));
+        }
+        for (unsigned i = 0; i < kStrings; ++i) {
+            rec->lengths[i] = 0;
+            if (refs[i]->offset == Account::kInvalidOffset) continue;
+            rec->fields |= 1u << i;
+            rec->lengths[i] = static_cast<u16>(refs[i]->size);
+            std::memcpy(p, acc.string_data + refs[i]->offset, refs[i]->size);
+            p += refs[i]->size;
+        }
+        if (interests != 0) std::memcpy(p, acc.string_data + acc.interests.front(), acc.interests.back() - acc.interests.front());
+
+        tail_ += size;
+        return true;
+    }
+
+    // Writer thread: a like batch is the record header, with only `likes` set, and the likes as they came
+    bool appendLikes(const std::vector<LikeEdge> &likes) {
+        size_t size = (sizeof(Record) + likes.size() * sizeof(LikeEdge) + 7) & ~size_t(7);
+        if (HLCUP_UNLIKELY(tail_ + size > capacity_)) return false;
+
+        Record *rec = reinterpret_cast<Record *>(base_ + tail_);
+        std::memset(rec, 0, sizeof(Record));
+        rec->size  = static_cast<u32>(size);
+        rec->kind  = AccountUpdate::kLikes;
+        rec->likes = static_cast<u32>(likes.size());
+        std::memcpy(rec + 1, likes.data(), likes.size() * sizeof(LikeEdge));
+
+        tail_ += size;
+        return true;
+    }
+
+    // Writer thread: makes everything appended so far part of the journal
+    void commit() { __atomic_store_n(&header_->committed, tail_ - kHeaderSize, __ATOMIC_RELEASE); }
+
+    // Writes committed records through to the disk. Returns 0 or -errno
+    int flush() { return ef::platform::msync(base_, tail_, MS_SYNC); }
+
+    size_t size() const { return tail_ - kHeaderSize; }
+
+private:
+    static const constexpr unsigned kStrings = 6;
+
+    struct Header {
+        u64 magic;
+        u64 committed;  // bytes of records after the header
+    };
+
+    // Followed by the likes, the interest lengths, the present strings in the order of `lengths` and the
+    // interests, then padding to 8 bytes
+    struct Record {
+        u32       size;  // with everything that follows
+        u8        kind;
+        u8        sex;
+        u8        status;
+        u8        fields;  // bit i: string i is present
+        u32       id;
+        Timestamp birth, joined, premium_start, premium_finish;
+        u16       lengths[kStrings];  // fname, sname, country, city, email, phone
+        u16       interests;
+        u16       reserved;
+        u32       likes;
+    };
+    static_assert(sizeof(Record) % 8 == 0, "records are 8-byte aligned");
+
+    static bool decode(const char *p, const char *end, AccountUpdate &u) {
+        const Record *rec = reinterpret_cast<const Record *>(p);
+        if (end - p < static_cast<ptrdiff_t>(sizeof(Record)) || rec->size < sizeof(Record) || rec->size > static_cast<size_t>(end - p)) return false;
+        const char *rec_end = p + rec->size;
+
+        u.kind = static_cast<AccountUpdate::Kind>(rec->kind);
+        u.likes.clear();
+        if (u.kind == AccountUpdate::kLikes) {
+            if (static_cast<size_t>(rec->size - sizeof(Record)) < rec->likes * sizeof(LikeEdge)) return false;
+            u.likes.resize(rec->likes);
+            std::memcpy(u.likes.data(), rec + 1, rec->likes * sizeof(LikeEdge));
+            return true;
+        }
+
+        Account &acc = u.acc;
+        acc.clear();
+        acc.id              = rec->id;
+        acc.sex             = static_cast<Account::Sex>(rec->sex);
+        acc.status          = static_cast<Account::Status>(rec->status);
+        acc.birth           = rec->birth;
+        acc.joined          = rec->joined;
+        acc.premium.start   = rec->premium_start;
+        acc.premium.finish  = rec->premium_finish;
+        p += sizeof(Record);
+
+        if (static_cast<size_t>(rec_end - p) < rec->likes * sizeof(Account::Like) + rec->interests * sizeof(u16)) return false;
+        acc.likes.resize(rec->likes);
+        std::memcpy(acc.likes.data(), p, rec->likes * sizeof(Account::Like));
+        p += rec->likes * sizeof(Account::Like);
+        const char *interest_lengths = p;
+        p += rec->interests * sizeof(u16);
+
+        u32       offset = 0;
+        StringRef *refs[kStrings] = {&acc.fname, &acc.sname, &acc.country, &acc.city, &acc.email, &acc.phone};
+        for (unsigned i = 0; i < kStrings; ++i) {
+            if (!(rec->fields & (1u << i))) continue;
+            u32 len = rec->lengths[i];
+            if (len > static_cast<size_t>(rec_end - p) || offset + len > Account::kStringCapacity) return false;
+            std::memcpy(acc.string_data + offset, p, len);
+            *refs[i] = StringRef{offset, len};
+            offset += len;
+            p += len;
+        }
+        if (rec->interests != 0) acc.interests.push_back(offset);
+        for (u16 i = 0; i < rec->interests; ++i) {
+            u16 len;
+            std::memcpy(&len, interest_lengths + i * sizeof(u16), sizeof(len));
+            if (len > static_cast<size_t>(rec_end - p) || offset + len > Account::kStringCapacity) return false;
+            std::memcpy(acc.string_data + offset, p, len);
+            offset += len;
+            p += len;
+            acc.interests.push_back(offset);
+        }
+        return true;
+    }
+
+    int     fd_       = -1;
+    char *  base_     = nullptr;
+    Header *header_   = nullptr;
+    size_t  capacity_ = 0;
+    size_t  tail_     = 0;  // end of the appended records, committed or not
+};
+
+}  // namespace hlcup
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Account.hpp"
+#include "common.hpp"
+#include "core/Published.hpp"
+#include "core/StableVector.hpp"
+
+namespace hlcup {
+
+// Who liked whom, by liker (forward) and by likee (reverse). Each direction is a compressed sparse row array
+// built at load time, rows sorted by id, plus small per-account append buffers for the likes POSTed since.
+// Readers merge the two. Once the buffers hold kCompactLikes likes, the writer freezes them and starts an
+// empty set, and the compactor thread folds the frozen set into new arrays. The writer then swaps those in
+// together with the buffers that filled up meanwhile.
+//
+// Everything a reader looks at hangs off one published Generation. The writer thread (StoreWriter) is the
+// only one that publishes, appends and frees; the compactor only reads a frozen generation and hands its
+// result back.
+class LikeStore {
+public:
+    enum Direction : u8 {
+        kForward = 0,  // liker -> likee
+        kReverse,      // likee -> liker
+    };
+
+    static const constexpr size_t kCompactLikes = 1 << 16;
+    static const constexpr auto   kPoll         = std::chrono::milliseconds(1);
+
+    LikeStore() = default;
+
+    LikeStore(const LikeStore &) = delete;
+    LikeStore &operator=(const LikeStore &) = delete;
+
+    ~LikeStore() {
+        stop();
+        delete done_.load(std::memory_order_relaxed);
+        delete job_.load(std::memory_order_relaxed);
+    }
+
+    // Loader: the likes of one loaded account, before build()
+    void load(u32 liker, const std::vector<Account::Like> &likes) {
+        for (const Account::Like &like : likes) loaded_.push_back(LikeEdge{liker, like.to_id, like.ts});
+    }
+
+    // Loader: builds both arrays from what load() got
+    void build() {
+        std::unique_ptr<Generation> gen(new Generation);
+        gen->csr[kForward] = fromEdges(loaded_, kForward);
+        gen->csr[kReverse] = fromEdges(loaded_, kReverse);
+        gen->active        = std::make_shared<Buffers>();
+        generations_.publish(gen.release());
+        std::vector<LikeEdge>().swap(loaded_);
+    }
+
+    // Compactor thread
+    void start() { thread_ = std::thread(&LikeStore::run, this); }
+
+    void stop() {
+        if (!thread_.joinable()) return;
+        stop_.store(true, std::memory_order_release);
+        thread_.join();
+    }
+
+    // Writer thread only
+    void add(u32 liker, u32 likee, Timestamp ts) {
+        Buffers &buffers = *generations_.current()->active;
+        buffers.append(kForward, liker, Account::Like{likee, ts});
+        buffers.append(kReverse, likee, Account::Like{liker, ts});
+    }
+
+    // Writer thread only: swaps in a finished compaction, frees what readers no longer use and freezes the
+    // buffers for the next one when they are large enough. Cheap when there is nothing to do
+    void maintain() {
+        if (done_.load(std::memory_order_relaxed) != nullptr) {
+            std::unique_ptr<Generation> done(done_.exchange(nullptr, std::memory_order_acquire));
+            done->active = generations_.current()->active;
+            generations_.publish(done.release());
+            compacting_ = false;
+            compactions_.fetch_add(1, std::memory_order_release);
+        }
+        generations_.reclaim();
+
+        const Generation *cur = generations_.current();
+        if (compacting_ || cur->active->likes < kCompactLikes || !thread_.joinable()) return;
+
+        std::unique_ptr<Generation> next(new Generation);
+        next->csr[kForward] = cur->csr[kForward];
+        next->csr[kReverse] = cur->csr[kReverse];
+        next->frozen        = cur->active;
+        next->active        = std::make_shared<Buffers>();
+
+        std::unique_ptr<Generation> job(new Generation);
+        job->csr[kForward] = cur->csr[kForward];
+        job->csr[kReverse] = cur->csr[kReverse];
+        job->frozen        = cur->active;
+
+        generations_.publish(next.release());
+        compacting_ = true;
+        job_.store(job.release(), std::memory_order_release);
+    }
+
+    u64 compactions() const { return compactions_.load(std::memory_order_acquire); }
+
+    class View;
+
+private:
+    static const constexpr unsigned kBlockLikes = 7;  // a block is a cache line
+    static const constexpr size_t   kSlabBlocks = 1 << 12;
+
+    struct alignas(64) Block {
+        Account::Like likes[kBlockLikes];
+        Block *       next;
+    };
+
+    // Blocks for one set of buffers, carved out of large slabs and freed all at once with them
+    class Slab {
+    public:
+        Block *alloc() {
+            if (used_ == kSlabBlocks) {
+                slabs_.emplace_back(new Block[kSlabBlocks]);
+                used_ = 0;
+            }
+            Block *block = &slabs_.back()[used_++];
+            block->next  = nullptr;
+            return block;
+        }
+
+    private:
+        std::vector<std::unique_ptr<Block[]>> slabs_;
+        size_t                                used_ = kSlabBlocks;
+    };
+
+    // A chain of blocks per account. The writer fills a like before it publishes the count with a release
+    // store, a reader walks only as far as the count it loaded
+    struct Row {
+        Block *          head = nullptr;
+        Block *          tail = nullptr;  // writer
+        std::atomic<u32> count{0};
+    };
+
+    struct Buffers {
+        StableVector<Row> rows[2];
+        Slab              slab;
+        size_t            likes = 0;  // in both directions together, counting each like once
+
+        void append(Direction d, u32 id, const Account::Like &like) {
+            if (id >= rows[d].size()) rows[d].resize(id + 1);
+            Row &row = rows[d][id];
+            u32  n   = row.count.load(std::memory_order_relaxed);
+
+            if (n == 0) {
+                row.head = row.tail = slab.alloc();
+            } else if (n % kBlockLikes == 0) {
+                row.tail = row.tail->next = slab.alloc();
+            }
+            row.tail->likes[n % kBlockLikes] = like;
+            row.count.store(n + 1, std::memory_order_release);
+            if (d == kForward) ++likes;
+        }
+
+        template <typename F>
+        void forEach(Direction d, u32 id, F &&fn) const {
+            if (id >= rows[d].size()) return;
+            const Row &  row   = rows[d][id];
+            u32          n     = row.count.load(std::memory_order_acquire);
+            const Block *block = row.head;
+            for (u32 i = 0; i < n; ++i) {
+                fn(block->likes[i % kBlockLikes]);
+                if (i % kBlockLikes == kBlockLikes - 1 && i + 1 < n) block = block->next;
+            }
+        }
+    };
+
+    struct Csr {
+        std::vector<u32>           offsets;  // row i is likes[offsets[i], offsets[i + 1])
+        std::vector<Account::Like> likes;    // a row is sorted by id
+
+        u32 rows() const { return static_cast<u32>(offsets.size() - 1); }
+
+        const Account::Like *begin(u32 id) const { return id < rows() ? likes.data() + offsets[id] : nullptr; }
+        const Account::Like *end(u32 id) const { return id < rows() ? likes.data() + offsets[id + 1] : nullptr; }
+    };
+
+    struct Generation {
+        std::shared_ptr<const Csr>     csr[2];
+        std::shared_ptr<const Buffers> frozen;  // being folded into new arrays, or null
+        std::shared_ptr<Buffers>       active;  // what the writer appends to
+    };
+
+    static bool byId(const Account::Like &a, const Account::Like &b) { return a.to_id < b.to_id; }
+
+    static std::shared_ptr<const Csr> fromEdges(const std::vector<LikeEdge> &edges, Direction d) {
+        std::shared_ptr<Csr> csr  = std::make_shared<Csr>();
+        u32                  rows = 0;
+        for (const LikeEdge &e : edges) rows = std::max(rows, (d == kForward ? e.liker : e.likee) + 1);
+
+        csr->offsets.assign(rows + 1, 0);
+        for (const LikeEdge &e : edges) ++csr->offsets[(d == kForward ? e.liker : e.likee) + 1];
+        for (u32 i = 1; i <= rows; ++i) csr->offsets[i] += csr->offsets[i - 1];
+
+        csr->likes.resize(edges.size());
+        std::vector<u32> fill(csr->offsets.begin(), csr->offsets.end() - 1);
+        for (const LikeEdge &e : edges) {
+            if (d == kForward) {
+                csr->likes[fill[e.liker]++] = Account::Like{e.likee, e.ts};
+            } else {
+                csr->likes[fill[e.likee]++] = Account::Like{e.liker, e.ts};
+            }
+        }
+        for (u32 i = 0; i < rows; ++i) std::stable_sort(csr->likes.begin() + csr->offsets[i], csr->likes.begin() + csr->offsets[i + 1], byId);
+        return csr;
+    }
+
+    // The rows of `base` with the frozen buffers merged in
+    static std::shared_ptr<const Csr> fold(const Csr &base, const Buffers &buffers, Direction d) {
+        std::shared_ptr<Csr> csr  = std::make_shared<Csr>();
+        u32                  rows = std::max(base.rows(), static_cast<u32>(buffers.rows[d].size()));
+        csr->offsets.resize(rows + 1);
+        csr->likes.reserve(base.likes.size() + buffers.likes);
+
+        std::vector<Account::Like> added;
+        for (u32 id = 0; id < rows; ++id) {
+            csr->offsets[id] = static_cast<u32>(csr->likes.size());
+            csr->likes.insert(csr->likes.end(), base.begin(id), base.end(id));
+
+            added.clear();
+            buffers.forEach(d, id, [&added](const Account::Like &like) { added.push_back(like); });
+            if (added.empty()) continue;
+            std::stable_sort(added.begin(), added.end(), byId);
+            size_t mid = csr->likes.size();
+            csr->likes.insert(csr->likes.end(), added.begin(), added.end());
+            std::inplace_merge(csr->likes.begin() + csr->offsets[id], csr->likes.begin() + mid, csr->likes.end(), byId);
+        }
+        csr->offsets[rows] = static_cast<u32>(csr->likes.size());
+        return csr;
+    }
+
+    void run() {
+        while (!stop_.load(std::memory_order_acquire)) {
+            std::unique_ptr<Generation> job(job_.exchange(nullptr, std::memory_order_acquire));
+            if (job == nullptr) {
+                std::this_thread::sleep_for(kPoll);
+                continue;
+            }
+            job->csr[kForward] = fold(*job->csr[kForward], *job->frozen, kForward);
+            job->csr[kReverse] = fold(*job->csr[kReverse], *job->frozen, kReverse);
+            job->frozen.reset();
+            done_.store(job.release(), std::memory_order_release);
+        }
+    }
+
+    Published<Generation>     generations_;
+    std::vector<LikeEdge>     loaded_;
+    bool                      compacting_ = false;  // writer
+    std::atomic<Generation *> job_{nullptr};        // writer -> compactor
+    std::atomic<Generation *> done_{nullptr};       // compactor -> writer
+    std::atomic<u64>          compactions_{0};
+    std::thread               thread_;
+    std::atomic<bool>         stop_{false};
+};
+
+// A reader's pinned generation, meant to live for one request. The compacted row of an account comes first, in
+// id order, then its buffered likes in the order they came
+class LikeStore::View {
+public:
+    explicit View(const LikeStore &likes) : gen_(likes.generations_) {}
+
+    // Calls fn(const Account::Like &) for every like of `id`: likee and ts going forward, liker and ts in reverse
+    template <typename F>
+    void forEach(Direction d, u32 id, F &&fn) const {
+        const Csr &csr = *gen_->csr[d];
+        for (const Account::Like *like = csr.begin(id); like != csr.end(id); ++like) fn(*like);
+        if (gen_->frozen != nullptr) gen_->frozen->forEach(d, id, fn);
+        gen_->active->forEach(d, id, fn);
+    }
+
+    size_t count(Direction d, u32 id) const {
+        size_t n = 0;
+        forEach(d, id, [&n](const Account::Like &) { ++n; });
+        return n;
+    }
+
+    // Whether `liker` liked `likee`, what likes_contains asks for every candidate
+    bool contains(u32 liker, u32 likee) const {
+        const Csr &csr = *gen_->csr[kForward];
+        if (std::binary_search(csr.begin(liker), csr.end(liker), Account::Like{likee, 0}, byId)) return true;
+
+        bool found = false;
+        auto check = [&found, likee](const Account::Like &like) { found |= like.to_id == likee; };
+        if (gen_->frozen != nullptr) gen_->frozen->forEach(kForward, liker, check);
+        gen_->active->forEach(kForward, liker, check);
+        return found;
+    }
+
+private:
+    Published<Generation>::Pin gen_;
+};
+
+}  // namespace hlcup
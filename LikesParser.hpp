@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstring>
+#include <vector>
+
+#include "Account.hpp"
+#include "ParseUtils.hpp"
+#include "common.hpp"
+
+namespace hlcup {
+
+// Body of POST /accounts/likes/: {"likes":[{"likee":3,"ts":1518000000,"liker":7},...]}. The keys of a like may
+// come in any order and all three are required; anything else in the body makes it invalid.
+struct LikesParser {
+    static bool parse(const char *p, const char *pe, std::vector<LikeEdge> &out) {
+        out.clear();
+        if (!expect(p, pe, '{') || !key(p, pe, "likes") || !expect(p, pe, '[')) return false;
+
+        skipWs(p, pe);
+        if (p < pe && *p == ']') {
+            ++p;
+        } else {
+            for (;;) {
+                if (!like(p, pe, out)) return false;
+                skipWs(p, pe);
+                if (p == pe) return false;
+                if (*p++ == ']') break;
+                if (p[-1] != ',') return false;
+            }
+        }
+
+        if (!expect(p, pe, '}')) return false;
+        skipWs(p, pe);
+        return p == pe;
+    }
+
+private:
+    static void skipWs(const char *&p, const char *pe) {
+        while (p < pe && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+    }
+
+    static bool expect(const char *&p, const char *pe, char ch) {
+        skipWs(p, pe);
+        if (p == pe || *p != ch) return false;
+        ++p;
+        return true;
+    }
+
+    // "name" followed by a colon
+    template <size_t N>
+    static bool key(const char *&p, const char *pe, const char (&name)[N]) {
+        if (!expect(p, pe, '"') || static_cast<size_t>(pe - p) < N || std::memcmp(p, name, N - 1) != 0 || p[N - 1] != '"') return false;
+        p += N;
+        return expect(p, pe, ':');
+    }
+
+    static bool like(const char *&p, const char *pe, std::vector<LikeEdge> &out) {
+        static const constexpr unsigned kLiker = 1, kLikee = 2, kTs = 4;
+
+        if (!expect(p, pe, '{')) return false;
+        LikeEdge edge;
+        unsigned seen = 0;
+        for (;;) {
+            u32 *    field;
+            unsigned bit;
+            skipWs(p, pe);
+            if (pe - p >= 8 && std::memcmp(p, "\"liker\"", 7) == 0) {
+                field = &edge.liker;
+                bit   = kLiker;
+                p += 7;
+            } else if (pe - p >= 8 && std::memcmp(p, "\"likee\"", 7) == 0) {
+                field = &edge.likee;
+                bit   = kLikee;
+                p += 7;
+            } else if (pe - p >= 5 && std::memcmp(p, "\"ts\"", 4) == 0) {
+                field = reinterpret_cast<u32 *>(&edge.ts);
+                bit   = kTs;
+                p += 4;
+            } else {
+                return false;
+            }
+            if (!expect(p, pe, ':')) return false;
+            skipWs(p, pe);
+            if (!ParseUtils::parseUint(p, pe, *field)) return false;
+            seen |= bit;
+
+            skipWs(p, pe);
+            if (p == pe) return false;
+            if (*p++ == '}') break;
+            if (p[-1] != ',') return false;
+        }
+        if (seen != (kLiker | kLikee | kTs)) return false;
+        out.push_back(edge);
+        return true;
+    }
+};
+
+}  // namespace hlcup
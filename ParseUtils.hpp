@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstring>
+
 #include "common.hpp"
 
 namespace hlcup {
@@ -34,6 +36,39 @@ struct ParseUtils {
         }
         return 1;
     }
+
+    // Parses up to 8 leading digits at once (SWAR), longer numbers are finished byte by byte.
+    static bool parseUint(const char *&p, const char *pe, u32 &val) {
+        u64 v = 0;
+
+        if (HLCUP_LIKELY(pe - p >= 8)) {
+            u64 word;
+            std::memcpy(&word, p, sizeof(word));
+
+            u64 digits   = word - 0x3030303030303030ULL;
+            u64 nondigit = ((digits + 0x7676767676767676ULL) | digits) & 0x8080808080808080ULL;
+            u32 len      = nondigit != 0 ? static_cast<u32>(__builtin_ctzll(nondigit)) >> 3 : 8;
+            if (len == 0) return false;
+
+            digits <<= 8 * (8 - len);
+            digits = ((digits & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+            digits = ((digits & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+            digits = ((digits & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+
+            v = digits;
+            p += len;
+            if (len < 8) {
+                val = static_cast<u32>(v);
+                return true;
+            }
+        } else if (p == pe || static_cast<u8>(*p - '0') >= 10) {
+            return false;
+        }
+
+        while (p < pe && static_cast<u8>(*p - '0') < 10) v = v * 10 + static_cast<u64>(*p++ - '0');
+        val = static_cast<u32>(v);
+        return true;
+    }
 };
 
 }  // namespace hlcup
@@ -19,6 +19,7 @@ struct Request {
         kAccountsNew,
         kAccountsUpdate,
         kAccountsLikes,
+        kNotFound,  // path or method we don't serve, kInvalid is left for malformed queries
     };
 
     enum Filter : u32 {
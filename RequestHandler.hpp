@@ -0,0 +1,40 @@
+#pragma once
+
+#include "Request.hpp"
+#include "Response.hpp"
+#include "StoreWriter.hpp"
+
+namespace hlcup {
+
+// Turns a parsed request into a response. There are no query engines yet, so every search comes back empty.
+// POSTs are validated here and applied by `writer`; without one they are answered as if they were valid.
+struct RequestHandler {
+    explicit RequestHandler(StoreWriter *writer = nullptr) : writer_(writer) {}
+
+    void handle(const Request &req, const char *body, u32 body_size, ResponseQueue &out) {
+        switch (req.type) {
+        case Request::kFilter:
+        case Request::kRecommend:
+        case Request::kSuggest: return addJson(out, "{\"accounts\":[]}");
+        case Request::kGroup: return addJson(out, "{\"groups\":[]}");
+        case Request::kAccountsNew: return out.add(writer_ != nullptr ? writer_->postNew(body, body_size) : ResponseQueue::k201);
+        case Request::kAccountsUpdate:
+            return out.add(writer_ != nullptr ? writer_->postUpdate(req.query.basic.entity_id, body, body_size) : ResponseQueue::k202);
+        case Request::kAccountsLikes: return out.add(writer_ != nullptr ? writer_->postLikes(body, body_size) : ResponseQueue::k202);
+        case Request::kNotFound: return out.add(ResponseQueue::k404);
+        default: return out.add(ResponseQueue::k400);
+        }
+    }
+
+private:
+    template <size_t N>
+    static void addJson(ResponseQueue &out, const char (&json)[N]) {
+        size_t start = out.bodyStart();
+        out.body().append(json, N - 1);
+        out.add200(start);
+    }
+
+    StoreWriter *writer_;
+};
+
+}  // namespace hlcup
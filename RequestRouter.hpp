@@ -0,0 +1,164 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <cstring>
+
+#include "Request.hpp"
+#include "common.hpp"
+
+namespace hlcup {
+
+namespace details {
+
+struct Token {
+    alignas(16) char bytes[16];
+    u32 mask;
+    u32 size;
+};
+
+template <size_t N>
+constexpr Token makeToken(const char (&str)[N]) {
+    static_assert(N - 1 <= 16, "Token doesn't fit into xmm register");
+    Token t{};
+    for (size_t i = 0; i < N - 1; ++i) t.bytes[i] = str[i];
+    t.mask = (1u << (N - 1)) - 1;
+    t.size = N - 1;
+    return t;
+}
+
+inline constexpr Token kGetPrefix  = makeToken("GET /accounts/");
+inline constexpr Token kPostPrefix = makeToken("POST /accounts/");
+inline constexpr Token kFilter     = makeToken("filter/?");
+inline constexpr Token kGroup      = makeToken("group/?");
+inline constexpr Token kNew        = makeToken("new/?");
+inline constexpr Token kLikes      = makeToken("likes/?");
+inline constexpr Token kRecommend  = makeToken("/recommend/?");
+inline constexpr Token kSuggest    = makeToken("/suggest/?");
+inline constexpr Token kUpdate     = makeToken("/?");
+
+struct Slot {
+    const Token * token;
+    Request::Type get_type;
+    Request::Type post_type;
+};
+
+// Perfect hash of the first route byte: low nibbles of 'f', 'g', 'l' and 'n' are distinct. Digits are checked
+// before the lookup, so they never reach this table.
+inline constexpr Slot kSlots[16] = {
+    {nullptr, Request::kInvalid, Request::kInvalid}, {nullptr, Request::kInvalid, Request::kInvalid},
+    {nullptr, Request::kInvalid, Request::kInvalid}, {nullptr, Request::kInvalid, Request::kInvalid},
+    {nullptr, Request::kInvalid, Request::kInvalid}, {nullptr, Request::kInvalid, Request::kInvalid},
+    {&kFilter, Request::kFilter, Request::kInvalid}, {&kGroup, Request::kGroup, Request::kInvalid},
+    {nullptr, Request::kInvalid, Request::kInvalid}, {nullptr, Request::kInvalid, Request::kInvalid},
+    {nullptr, Request::kInvalid, Request::kInvalid}, {nullptr, Request::kInvalid, Request::kInvalid},
+    {&kLikes, Request::kInvalid, Request::kAccountsLikes}, {nullptr, Request::kInvalid, Request::kInvalid},
+    {&kNew, Request::kInvalid, Request::kAccountsNew}, {nullptr, Request::kInvalid, Request::kInvalid},
+};
+
+}  // namespace details
+
+// Classifies the request line before the ragel machine sees it. Method and route tokens are matched with masked
+// 16-byte compares, so the parser can be entered right at the query string of the route.
+struct RequestRouter {
+    enum Status : u8 {
+        kMatched = 0,
+        kUnknown,  // method or path is not served by us, answer 404
+        kShort,    // the request line isn't buffered yet, route again once more of it arrives
+    };
+
+    struct Route {
+        Status        status;
+        Request::Type type;
+        u32           entity_id;
+        const char *  params;
+    };
+
+    HLCUP_ALWAYS_INLINE static inline bool match(const char *p, const details::Token &t) {
+        __m128i v  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i e  = _mm_load_si128(reinterpret_cast<const __m128i *>(t.bytes));
+        u32     eq = static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, e)));
+        return (eq & t.mask) == t.mask;
+    }
+
+    static inline Route route(const char *p, const char *pe) {
+        Route r{kShort, Request::kInvalid, 0, p};
+
+        while (p < pe && (*p == '\r' || *p == '\n' || *p == ' ')) ++p;
+        if (HLCUP_UNLIKELY(pe - p < kMinBuffered)) return routeShort(p, pe);
+
+        bool post;
+        if (*p == 'G' && match(p, details::kGetPrefix)) {
+            post = false;
+            p += details::kGetPrefix.size;
+        } else if (*p == 'P' && match(p, details::kPostPrefix)) {
+            post = true;
+            p += details::kPostPrefix.size;
+        } else {
+            r.status = kUnknown;
+            return r;
+        }
+
+        const details::Token *token;
+        Request::Type         type;
+
+        if (static_cast<u8>(*p - '0') < 10) {
+            u32 id = 0;
+            while (p < pe && static_cast<u8>(*p - '0') < 10) id = id * 10 + static_cast<u32>(*p++ - '0');
+            if (HLCUP_UNLIKELY(pe - p < 16)) {
+                // an id this long is no account of ours once the line is complete
+                if (::memchr(p, '\n', static_cast<size_t>(pe - p)) != nullptr) r.status = kUnknown;
+                return r;
+            }
+
+            r.entity_id = id;
+            if (post) {
+                token = &details::kUpdate;
+                type  = Request::kAccountsUpdate;
+            } else if (p[1] == 'r') {
+                token = &details::kRecommend;
+                type  = Request::kRecommend;
+            } else {
+                token = &details::kSuggest;
+                type  = Request::kSuggest;
+            }
+        } else {
+            const details::Slot &slot = details::kSlots[static_cast<u8>(*p) & 0x0f];
+            token                     = slot.token;
+            type                      = post ? slot.post_type : slot.get_type;
+            if (token == nullptr || type == Request::kInvalid) {
+                r.status = kUnknown;
+                return r;
+            }
+        }
+
+        if (!match(p, *token)) {
+            r.status = kUnknown;
+            return r;
+        }
+
+        r.status = kMatched;
+        r.type   = type;
+        r.params = p + token->size;
+        return r;
+    }
+
+private:
+    // The compares load 16 bytes past the method and the route token
+    static const constexpr ssize_t kMinBuffered = 32;
+
+    // Fewer than kMinBuffered bytes: wait for the rest of the line, or route a zero-padded copy of it when it is
+    // complete and just short
+    static Route routeShort(const char *p, const char *pe) {
+        Route r{kShort, Request::kInvalid, 0, p};
+        if (::memchr(p, '\n', static_cast<size_t>(pe - p)) == nullptr) return r;
+
+        char padded[2 * kMinBuffered] = {};
+        ::memcpy(padded, p, static_cast<size_t>(pe - p));
+        r        = route(padded, padded + sizeof(padded));
+        r.params = p + (r.params - padded);
+        return r;
+    }
+};
+
+}  // namespace hlcup
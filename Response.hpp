@@ -0,0 +1,177 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "common.hpp"
+#include "core/Buffer.hpp"
+#include "core/IntFormat.hpp"
+
+namespace hlcup {
+
+namespace details {
+
+struct alignas(64) Rendered {
+    char data[112];
+    u32  size;
+};
+
+template <size_t N>
+constexpr Rendered render(const char (&str)[N]) {
+    static_assert(N - 1 <= sizeof(Rendered::data), "Rendered response is too long");
+    Rendered r{};
+    for (size_t i = 0; i < N - 1; ++i) r.data[i] = str[i];
+    r.size = N - 1;
+    return r;
+}
+
+#define HLCUP_STATIC_HEADERS "Connection: keep-alive\r\nContent-Type: application/json\r\n"
+
+inline constexpr Rendered kHeader200 = render("HTTP/1.1 200 OK\r\n" HLCUP_STATIC_HEADERS "Content-Length: ");
+inline constexpr Rendered kHeaderEnd = render("\r\n\r\n");
+inline constexpr Rendered kAnswer201 = render("HTTP/1.1 201 Created\r\n" HLCUP_STATIC_HEADERS "Content-Length: 2\r\n\r\n{}");
+inline constexpr Rendered kAnswer202 = render("HTTP/1.1 202 Accepted\r\n" HLCUP_STATIC_HEADERS "Content-Length: 2\r\n\r\n{}");
+inline constexpr Rendered kAnswer400 = render("HTTP/1.1 400 Bad Request\r\n" HLCUP_STATIC_HEADERS "Content-Length: 0\r\n\r\n");
+inline constexpr Rendered kAnswer404 = render("HTTP/1.1 404 Not Found\r\n" HLCUP_STATIC_HEADERS "Content-Length: 0\r\n\r\n");
+
+#undef HLCUP_STATIC_HEADERS
+
+}  // namespace details
+
+// Outgoing responses of a connection as a list of iovec parts. Answers without a computed body point straight
+// at the pre-rendered text; a 200 is the rendered header, the Content-Length digits written after its body
+// was serialized, the header terminator and the body itself. Serialized bytes live in one buffer and are
+// referenced by offset, so the buffer may grow while responses are queued.
+struct ResponseQueue {
+    enum Status : u8 {
+        k201 = 0,
+        k202,
+        k400,
+        k404,
+    };
+
+    ResponseQueue() { parts_.reserve(64); }
+
+    bool empty() const { return head_ == parts_.size(); }
+
+    // Bytes queued and not consumed yet
+    size_t size() const { return size_; }
+
+    void add(Status status) {
+        static const details::Rendered *const kAnswers[] = {&details::kAnswer201, &details::kAnswer202, &details::kAnswer400, &details::kAnswer404};
+        addStatic(*kAnswers[status]);
+    }
+
+    // Serialize the body into body() after calling bodyStart(), then finish it with add200()
+    Buffer &body() { return data_; }
+    size_t  bodyStart() const { return data_.size(); }
+
+    void add200(size_t body_start) {
+        u32 body_size = static_cast<u32>(data_.size() - body_start);
+        u32 len       = IntFormat::digits(body_size);
+
+        size_t digits_start = data_.size();
+        data_.reserve(len);
+        IntFormat::write(data_.tail(), body_size, len);
+        data_.commit(len);
+
+        addStatic(details::kHeader200);
+        addOwned(digits_start, data_.size() - digits_start);
+        addStatic(details::kHeaderEnd);
+        addOwned(body_start, digits_start - body_start);
+    }
+
+    // Fills up to max_iov entries starting at the first unsent byte, returns how many were used
+    unsigned fill(iovec *iov, unsigned max_iov) const {
+        unsigned n = 0;
+        for (size_t i = head_; i < parts_.size() && n < max_iov; ++i, ++n) {
+            const Part &part = parts_[i];
+            const char *ptr  = part.ptr != nullptr ? part.ptr : data_.data() + part.offset;
+            size_t      skip = i == head_ ? head_offset_ : 0;
+            iov[n].iov_base  = const_cast<char *>(ptr + skip);
+            iov[n].iov_len   = part.size - skip;
+        }
+        return n;
+    }
+
+    // Copies n bytes starting `offset` bytes past the first unsent one, for callers that cut the stream into
+    // packets themselves. The range must be queued
+    void copy(size_t offset, char *dst, size_t n) const {
+        offset += head_offset_;
+        for (size_t i = head_; n > 0 && i < parts_.size(); ++i) {
+            const Part &part = parts_[i];
+            if (offset >= part.size) {
+                offset -= part.size;
+                continue;
+            }
+
+            const char *ptr   = part.ptr != nullptr ? part.ptr : data_.data() + part.offset;
+            size_t      chunk = std::min(n, part.size - offset);
+            ::memcpy(dst, ptr + offset, chunk);
+            dst += chunk;
+            n -= chunk;
+            offset = 0;
+        }
+    }
+
+    // Drops n sent bytes, everything is released once the last part is gone
+    void consume(size_t n) {
+        size_ -= std::min(n, size_);
+        while (n > 0 && head_ < parts_.size()) {
+            size_t left = parts_[head_].size - head_offset_;
+            if (n < left) {
+                head_offset_ += n;
+                return;
+            }
+            n -= left;
+            ++head_;
+            head_offset_ = 0;
+        }
+        if (head_ == parts_.size()) clear();
+    }
+
+    void clear() {
+        parts_.clear();
+        data_.clear();
+        head_        = 0;
+        head_offset_ = 0;
+        size_        = 0;
+    }
+
+    void swap(ResponseQueue &other) {
+        parts_.swap(other.parts_);
+        data_.swap(other.data_);
+        std::swap(head_, other.head_);
+        std::swap(head_offset_, other.head_offset_);
+        std::swap(size_, other.size_);
+    }
+
+private:
+    struct Part {
+        const char *ptr;  // pre-rendered text, nullptr if the bytes are in data_
+        size_t      offset;
+        size_t      size;
+    };
+
+    void addStatic(const details::Rendered &r) {
+        parts_.push_back({r.data, 0, r.size});
+        size_ += r.size;
+    }
+
+    void addOwned(size_t offset, size_t size) {
+        parts_.push_back({nullptr, offset, size});
+        size_ += size;
+    }
+
+    std::vector<Part> parts_;
+    Buffer            data_;
+    size_t            head_        = 0;
+    size_t            head_offset_ = 0;
+    size_t            size_        = 0;
+};
+
+}  // namespace hlcup
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "common.hpp"
+
+#include "fmt/format.hpp"
+
+namespace hlcup {
+
+class StoreWriter;
+
+struct ServerConfig {
+    enum Backend : u8 {
+        kEpoll = 0,
+        kUring,
+    };
+
+    u16      port           = 80;
+    unsigned threads        = 0;  // 0 means one per online cpu
+    int      backlog        = 4096;
+    Backend  backend        = kEpoll;
+    unsigned stats_interval = 0;    // seconds between syscall/request reports, 0 disables them
+    unsigned busy_poll_us   = 0;    // SO_BUSY_POLL budget, non-zero also makes the epoll loop spin
+    unsigned idle_ms        = 200;  // spinning stops after this long without events
+
+    const char * journal = nullptr;  // write-ahead log of POSTs, replayed at startup; none if not given
+    StoreWriter *writer  = nullptr;  // applies POSTs, set by main() rather than from the command line
+
+    // --backend=epoll|uring --port=N --threads=N --stats=SECONDS --busy-poll=USEC --idle=MSEC --journal=PATH
+    static ServerConfig fromArgs(int argc, char **argv) {
+        ServerConfig config;
+        for (int i = 1; i < argc; ++i) {
+            const char *arg = argv[i];
+            if (std::strcmp(arg, "--backend=uring") == 0) {
+                config.backend = kUring;
+            } else if (std::strcmp(arg, "--backend=epoll") == 0) {
+                config.backend = kEpoll;
+            } else if (std::strncmp(arg, "--port=", 7) == 0) {
+                config.port = static_cast<u16>(std::atoi(arg + 7));
+            } else if (std::strncmp(arg, "--threads=", 10) == 0) {
+                config.threads = static_cast<unsigned>(std::atoi(arg + 10));
+            } else if (std::strncmp(arg, "--stats=", 8) == 0) {
+                config.stats_interval = static_cast<unsigned>(std::atoi(arg + 8));
+            } else if (std::strncmp(arg, "--busy-poll=", 12) == 0) {
+                config.busy_poll_us = static_cast<unsigned>(std::atoi(arg + 12));
+            } else if (std::strncmp(arg, "--idle=", 7) == 0) {
+                config.idle_ms = static_cast<unsigned>(std::atoi(arg + 7));
+            } else if (std::strncmp(arg, "--journal=", 10) == 0) {
+                config.journal = arg + 10;
+            } else {
+                fmt::print(stderr, "unknown option: {}\n", arg);
+            }
+        }
+        return config;
+    }
+};
+
+// Written by the owning worker only, read by the stats reporter
+struct alignas(64) WorkerStats {
+    std::atomic<u64> requests{0};
+    std::atomic<u64> syscalls{0};
+
+    void addRequests(u64 n) { requests.store(requests.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    void addSyscalls(u64 n) { syscalls.store(syscalls.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+};
+
+// Creates a worker per thread, binds all of them before starting any, then runs them on their own threads.
+template <typename Worker>
+int run_workers(ServerConfig config, const char *name) {
+    if (config.threads == 0) config.threads = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned i = 0; i < config.threads; ++i) {
+        workers.emplace_back(std::make_unique<Worker>(config, i));
+        if (!workers.back()->init()) return 1;
+    }
+
+    fmt::print(stderr, "listening on port {} with {} {} workers\n", config.port, config.threads, name);
+
+    std::vector<std::thread> threads;
+    for (auto &worker : workers) threads.emplace_back(&Worker::run, worker.get());
+
+    if (config.stats_interval > 0) {
+        u64 last_requests = 0, last_syscalls = 0;
+        while (true) {
+            ::sleep(config.stats_interval);
+
+            u64 requests = 0, syscalls = 0;
+            for (auto &worker : workers) {
+                requests += worker->stats().requests.load(std::memory_order_relaxed);
+                syscalls += worker->stats().syscalls.load(std::memory_order_relaxed);
+            }
+
+            u64 dr = requests - last_requests, ds = syscalls - last_syscalls;
+            fmt::print(stderr, "{}: {} requests, {} syscalls, {:.2f} syscalls per request\n", name, dr, ds, dr > 0 ? double(ds) / double(dr) : 0.0);
+            last_requests = requests;
+            last_syscalls = syscalls;
+        }
+    }
+
+    for (auto &th : threads) th.join();
+    return 0;
+}
+
+}  // namespace hlcup
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string_view>
+#include <thread>
+
+#include "Account.hpp"
+#include "AccountIndex.hpp"
+#include "AccountParser.hpp"
+#include "AccountStore.hpp"
+#include "Journal.hpp"
+#include "Likes.hpp"
+#include "LikesParser.hpp"
+#include "Response.hpp"
+#include "common.hpp"
+#include "core/MpscQueue.hpp"
+#include "fmt/format.hpp"
+
+namespace hlcup {
+
+// Applies POSTed changes on one dedicated thread, so the store has a single writer and its readers take no
+// locks. Request threads parse and validate a body against the store as it is, queue the update and answer at
+// once; the answer does not wait for the change to be applied.
+class StoreWriter {
+public:
+    static const constexpr size_t   kQueueSize = 1 << 14;
+    static const constexpr unsigned kSpins     = 1 << 12;  // empty polls before the thread starts napping
+    static const constexpr auto     kNap       = std::chrono::microseconds(50);
+    static const constexpr unsigned kGroupSize = 256;  // journal records committed together at most
+
+    // `index`, if any, is told about every row that changes. `journal`, if any, gets every update before it is
+    // applied, committed a group at a time: whatever the queue held when it ran empty, kGroupSize at most.
+    // `likes`, if any, gets the likes of new accounts and like batches, which are dropped without it
+    explicit StoreWriter(AccountStore &store, AccountIndex *index = nullptr, Journal *journal = nullptr, LikeStore *likes = nullptr)
+        : store_(store), index_(index), journal_(journal), likes_(likes), queue_(kQueueSize) {}
+
+    StoreWriter(const StoreWriter &) = delete;
+    StoreWriter &operator=(const StoreWriter &) = delete;
+
+    ~StoreWriter() { stop(); }
+
+    void start() { thread_ = std::thread(&StoreWriter::run, this); }
+
+    // Applies what the journal holds, before start(). Returns the number of updates
+    u64 replay(const Journal &journal) {
+        return journal.replay([this](const AccountUpdate &u) { apply(u); });
+    }
+
+    // Applies what is queued and joins the thread, nothing may be submitted after this
+    void stop() {
+        if (!thread_.joinable()) return;
+        stop_.store(true, std::memory_order_release);
+        thread_.join();
+    }
+
+    // Request threads: POST /accounts/new/
+    ResponseQueue::Status postNew(const char *body, u32 size) {
+        std::unique_ptr<AccountUpdate> u(new AccountUpdate);
+        if (!parse(body, size, u->acc)) return ResponseQueue::k400;
+
+        const Account &acc = u->acc;
+        if (acc.id == Account::kInvalidId || acc.email.offset == Account::kInvalidOffset || acc.sex == Account::kInvalidSex
+            || acc.status == Account::kInvalidStatus) {
+            return ResponseQueue::k400;
+        }
+        if (!store_.acceptsNewId(acc.id) || store_.exists(acc.id) || taken(acc)) return ResponseQueue::k400;
+
+        u->kind = AccountUpdate::kNew;
+        submit(std::move(u));
+        return ResponseQueue::k201;
+    }
+
+    // Request threads: POST /accounts/<id>/
+    ResponseQueue::Status postUpdate(u32 id, const char *body, u32 size) {
+        if (!store_.exists(id)) return ResponseQueue::k404;
+
+        std::unique_ptr<AccountUpdate> u(new AccountUpdate);
+        if (!parse(body, size, u->acc)) return ResponseQueue::k400;
+
+        u->kind   = AccountUpdate::kUpdate;
+        u->acc.id = id;
+        if (taken(u->acc)) return ResponseQueue::k400;
+        submit(std::move(u));
+        return ResponseQueue::k202;
+    }
+
+    // Request threads: POST /accounts/likes/
+    ResponseQueue::Status postLikes(const char *body, u32 size) {
+        std::unique_ptr<AccountUpdate> u(new AccountUpdate);
+        if (!LikesParser::parse(body, body + size, u->likes)) return ResponseQueue::k400;
+        for (const LikeEdge &like : u->likes) {
+            if (!store_.exists(like.liker) || !store_.exists(like.likee)) return ResponseQueue::k400;
+        }
+
+        u->kind = AccountUpdate::kLikes;
+        submit(std::move(u));
+        return ResponseQueue::k202;
+    }
+
+    // Any thread. Spins while the queue is full, the writer empties it far faster than requests fill it
+    void submit(std::unique_ptr<AccountUpdate> u) {
+        AccountUpdate *raw = u.release();
+        while (!queue_.push(std::move(raw))) std::this_thread::yield();
+        submitted_.fetch_add(1, std::memory_order_release);
+    }
+
+    // Waits until everything submitted before the call is applied
+    void sync() const {
+        u64 target = submitted_.load(std::memory_order_acquire);
+        while (applied_.load(std::memory_order_acquire) < target) std::this_thread::yield();
+    }
+
+    u64 applied() const { return applied_.load(std::memory_order_acquire); }
+
+private:
+    // Bodies are decoded into Account::string_data, which the decoded strings of a body this size always fit
+    static bool parse(const char *body, u32 size, Account &acc) {
+        if (size == 0 || size > Account::kStringCapacity) return false;
+
+        AccountParser parser;
+        const char *  p = body;
+        if (!parser.parse(p, body + size, acc)) return false;
+
+        if (acc.email.offset != Account::kInvalidOffset && !validEmail(acc.getView(acc.email))) return false;
+        return true;
+    }
+
+    // Whether the email or phone of `acc` belongs to another account
+    bool taken(const Account &acc) const {
+        auto other = [&acc](u32 owner) { return owner != Account::kInvalidId && owner != acc.id; };
+        return (acc.email.offset != Account::kInvalidOffset && other(store_.findEmail(acc.getView(acc.email))))
+            || (acc.phone.offset != Account::kInvalidOffset && other(store_.findPhone(acc.getView(acc.phone))));
+    }
+
+    static bool validEmail(std::string_view email) {
+        size_t at = email.find('@');
+        return at != std::string_view::npos && at > 0 && at + 1 < email.size() && email.find('@', at + 1) == std::string_view::npos;
+    }
+
+    void run() {
+        AccountUpdate *u;
+        unsigned       idle = 0, uncommitted = 0;
+        for (;;) {
+            if (queue_.pop(u)) {
+                if (journal_ != nullptr) journal(*u, uncommitted);
+                apply(*u);
+                delete u;
+                applied_.fetch_add(1, std::memory_order_release);
+                idle = 0;
+                continue;
+            }
+            if (uncommitted != 0) {
+                journal_->commit();
+                uncommitted = 0;
+            }
+            if (likes_ != nullptr) likes_->maintain();
+            if (stop_.load(std::memory_order_acquire)) {
+                if (journal_ != nullptr) journal_->flush();
+                return;
+            } else if (++idle < kSpins) {
+                _mm_pause();
+            } else {
+                std::this_thread::sleep_for(kNap);
+            }
+        }
+    }
+
+    void journal(const AccountUpdate &u, unsigned &uncommitted) {
+        if (HLCUP_UNLIKELY(!journal_->append(u))) {
+            if (!journal_full_) fmt::print(stderr, "journal is full, updates from here on are not logged\n");
+            journal_full_ = true;
+            return;
+        }
+        if (++uncommitted == kGroupSize) {
+            journal_->commit();
+            uncommitted = 0;
+        }
+    }
+
+    void apply(const AccountUpdate &u) {
+        switch (u.kind) {
+        case AccountUpdate::kNew:
+            // Two POSTs with the same id, email or phone can both pass validation, the first one queued wins
+            if (store_.exists(u.acc.id) || taken(u.acc)) return;
+            store_.add(u.acc);
+            if (likes_ != nullptr) {
+                for (const Account::Like &like : u.acc.likes) likes_->add(u.acc.id, like.to_id, like.ts);
+            }
+            break;
+        case AccountUpdate::kUpdate:
+            if (taken(u.acc)) return;
+            store_.update(u.acc);
+            break;
+        case AccountUpdate::kLikes:
+            if (likes_ == nullptr) return;
+            for (const LikeEdge &like : u.likes) likes_->add(like.liker, like.likee, like.ts);
+            likes_->maintain();
+            return;
+        }
+        if (index_ != nullptr) index_->touch(u.acc.id);
+    }
+
+    AccountStore &              store_;
+    AccountIndex *              index_;
+    Journal *                   journal_;
+    LikeStore *                 likes_;
+    bool                        journal_full_ = false;
+    MpscQueue<AccountUpdate *>  queue_;
+    std::thread                 thread_;
+    std::atomic<bool>           stop_{false};
+    alignas(64) std::atomic<u64> submitted_{0};
+    alignas(64) std::atomic<u64> applied_{0};
+};
+
+}  // namespace hlcup
@@ -4,13 +4,29 @@
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <syscall.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <cstring>
+#include <vector>
+
+#include "common.hpp"
+
+// Failed calls return -1 and keep errno in lastError()
+#define HLCUP_HANDLE_ERR(x)                \
+    {                                      \
+        long rc = (x);                     \
+        if (rc < 0) { err_code_ = errno; } \
+        return rc;                         \
+    }
 
 namespace hlcup {
 
+using MsgHdr = msghdr;
+using IoVec  = iovec;
+
 struct TcpSocket {
     TcpSocket(int fd) : fd_(fd) {}
     TcpSocket() { fd_ = ::socket(PF_INET, SOCK_CLOEXEC | SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP); }
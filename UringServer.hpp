@@ -0,0 +1,377 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <memory>
+#include <vector>
+
+#include "io.hpp"
+#include "io_uring.hpp"
+#include "sched.hpp"
+
+#include "Connection.hpp"
+#include "RequestHandler.hpp"
+#include "Server.hpp"
+#include "TcpSocket.hpp"
+#include "common.hpp"
+#include "core/IoUring.hpp"
+
+#include "fmt/format.hpp"
+
+namespace hlcup {
+
+// io_uring flavour of the per-core loop. Accept and recv are multishot, so after the first submission they keep
+// producing completions without new SQEs; accepted sockets go straight into the registered file table and data
+// lands in a registered buffer ring. Sends collected while draining completions are submitted with the next wait
+// and returned buffers are published to the ring right before it, so a loop iteration costs exactly one
+// io_uring_enter(). Kernels without buffer rings get the buffers through PROVIDE_BUFFERS SQEs in the same enter(),
+// kernels without multishot recv a plain recv into the connection buffer.
+struct UringWorker {
+    static const constexpr unsigned kRingEntries    = 4096;
+    static const constexpr unsigned kMaxConnections = 16384;  // registered file slots
+    static const constexpr unsigned kBufEntries     = 4096;
+    static const constexpr u32      kBufSize        = 4096;
+    static const constexpr u16      kBufGroup       = 0;
+    static const constexpr unsigned kMaxIov         = 64;
+
+    enum Op : u32 {
+        kAccept = 0,
+        kRecv,
+        kSend,
+        kShutdown,
+        kClose,
+        kProvide,
+    };
+
+    // sock holds the registered file slot instead of a descriptor, it is never used for plain syscalls
+    struct UringConnection : Connection {
+        ResponseQueue inflight;  // responses handed to the kernel by the current send, `out` keeps collecting meanwhile
+        MsgHdr        msg{};
+        IoVec         iov[kMaxIov];
+        bool          open       = false;
+        bool          recv_armed = false;
+        bool          plain_recv = false;  // the armed recv reads into `in` rather than a provided buffer
+        bool          sending    = false;
+        bool          closing    = false;
+        bool          dirty      = false;
+
+        explicit UringConnection(int slot) : Connection(slot) {}
+    };
+
+    UringWorker(const ServerConfig &config, unsigned cpu) : config_(config), cpu_(cpu), handler_(config.writer) {}
+
+    ~UringWorker() {
+        if (listener_.fd() >= 0) listener_.close();
+    }
+
+    // Only the listener is created here, the ring belongs to the worker thread (SINGLE_ISSUER)
+    bool init() {
+        listener_ = TcpSocket();
+        if (listener_.fd() < 0) {
+            fmt::print(stderr, "worker {}: socket() failed: {}\n", cpu_, errno);
+            return false;
+        }
+
+        listener_.setoption(SOL_SOCKET, SO_REUSEADDR, 1);
+        listener_.setoption(SOL_SOCKET, SO_REUSEPORT, 1);
+        listener_.setoption(IPPROTO_TCP, TCP_NODELAY, 1);
+
+        if (listener_.bind(config_.port) < 0 || listener_.listen(config_.backlog) < 0) {
+            fmt::print(stderr, "worker {}: bind/listen on port {} failed: {}\n", cpu_, config_.port, strerror(listener_.lastError()));
+            return false;
+        }
+
+        return true;
+    }
+
+    const WorkerStats &stats() const { return stats_; }
+
+    void run() {
+        int err = ef::platform::set_affinity(static_cast<int>(cpu_));
+        if (err < 0) { fmt::print(stderr, "worker {}: sched_setaffinity() failed: {}\n", cpu_, err); }
+
+        if (!setupRing()) return;
+
+        conns_.resize(kMaxConnections);
+        armAccept();
+
+        while (true) {
+            bufs_.flush([this] {
+                io_uring_sqe *s = sqe();
+                s->user_data    = userData(kProvide, 0);
+                return s;
+            });
+
+            int n = uring_.enter(1);
+            stats_.addSyscalls(1);
+            if (HLCUP_UNLIKELY(n < 0 && n != -EINTR && n != -EBUSY && n != -EAGAIN)) {
+                fmt::print(stderr, "worker {}: io_uring_enter() failed: {}\n", cpu_, n);
+                break;
+            }
+
+            uring_.forEachCqe([this](const io_uring_cqe &cqe) { onCompletion(cqe); });
+
+            for (UringConnection *conn : dirty_) {
+                conn->dirty = false;
+                if (!conn->sending) startSend(conn);
+            }
+            dirty_.clear();
+        }
+    }
+
+private:
+    bool setupRing() {
+        // Newer kernels run completion work on our own enter() with these flags, older ones take the fallbacks
+        static const constexpr unsigned kFlags[] = {IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN, IORING_SETUP_COOP_TASKRUN, 0};
+
+        int err = -EINVAL;
+        for (unsigned flags : kFlags) {
+            err = uring_.init(kRingEntries, flags);
+            if (err != -EINVAL) break;
+        }
+        if (err < 0) {
+            fmt::print(stderr, "worker {}: io_uring_setup() failed: {}\n", cpu_, err);
+            return false;
+        }
+
+        if ((err = uring_.registerSparseFiles(kMaxConnections)) < 0) {
+            fmt::print(stderr, "worker {}: registering files failed: {}\n", cpu_, err);
+            return false;
+        }
+
+        if ((err = bufs_.init(uring_, kBufEntries, kBufSize, kBufGroup)) < 0) {
+            fmt::print(stderr, "worker {}: allocating recv buffers failed: {}\n", cpu_, err);
+            return false;
+        }
+        if (!bufs_.ring()) fmt::print(stderr, "worker {}: buffer ring unavailable, providing recv buffers per batch\n", cpu_);
+
+        return true;
+    }
+
+    static u64 userData(Op op, u32 slot) { return (static_cast<u64>(op) << 32) | slot; }
+
+    io_uring_sqe *sqe() {
+        io_uring_sqe *sqe;
+        while ((sqe = uring_.getSqe()) == nullptr) {
+            // submission queue overflow: push what we have without waiting
+            uring_.enter(0);
+            stats_.addSyscalls(1);
+        }
+        return sqe;
+    }
+
+    void armAccept() {
+        io_uring_sqe *s = sqe();
+        s->opcode       = IORING_OP_ACCEPT;
+        s->fd           = listener_.fd();
+        s->ioprio       = IORING_ACCEPT_MULTISHOT;
+        s->file_index   = IORING_FILE_INDEX_ALLOC;
+        s->user_data    = userData(kAccept, 0);
+    }
+
+    void armRecv(UringConnection *conn) {
+        if (!multishot_recv_) return armPlainRecv(conn);
+
+        io_uring_sqe *s = sqe();
+        s->opcode       = IORING_OP_RECV;
+        s->fd           = conn->sock.fd();
+        s->flags        = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+        s->ioprio       = IORING_RECV_MULTISHOT;
+        s->buf_group    = kBufGroup;
+        s->user_data    = userData(kRecv, static_cast<u32>(conn->sock.fd()));
+        conn->recv_armed = true;
+        conn->plain_recv = false;
+    }
+
+    // One recv straight into the connection buffer, nothing else touches `in` until it completes
+    void armPlainRecv(UringConnection *conn) {
+        conn->in.reserve(kBufSize);
+
+        io_uring_sqe *s = sqe();
+        s->opcode       = IORING_OP_RECV;
+        s->fd           = conn->sock.fd();
+        s->flags        = IOSQE_FIXED_FILE;
+        s->addr         = reinterpret_cast<u64>(conn->in.tail());
+        s->len          = static_cast<u32>(conn->in.space());
+        s->user_data    = userData(kRecv, static_cast<u32>(conn->sock.fd()));
+        conn->recv_armed = true;
+        conn->plain_recv = true;
+    }
+
+    void disableMultishotRecv(int err) {
+        if (!multishot_recv_) return;
+        fmt::print(stderr, "worker {}: multishot recv unavailable ({}), falling back to plain recv\n", cpu_, err);
+        multishot_recv_ = false;
+    }
+
+    void startSend(UringConnection *conn) {
+        if (conn->out.empty() || conn->closing) return;
+
+        conn->inflight.swap(conn->out);
+        conn->out.clear();
+        queueSend(conn);
+    }
+
+    void queueSend(UringConnection *conn) {
+        conn->msg.msg_iov    = conn->iov;
+        conn->msg.msg_iovlen = conn->inflight.fill(conn->iov, kMaxIov);
+
+        io_uring_sqe *s = sqe();
+        s->opcode       = IORING_OP_SENDMSG;
+        s->fd           = conn->sock.fd();
+        s->flags        = IOSQE_FIXED_FILE;
+        s->addr         = reinterpret_cast<u64>(&conn->msg);
+        s->len          = 1;
+        s->msg_flags    = MSG_NOSIGNAL;
+        s->user_data    = userData(kSend, static_cast<u32>(conn->sock.fd()));
+        conn->sending   = true;
+    }
+
+    void markDirty(UringConnection *conn) {
+        if (conn->dirty || conn->out.empty()) return;
+        conn->dirty = true;
+        dirty_.push_back(conn);
+    }
+
+    // The slot is released only after the multishot recv and the send have both completed, otherwise a late
+    // completion could hit a connection that reuses it.
+    void close(UringConnection *conn) {
+        if (!conn->closing) {
+            conn->closing = true;
+            if (conn->recv_armed) {
+                io_uring_sqe *s = sqe();
+                s->opcode       = IORING_OP_SHUTDOWN;
+                s->fd           = conn->sock.fd();
+                s->flags        = IOSQE_FIXED_FILE;
+                s->len          = SHUT_RDWR;
+                s->user_data    = userData(kShutdown, static_cast<u32>(conn->sock.fd()));
+            }
+        }
+        if (conn->recv_armed || conn->sending || !conn->open) return;
+
+        io_uring_sqe *s = sqe();
+        s->opcode       = IORING_OP_CLOSE;
+        s->file_index   = static_cast<u32>(conn->sock.fd()) + 1;
+        s->user_data    = userData(kClose, static_cast<u32>(conn->sock.fd()));
+        conn->open      = false;
+    }
+
+    void onCompletion(const io_uring_cqe &cqe) {
+        Op  op   = static_cast<Op>(cqe.user_data >> 32);
+        u32 slot = static_cast<u32>(cqe.user_data);
+
+        switch (op) {
+            case kAccept: onAccept(cqe); break;
+            case kRecv: onRecv(conns_[slot].get(), cqe); break;
+            case kSend: onSend(conns_[slot].get(), cqe); break;
+            case kProvide:
+                if (cqe.res < 0) disableMultishotRecv(cqe.res);
+                break;
+            case kShutdown:
+            case kClose: break;
+        }
+    }
+
+    void onAccept(const io_uring_cqe &cqe) {
+        if (!(cqe.flags & IORING_CQE_F_MORE)) armAccept();
+
+        if (cqe.res < 0) {
+            if (cqe.res != -ECONNABORTED) { fmt::print(stderr, "worker {}: accept failed: {}\n", cpu_, cqe.res); }
+            return;
+        }
+
+        u32   slot = static_cast<u32>(cqe.res);
+        auto &conn = conns_[slot];
+        if (!conn) {
+            conn = std::make_unique<UringConnection>(cqe.res);
+        } else {
+            conn->reset(cqe.res);
+            conn->inflight.clear();
+            conn->closing = conn->sending = conn->dirty = false;
+        }
+        conn->open = true;
+        armRecv(conn.get());
+    }
+
+    void onRecv(UringConnection *conn, const io_uring_cqe &cqe) {
+        if (cqe.flags & IORING_CQE_F_BUFFER) {
+            u16 bid = static_cast<u16>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            if (cqe.res > 0) conn->in.append(bufs_.get(bid), static_cast<size_t>(cqe.res));
+            bufs_.recycle(bid);
+        } else if (conn->plain_recv && cqe.res > 0) {
+            conn->in.commit(static_cast<size_t>(cqe.res));
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE)) conn->recv_armed = false;
+
+        if (cqe.res > 0) {
+            if (conn->closing) return close(conn);
+
+            stats_.addRequests(conn->process(handler_));
+            markDirty(conn);
+            if (!conn->recv_armed) armRecv(conn);
+            return;
+        }
+
+        if (cqe.res == 0 && !conn->closing) {
+            // The peer is done sending: stop reading, answer what it sent and close once that has gone out
+            conn->peer_closed = true;
+            if (!conn->sending && conn->out.empty()) close(conn);
+            return;
+        }
+
+        if (!conn->closing && !conn->recv_armed) {
+            // Every provided buffer is taken until the next flush: read into the connection buffer this once rather
+            // than re-arming into the same empty pool
+            if (cqe.res == -ENOBUFS) return armPlainRecv(conn);
+
+            // Kernels before 6.0 reject multishot recv
+            if (cqe.res == -EINVAL && !conn->plain_recv) {
+                disableMultishotRecv(cqe.res);
+                return armPlainRecv(conn);
+            }
+        }
+
+        close(conn);
+    }
+
+    void onSend(UringConnection *conn, const io_uring_cqe &cqe) {
+        conn->sending = false;
+
+        if (cqe.res < 0 || conn->closing) return close(conn);
+
+        conn->inflight.consume(static_cast<size_t>(cqe.res));
+        if (!conn->inflight.empty()) {
+            queueSend(conn);
+            return;
+        }
+
+        startSend(conn);
+        if (!conn->sending && conn->peer_closed) close(conn);
+    }
+
+    const ServerConfig &config_;
+    unsigned            cpu_;
+    TcpSocket           listener_{-1};
+    IoUring             uring_;
+    ProvidedBuffers     bufs_;
+    bool                multishot_recv_ = true;
+    RequestHandler      handler_;
+    WorkerStats         stats_;
+
+    std::vector<std::unique_ptr<UringConnection>> conns_;  // indexed by registered file slot
+    std::vector<UringConnection *>                dirty_;
+};
+
+struct UringServer {
+    explicit UringServer(const ServerConfig &config) : config_(config) {}
+
+    // Starts a pinned worker per thread and blocks until they exit
+    int run() { return run_workers<UringWorker>(config_, "io_uring"); }
+
+private:
+    ServerConfig config_;
+};
+
+}  // namespace hlcup
@@ -0,0 +1,11 @@
+TEMPLATE = app
+CONFIG += console c++17
+CONFIG -= app_bundle
+CONFIG -= qt
+
+QMAKE_CXXFLAGS_RELEASE = -g -march=nehalem -O2 -std=c++17
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        int_format.cpp
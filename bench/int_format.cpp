@@ -0,0 +1,93 @@
+// IntFormat against fmt::format_to on the kinds of numbers we emit: account ids, signed timestamps and small
+// group counts. Prints ns per number for every formatter and data set.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "common.hpp"
+#include "core/IntFormat.hpp"
+
+#include "fmt/format.hpp"
+
+using namespace hlcup;
+
+namespace {
+
+const constexpr size_t kValues = 1 << 16;
+const constexpr int    kRounds = 200;
+
+template <typename T, typename F>
+double run(const std::vector<T> &values, F &&format) {
+    static char buf[kValues * 12];
+    size_t      total = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < kRounds; ++r) {
+        char *p = buf;
+        for (T v : values) p = format(p, v);
+        total += static_cast<size_t>(p - buf);
+        asm volatile("" : : "r"(buf) : "memory");
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    if (total == 0) std::puts("");
+    return double(ns) / double(kValues * kRounds);
+}
+
+template <typename T>
+bool check(const std::vector<T> &values) {
+    char a[16], b[16];
+    for (T v : values) {
+        char *ea = IntFormat::write(a, v);
+        char *eb = fmt::format_to(b, "{}", v);
+        if (ea - a != eb - b || std::memcmp(a, b, static_cast<size_t>(ea - a)) != 0) {
+            fmt::print(stderr, "mismatch on {}\n", v);
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+void bench(const char *name, const std::vector<T> &values) {
+    if (!check(values)) return;
+
+    double ours = run(values, [](char *p, T v) { return IntFormat::write(p, v); });
+    double fmt  = run(values, [](char *p, T v) { return fmt::format_to(p, "{}", v); });
+    double fint = run(values, [](char *p, T v) {
+        fmt::format_int f(v);
+        std::memcpy(p, f.data(), f.size());
+        return p + f.size();
+    });
+
+    fmt::print("{:<12} IntFormat {:6.2f} ns   fmt::format_to {:6.2f} ns   fmt::format_int {:6.2f} ns\n", name, ours, fmt, fint);
+}
+
+}  // namespace
+
+int main() {
+    std::mt19937 rng(42);
+
+    std::vector<u32> ids(kValues), counts(kValues);
+    std::vector<i32> timestamps(kValues);
+
+    std::uniform_int_distribution<u32> id_dist(1, 1300000), count_dist(1, 5000);
+    std::uniform_int_distribution<i32> ts_dist(-631152000, 1609459200);
+    for (size_t i = 0; i < kValues; ++i) {
+        ids[i]        = id_dist(rng);
+        counts[i]     = count_dist(rng);
+        timestamps[i] = ts_dist(rng);
+    }
+
+    std::vector<u32> edges = {0, 9, 10, 99, 100, 999, 1000, 4294967295u, 1000000000, 999999999};
+    std::vector<i32> signed_edges = {0, -1, -9, -10, 2147483647, -2147483647 - 1};
+    if (!check(edges) || !check(signed_edges)) return 1;
+
+    bench("ids", ids);
+    bench("timestamps", timestamps);
+    bench("counts", counts);
+    return 0;
+}
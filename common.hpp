@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -49,6 +51,11 @@ struct StringRef {
     }
 };
 
+template <typename T, size_t N>
+constexpr size_t get_size(const T (&)[N]) {
+    return N;
+}
+
 using Timestamp = i32;
 
 const static constexpr Timestamp kInvalidTimestamp = std::numeric_limits<Timestamp>::max();
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+namespace hlcup {
+
+// Byte buffer for socket IO. Consumed bytes are dropped by moving the read position, memory is only moved
+// when more space is requested.
+struct Buffer {
+    explicit Buffer(size_t capacity = 8192) : capacity_(capacity) {
+        data_ = reinterpret_cast<char *>(::malloc(capacity_));
+        assert(data_ != nullptr);
+    }
+
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    ~Buffer() { ::free(data_); }
+
+    char *      data() { return data_ + begin_; }
+    const char *data() const { return data_ + begin_; }
+    size_t      size() const { return end_ - begin_; }
+    bool        empty() const { return begin_ == end_; }
+
+    char * tail() { return data_ + end_; }
+    size_t space() const { return capacity_ - end_; }
+
+    void reserve(size_t n) {
+        if (space() >= n) return;
+
+        if (begin_ > 0) {
+            ::memmove(data_, data_ + begin_, size());
+            end_ -= begin_;
+            begin_ = 0;
+            if (space() >= n) return;
+        }
+
+        while (capacity_ - end_ < n) capacity_ *= 2;
+        data_ = reinterpret_cast<char *>(::realloc(data_, capacity_));
+        assert(data_ != nullptr);
+    }
+
+    void commit(size_t n) { end_ += n; }
+
+    void append(const void *src, size_t n) {
+        reserve(n);
+        ::memcpy(tail(), src, n);
+        end_ += n;
+    }
+
+    void consume(size_t n) {
+        begin_ += n;
+        if (begin_ == end_) { begin_ = end_ = 0; }
+    }
+
+    void clear() { begin_ = end_ = 0; }
+
+    void swap(Buffer &other) {
+        std::swap(data_, other.data_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(begin_, other.begin_);
+        std::swap(end_, other.end_);
+    }
+
+private:
+    char * data_;
+    size_t capacity_;
+    size_t begin_ = 0;
+    size_t end_   = 0;
+};
+
+}  // namespace hlcup
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+
+namespace hlcup {
+
+// Unique byte-string keys to u32 ids, for one writer and any number of readers. The table keeps only the ids,
+// `key_of(id)` gives the key an id currently has, so a hit is confirmed against the owner of the key rather than
+// a copy of it.
+//
+// Open addressing in groups of 16 slots with a control byte each (empty, deleted, or 7 bits of the hash), probed
+// a group at a time with one SSE2 compare. The writer fills the id before it publishes the control byte; a
+// reader that loads a group mid-write sees the old byte or the new one, and a stale hit fails the key check.
+// Growing publishes a new table and keeps the old ones until the index goes away, so a reader never touches
+// freed memory; together they are smaller than the live one. Size it with reserve() before a bulk insert.
+template <typename KeyOf>
+class HashIndex {
+public:
+    static const constexpr u32 kNone = ~u32(0);
+
+    explicit HashIndex(KeyOf key_of) : key_of_(key_of) { grow(16); }
+
+    HashIndex(const HashIndex &) = delete;
+    HashIndex &operator=(const HashIndex &) = delete;
+
+    // Any thread: the id that has `key`, or kNone
+    u32 find(std::string_view key) const {
+        const Table *table = table_.load(std::memory_order_acquire);
+        u64          h     = hash(key);
+        u32          found = kNone;
+        probe(*table, h, [&](size_t slot) {
+            u32 id = __atomic_load_n(&table->ids[slot], __ATOMIC_RELAXED);
+            if (key_of_(id) != key) return false;
+            found = id;
+            return true;
+        });
+        return found;
+    }
+
+    // Writer: false if the key already belongs to an id
+    bool insert(std::string_view key, u32 id) {
+        if (find(key) != kNone) return false;
+        if ((used_ + 1) * 8 > capacity() * 7) grow(live_ * 2 + 16);
+
+        Table &table = *table_.load(std::memory_order_relaxed);
+        u64    h     = hash(key);
+        if (table.ctrl[place(table, h)] == kEmpty) ++used_;
+        put(table, h, id);
+        ++live_;
+        return true;
+    }
+
+    // Writer: forgets `key` if it belongs to `id`
+    bool erase(std::string_view key, u32 id) {
+        Table &table  = *table_.load(std::memory_order_relaxed);
+        bool   erased = false;
+        probe(table, hash(key), [&](size_t slot) {
+            if (table.ids[slot] != id) return false;
+            __atomic_store_n(&table.ctrl[slot], kDeleted, __ATOMIC_RELEASE);
+            erased = true;
+            return true;
+        });
+        if (erased) --live_;
+        return erased;
+    }
+
+    // Writer: room for `n` keys without growing
+    void reserve(size_t n) {
+        if (n * 8 > capacity() * 7) grow(n);
+    }
+
+    size_t size() const { return live_; }
+
+    size_t capacity() const { return table_.load(std::memory_order_relaxed)->groups * kGroupSize; }
+
+    // 64-bit hash of the bytes, 8 at a time; the top 7 bits are the control tag, the rest picks the group
+    static u64 hash(std::string_view key) {
+        static const constexpr u64 kMul = 0x9e3779b97f4a7c15;
+
+        const char *p = key.data();
+        size_t      n = key.size();
+        u64         h = n * kMul;
+        for (; n >= 8; n -= 8, p += 8) {
+            u64 w;
+            std::memcpy(&w, p, 8);
+            h = (h ^ w) * kMul;
+            h ^= h >> 29;
+        }
+        if (n != 0) {
+            u64 w = 0;
+            std::memcpy(&w, p, n);
+            h = (h ^ w) * kMul;
+        }
+        h ^= h >> 32;
+        h *= kMul;
+        return h ^ (h >> 29);
+    }
+
+private:
+    static const constexpr size_t kGroupSize = 16;
+    static const constexpr u8     kEmpty     = 0x80;
+    static const constexpr u8     kDeleted   = 0xfe;
+
+    struct alignas(16) Group {
+        u8 ctrl[kGroupSize];
+    };
+
+    struct Table {
+        size_t                   groups;  // a power of two
+        std::unique_ptr<Group[]> group_storage;
+        std::unique_ptr<u32[]>   ids;
+        u8 *                     ctrl;
+
+        explicit Table(size_t n) : groups(n), group_storage(new Group[n]), ids(new u32[n * kGroupSize]) {
+            ctrl = group_storage[0].ctrl;
+            std::memset(ctrl, kEmpty, n * kGroupSize);
+        }
+    };
+
+    static u8 tag(u64 h) { return static_cast<u8>(h >> 57); }
+
+    // Calls hit(slot) for every slot whose tag matches until it returns true or a group with an empty slot ends
+    // the chain. Groups follow a triangular sequence, which visits every one of a power-of-two table
+    template <typename F>
+    static void probe(const Table &table, u64 h, F &&hit) {
+        const __m128i tags  = _mm_set1_epi8(static_cast<char>(tag(h)));
+        const __m128i empty = _mm_set1_epi8(static_cast<char>(kEmpty));
+        size_t        mask  = table.groups - 1;
+        size_t        g     = h & mask;
+        for (size_t step = 1; step <= table.groups; g = (g + step++) & mask) {
+            // Racy by the letter of the memory model, like a seqlock read: a slot is only trusted after its id
+            // passes the key check
+            __m128i group = _mm_load_si128(reinterpret_cast<const __m128i *>(table.ctrl) + g);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            for (unsigned bits = _mm_movemask_epi8(_mm_cmpeq_epi8(group, tags)); bits != 0; bits &= bits - 1) {
+                if (hit(g * kGroupSize + __builtin_ctz(bits))) return;
+            }
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(group, empty)) != 0) return;
+        }
+    }
+
+    // First empty or deleted slot on the key's chain
+    static size_t place(const Table &table, u64 h) {
+        size_t mask = table.groups - 1;
+        size_t g    = h & mask;
+        for (size_t step = 1;; g = (g + step++) & mask) {
+            __m128i  group = _mm_load_si128(reinterpret_cast<const __m128i *>(table.ctrl) + g);
+            unsigned free  = _mm_movemask_epi8(group);  // empty and deleted both have the high bit
+            if (free != 0) return g * kGroupSize + __builtin_ctz(free);
+        }
+    }
+
+    static void put(Table &table, u64 h, u32 id) {
+        size_t slot = place(table, h);
+        __atomic_store_n(&table.ids[slot], id, __ATOMIC_RELAXED);
+        __atomic_store_n(&table.ctrl[slot], tag(h), __ATOMIC_RELEASE);
+    }
+
+    // Rehashes the live keys into a table with room for `n`
+    void grow(size_t n) {
+        size_t groups = 1;
+        while (groups * kGroupSize * 7 < n * 8) groups *= 2;
+
+        std::unique_ptr<Table> next(new Table(groups));
+        used_ = 0;
+        if (!tables_.empty()) {
+            const Table &old = *tables_.back();
+            for (size_t slot = 0; slot < old.groups * kGroupSize; ++slot) {
+                if (old.ctrl[slot] & 0x80) continue;
+                u32 id = old.ids[slot];
+                put(*next, hash(key_of_(id)), id);
+                ++used_;
+            }
+        }
+        table_.store(next.get(), std::memory_order_release);
+        tables_.push_back(std::move(next));
+    }
+
+    KeyOf                               key_of_;
+    std::atomic<Table *>                table_{nullptr};
+    std::vector<std::unique_ptr<Table>> tables_;  // the current one last
+    size_t                              used_ = 0;  // slots that are not empty, deleted ones included
+    size_t                              live_ = 0;
+};
+
+}  // namespace hlcup
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstring>
+
+#include "common.hpp"
+
+namespace hlcup {
+
+// Integer to decimal for ids, timestamps, counts and Content-Length. The digit count is computed first from
+// the bit length, so the caller knows the size up front and the digits are stored back to front, two per
+// step from a 200-byte table. No terminating zero is written.
+struct IntFormat {
+    static const constexpr size_t kMaxU32 = 10;
+    static const constexpr size_t kMaxI32 = 11;
+
+    HLCUP_ALWAYS_INLINE static inline u32 digits(u32 val) {
+        static const constexpr u32 kPow10[] = {0, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+
+        // floor(log10(2^bits)) estimate, fixed up by one comparison
+        u32 bits = 32 - static_cast<u32>(__builtin_clz(val | 1));
+        u32 n    = (bits * 1233) >> 12;
+        return n + 1 - (val < kPow10[n]);
+    }
+
+    HLCUP_ALWAYS_INLINE static inline u32 digits(i32 val) { return val < 0 ? digits(0u - static_cast<u32>(val)) + 1 : digits(static_cast<u32>(val)); }
+
+    // Writes exactly `len` digits of val ending at p + len, len must be digits(val)
+    HLCUP_ALWAYS_INLINE static inline void write(char *p, u32 val, u32 len) {
+        char *d = p + len;
+        while (val >= 100) {
+            u32 idx = (val % 100) * 2;
+            val /= 100;
+            d -= 2;
+            std::memcpy(d, &kDigits[idx], 2);
+        }
+        if (val >= 10) {
+            std::memcpy(d - 2, &kDigits[val * 2], 2);
+        } else {
+            d[-1] = static_cast<char>('0' + val);
+        }
+    }
+
+    // Returns the end of the written number
+    HLCUP_ALWAYS_INLINE static inline char *write(char *p, u32 val) {
+        u32 len = digits(val);
+        write(p, val, len);
+        return p + len;
+    }
+
+    HLCUP_ALWAYS_INLINE static inline char *write(char *p, i32 val) {
+        u32 abs = static_cast<u32>(val);
+        if (val < 0) {
+            *p++ = '-';
+            abs  = 0u - abs;
+        }
+        return write(p, abs);
+    }
+
+private:
+    static inline constexpr char kDigits[] =
+        "0001020304050607080910111213141516171819"
+        "2021222324252627282930313233343536373839"
+        "4041424344454647484950515253545556575859"
+        "6061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+};
+
+}  // namespace hlcup
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include "io.hpp"
+#include "io_uring.hpp"
+#include "mman.hpp"
+
+#include "common.hpp"
+
+namespace hlcup {
+
+// Bare io_uring on top of the raw syscalls: mmap'ed SQ/CQ rings, sparse registered files and provided buffer rings.
+// Single-threaded, every SQE queued between two enter() calls goes to the kernel with one syscall.
+struct IoUring {
+    IoUring() = default;
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    ~IoUring() {
+        if (ring_ptr_ != nullptr) ef::platform::munmap(ring_ptr_, ring_size_);
+        if (sqes_ != nullptr) ef::platform::munmap(sqes_, sqes_size_);
+        if (fd_ >= 0) ef::platform::close(fd_);
+    }
+
+    // Returns 0 or -errno
+    int init(unsigned entries, unsigned flags) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        params.flags = flags;
+
+        fd_ = ef::platform::io_uring_setup(entries, &params);
+        if (fd_ < 0) return fd_;
+
+        if (!(params.features & IORING_FEAT_SINGLE_MMAP)) return -ENOTSUP;
+
+        size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+        size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ring_size_     = sq_size > cq_size ? sq_size : cq_size;
+
+        ring_ptr_ = reinterpret_cast<char *>(ef::platform::mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING));
+        if (ef::platform::is_mmap_error(ring_ptr_)) {
+            int err   = static_cast<int>(reinterpret_cast<long>(ring_ptr_));
+            ring_ptr_ = nullptr;
+            return err;
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_      = reinterpret_cast<io_uring_sqe *>(ef::platform::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+        if (ef::platform::is_mmap_error(sqes_)) {
+            int err = static_cast<int>(reinterpret_cast<long>(sqes_));
+            sqes_   = nullptr;
+            return err;
+        }
+
+        sq_head_    = reinterpret_cast<u32 *>(ring_ptr_ + params.sq_off.head);
+        sq_tail_    = reinterpret_cast<u32 *>(ring_ptr_ + params.sq_off.tail);
+        sq_mask_    = *reinterpret_cast<u32 *>(ring_ptr_ + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        cq_head_    = reinterpret_cast<u32 *>(ring_ptr_ + params.cq_off.head);
+        cq_tail_    = reinterpret_cast<u32 *>(ring_ptr_ + params.cq_off.tail);
+        cq_mask_    = *reinterpret_cast<u32 *>(ring_ptr_ + params.cq_off.ring_mask);
+        cqes_       = reinterpret_cast<io_uring_cqe *>(ring_ptr_ + params.cq_off.cqes);
+
+        // SQEs are always used in ring order, so the indirection array is filled once
+        u32 *array = reinterpret_cast<u32 *>(ring_ptr_ + params.sq_off.array);
+        for (u32 i = 0; i < sq_entries_; ++i) array[i] = i;
+
+        sqe_tail_ = *sq_tail_;
+        return 0;
+    }
+
+    int fd() const { return fd_; }
+
+    // Returns nullptr when the submission queue is full, the caller has to enter() first
+    io_uring_sqe *getSqe() {
+        u32 head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (HLCUP_UNLIKELY(sqe_tail_ - head >= sq_entries_)) return nullptr;
+
+        io_uring_sqe *sqe = &sqes_[sqe_tail_ & sq_mask_];
+        ++sqe_tail_;
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    unsigned pending() const { return sqe_tail_ - *sq_tail_; }
+
+    // Publishes queued SQEs and waits for at least wait_nr completions, one syscall. Returns io_uring_enter() result.
+    int enter(unsigned wait_nr) {
+        unsigned to_submit = pending();
+        __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+        return ef::platform::io_uring_enter(fd_, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+    }
+
+    // Calls f(const io_uring_cqe &) for every available completion, then releases them to the kernel
+    template <typename F>
+    unsigned forEachCqe(F &&f) {
+        u32 head = *cq_head_;
+        u32 tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+
+        for (u32 i = head; i != tail; ++i) f(cqes_[i & cq_mask_]);
+
+        __atomic_store_n(cq_head_, tail, __ATOMIC_RELEASE);
+        return tail - head;
+    }
+
+    int registerSparseFiles(unsigned count) {
+        io_uring_rsrc_register reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.nr    = count;
+        reg.flags = IORING_RSRC_REGISTER_SPARSE;
+        return ef::platform::io_uring_register(fd_, IORING_REGISTER_FILES2, &reg, sizeof(reg));
+    }
+
+    int registerBufRing(io_uring_buf_ring *ring, unsigned entries, u16 group) {
+        io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr    = reinterpret_cast<u64>(ring);
+        reg.ring_entries = entries;
+        reg.bgid         = group;
+        return ef::platform::io_uring_register(fd_, IORING_REGISTER_PBUF_RING, &reg, 1);
+    }
+
+private:
+    int    fd_        = -1;
+    char * ring_ptr_  = nullptr;
+    size_t ring_size_ = 0;
+
+    io_uring_sqe *sqes_      = nullptr;
+    size_t        sqes_size_ = 0;
+
+    u32 *sq_head_    = nullptr;
+    u32 *sq_tail_    = nullptr;
+    u32  sq_mask_    = 0;
+    u32  sq_entries_ = 0;
+    u32  sqe_tail_   = 0;
+
+    u32 *         cq_head_ = nullptr;
+    u32 *         cq_tail_ = nullptr;
+    u32           cq_mask_ = 0;
+    io_uring_cqe *cqes_    = nullptr;
+};
+
+// Buffers the kernel picks from for multishot recv. They sit in a buffer ring registered with
+// IORING_REGISTER_PBUF_RING (5.19+); returned buffers are written to the ring and flush() publishes them with one tail
+// store. Where the ring can't be registered they are handed over with IORING_OP_PROVIDE_BUFFERS instead: flush()
+// queues one SQE per run of consecutive ids, so they go out with the next enter().
+struct ProvidedBuffers {
+    ProvidedBuffers() = default;
+
+    ProvidedBuffers(const ProvidedBuffers &) = delete;
+    ProvidedBuffers &operator=(const ProvidedBuffers &) = delete;
+
+    ~ProvidedBuffers() {
+        if (ring_ != nullptr) ef::platform::munmap(ring_, ring_size_);
+        if (data_ != nullptr) ef::platform::munmap(data_, data_size_);
+    }
+
+    // entries must be a power of two. Returns 0 or -errno; all buffers are returned, the first flush() hands them over
+    int init(IoUring &uring, unsigned entries, u32 buf_size, u16 group) {
+        entries_   = entries;
+        buf_size_  = buf_size;
+        group_     = group;
+        data_size_ = static_cast<size_t>(entries) * buf_size;
+
+        void *data = ef::platform::mmap(nullptr, data_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (ef::platform::is_mmap_error(data)) return static_cast<int>(reinterpret_cast<long>(data));
+        data_ = reinterpret_cast<char *>(data);
+
+        ring_size_ = entries * sizeof(io_uring_buf);
+        void *ring = ef::platform::mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (ef::platform::is_mmap_error(ring)) return static_cast<int>(reinterpret_cast<long>(ring));
+        ring_ = reinterpret_cast<io_uring_buf_ring *>(ring);
+
+        if (uring.registerBufRing(ring_, entries, group) < 0) {
+            ef::platform::munmap(ring_, ring_size_);
+            ring_ = nullptr;
+            returned_.reserve(entries);
+        }
+
+        for (unsigned bid = 0; bid < entries; ++bid) recycle(static_cast<u16>(bid));
+        return 0;
+    }
+
+    // Whether the buffers go through a registered ring rather than PROVIDE_BUFFERS
+    bool ring() const { return ring_ != nullptr; }
+
+    char *get(u16 bid) { return data_ + static_cast<size_t>(bid) * buf_size_; }
+
+    void recycle(u16 bid) {
+        if (ring_ == nullptr) return returned_.push_back(bid);
+
+        // Entry 0 starts at the ring itself, its resv field holds the tail. Compiled as C++ the uapi header puts
+        // ring_->bufs one entry in (the empty struct in __DECLARE_FLEX_ARRAY takes a byte there), so the entries
+        // are addressed from the start of the ring
+        io_uring_buf &buf = reinterpret_cast<io_uring_buf *>(ring_)[tail_ & (entries_ - 1)];
+        buf.addr          = reinterpret_cast<u64>(get(bid));
+        buf.len           = buf_size_;
+        buf.bid           = bid;
+        ++tail_;
+    }
+
+    // next_sqe() returns a cleared SQE with its user_data set, only PROVIDE_BUFFERS asks for one
+    template <typename F>
+    void flush(F &&next_sqe) {
+        if (ring_ != nullptr) return __atomic_store_n(&ring_->tail, tail_, __ATOMIC_RELEASE);
+
+        for (size_t i = 0, j; i < returned_.size(); i = j) {
+            for (j = i + 1; j < returned_.size() && returned_[j] == returned_[j - 1] + 1;) ++j;
+
+            io_uring_sqe *s = next_sqe();
+            s->opcode       = IORING_OP_PROVIDE_BUFFERS;
+            s->fd           = static_cast<i32>(j - i);
+            s->addr         = reinterpret_cast<u64>(get(returned_[i]));
+            s->len          = buf_size_;
+            s->off          = returned_[i];
+            s->buf_group    = group_;
+        }
+        returned_.clear();
+    }
+
+private:
+    io_uring_buf_ring *ring_      = nullptr;
+    size_t             ring_size_ = 0;
+    char *             data_      = nullptr;
+    size_t             data_size_ = 0;
+    unsigned           entries_   = 0;
+    u32                buf_size_  = 0;
+    u16                group_     = 0;
+    u16                tail_      = 0;
+    std::vector<u16>   returned_;  // PROVIDE_BUFFERS only
+};
+
+}  // namespace hlcup
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace hlcup {
+
+// Bounded queue for any number of producers and one consumer (Vyukov's cell-sequence ring). A producer claims a
+// slot with one CAS on the tail and publishes it through the slot's sequence number, the consumer owns the head
+// and never writes shared state except the sequence of the slot it frees. Nothing blocks: push() fails when the
+// ring is full and pop() when it is empty.
+template <typename T>
+class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacity_pow2) : cells_(new Cell[capacity_pow2]), mask_(capacity_pow2 - 1) {
+        assert(capacity_pow2 >= 2 && (capacity_pow2 & mask_) == 0);
+        for (size_t i = 0; i < capacity_pow2; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    // Any thread
+    bool push(T &&value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell & cell = cells_[pos & mask_];
+            size_t seq  = cell.seq.load(std::memory_order_acquire);
+            intptr_t d  = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (d == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (d < 0) {
+                return false;  // the consumer is a whole lap behind
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer thread only
+    bool pop(T &out) {
+        Cell & cell = cells_[head_ & mask_];
+        size_t seq  = cell.seq.load(std::memory_order_acquire);
+        if (seq != head_ + 1) return false;
+
+        out = std::move(cell.value);
+        cell.seq.store(head_ + mask_ + 1, std::memory_order_release);
+        ++head_;
+        return true;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<size_t> seq;
+        T                   value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t                  mask_;
+
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t head_ = 0;
+};
+
+}  // namespace hlcup
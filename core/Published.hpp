@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace hlcup {
+
+// An immutable object that one publisher thread replaces as a whole while any number of readers use it. A
+// reader takes a Pin: it stores the object in a reader slot and checks it is still current before using it. The
+// publisher swaps the pointer first and scans the slots after, so it frees a replaced object only once no Pin
+// holds it.
+template <typename T, size_t kSlots = 128>
+class Published {
+public:
+    Published() = default;
+
+    Published(const Published &) = delete;
+    Published &operator=(const Published &) = delete;
+
+    ~Published() {
+        for (T *old : retired_) delete old;
+        delete current_.load(std::memory_order_relaxed);
+    }
+
+    // Publisher: makes `next` current and retires the previous one
+    void publish(T *next) {
+        T *old = current_.load(std::memory_order_relaxed);
+        current_.store(next, std::memory_order_seq_cst);
+        if (old != nullptr) retired_.push_back(old);
+    }
+
+    // Publisher: frees the retired objects no Pin holds any more, true when none are left
+    bool reclaim() {
+        size_t kept = 0;
+        for (T *old : retired_) {
+            if (pinned(old)) {
+                retired_[kept++] = old;
+            } else {
+                delete old;
+            }
+        }
+        retired_.resize(kept);
+        return kept == 0;
+    }
+
+    // Publisher: what it published last, nullptr before the first publish()
+    T *current() const { return current_.load(std::memory_order_relaxed); }
+
+    // Meant to live for one request. There must be a published object
+    class Pin {
+    public:
+        explicit Pin(const Published &published) {
+            const T *obj = published.current_.load(std::memory_order_seq_cst);
+            size_t   i   = std::hash<std::thread::id>()(std::this_thread::get_id()) % kSlots;
+            for (const T *free = nullptr;; i = (i + 1) % kSlots, free = nullptr) {
+                if (published.slots_[i].obj.compare_exchange_strong(free, obj, std::memory_order_seq_cst)) break;
+            }
+            slot_ = &published.slots_[i];
+
+            for (;;) {
+                const T *again = published.current_.load(std::memory_order_seq_cst);
+                if (again == obj) break;
+                obj = again;
+                slot_->obj.store(obj, std::memory_order_seq_cst);
+            }
+            obj_ = obj;
+        }
+
+        Pin(const Pin &) = delete;
+        Pin &operator=(const Pin &) = delete;
+
+        ~Pin() { slot_->obj.store(nullptr, std::memory_order_release); }
+
+        const T &operator*() const { return *obj_; }
+        const T *operator->() const { return obj_; }
+
+    private:
+        typename Published::Slot *slot_;
+        const T *                 obj_;
+    };
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<const T *> obj{nullptr};  // what a Pin holds, null when free
+    };
+
+    bool pinned(const T *obj) const {
+        for (const Slot &slot : slots_) {
+            if (slot.obj.load(std::memory_order_seq_cst) == obj) return true;
+        }
+        return false;
+    }
+
+    std::atomic<T *> current_{nullptr};
+    std::vector<T *> retired_;
+    mutable Slot     slots_[kSlots];
+};
+
+}  // namespace hlcup
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <emmintrin.h>
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+
+#include "common.hpp"
+
+namespace hlcup {
+
+// A value with one writer and lock-free readers. The writer makes the sequence odd, changes the value and makes
+// it even again; a reader copies the value between two loads of the sequence and starts over if it saw a write
+// in progress or the sequence moved. Readers never block the writer or each other, they only repeat a copy that
+// raced with a write.
+template <typename T>
+class SeqLocked {
+    static_assert(std::is_trivially_copyable<T>::value, "readers copy the value byte by byte");
+
+public:
+    SeqLocked() = default;
+
+    // Any thread
+    T load() const {
+        T out;
+        for (;;) {
+            u32 seq = seq_.load(std::memory_order_acquire);
+            if (HLCUP_UNLIKELY(seq & 1)) {
+                _mm_pause();
+                continue;
+            }
+            // Racy by the letter of the memory model, like every seqlock: a torn copy is thrown away below
+            std::memcpy(&out, &value_, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (HLCUP_LIKELY(seq_.load(std::memory_order_relaxed) == seq)) return out;
+        }
+    }
+
+    // Writer thread only: fn(T &) changes the value in place
+    template <typename F>
+    void update(F &&fn) {
+        u32 seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        fn(value_);
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    void store(const T &value) {
+        update([&value](T &dst) { dst = value; });
+    }
+
+    // Writer thread only, no copy
+    const T &unsafeRef() const { return value_; }
+
+private:
+    std::atomic<u32> seq_{0};
+    T                value_{};
+};
+
+}  // namespace hlcup
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+
+namespace hlcup {
+
+// Append-only array for one writer and any number of readers. Elements live in chunks of 2^kChunkBits that are
+// allocated once and never move, so readers index it while the writer grows it and references stay valid.
+// The writer publishes the new size with a release store after constructing the elements; an index a reader
+// got from anything published after that (e.g. a seqlocked row) is safe to use.
+template <typename T, unsigned kChunkBits = 16, size_t kMaxChunks = 1024>
+class StableVector {
+public:
+    static const constexpr size_t kChunkSize = size_t(1) << kChunkBits;
+    static const constexpr size_t kMaxSize   = kChunkSize * kMaxChunks;
+
+    StableVector() {
+        for (auto &chunk : chunks_) chunk.store(nullptr, std::memory_order_relaxed);
+    }
+
+    StableVector(const StableVector &) = delete;
+    StableVector &operator=(const StableVector &) = delete;
+
+    ~StableVector() {
+        for (auto &chunk : chunks_) delete[] chunk.load(std::memory_order_relaxed);
+    }
+
+    // Any thread, for indexes below a size() it has seen
+    const T &operator[](size_t i) const { return chunks_[i >> kChunkBits].load(std::memory_order_acquire)[i & (kChunkSize - 1)]; }
+    T &      operator[](size_t i) { return chunks_[i >> kChunkBits].load(std::memory_order_acquire)[i & (kChunkSize - 1)]; }
+
+    size_t size() const { return size_.load(std::memory_order_acquire); }
+
+    // Writer thread only. New elements are value-initialized. Callers bound their indexes; growing past kMaxSize
+    // would index past the chunk table, so it aborts in release builds too
+    void resize(size_t n) {
+        if (n > kMaxSize) std::abort();
+        size_t size = size_.load(std::memory_order_relaxed);
+        if (n <= size) return;
+        for (size_t c = size >> kChunkBits; c <= (n - 1) >> kChunkBits; ++c) chunk(c);
+        size_.store(n, std::memory_order_release);
+    }
+
+    // Writer thread only. The element is written before the size that covers it is published
+    void push_back(const T &value) {
+        size_t size = size_.load(std::memory_order_relaxed);
+        if (size >= kMaxSize) std::abort();
+        chunk(size >> kChunkBits)[size & (kChunkSize - 1)] = value;
+        size_.store(size + 1, std::memory_order_release);
+    }
+
+    // Writer thread only. Copies `n` elements so that they are contiguous, skipping to the next chunk when they
+    // would straddle one (n must fit a chunk), and returns the index of the first
+    size_t append(const T *data, size_t n) {
+        assert(n <= kChunkSize);
+        size_t start = size_.load(std::memory_order_relaxed);
+        if ((start & (kChunkSize - 1)) + n > kChunkSize) start = (start + kChunkSize - 1) & ~(kChunkSize - 1);
+        if (n == 0) return start;
+        if (start + n > kMaxSize) std::abort();
+
+        T *dst = chunk(start >> kChunkBits) + (start & (kChunkSize - 1));
+        for (size_t i = 0; i < n; ++i) dst[i] = data[i];
+        size_.store(start + n, std::memory_order_release);
+        return start;
+    }
+
+    // Any thread: the first of `n` elements stored by one append()
+    const T *data(size_t i) const { return &(*this)[i]; }
+
+private:
+    // Writer thread only: chunk c, allocated on first use
+    T *chunk(size_t c) {
+        T *chunk = chunks_[c].load(std::memory_order_relaxed);
+        if (chunk == nullptr) {
+            chunk = new T[kChunkSize]();
+            chunks_[c].store(chunk, std::memory_order_release);
+        }
+        return chunk;
+    }
+
+    std::atomic<T *>    chunks_[kMaxChunks];
+    std::atomic<size_t> size_{0};
+};
+
+}  // namespace hlcup
@@ -1,5 +1,5 @@
 CONFIG -= qt qtquickcompiler
-CONFIG += c++17 console
+CONFIG += c++17 console thread
 
 TARGET = hlcup2
 
@@ -34,14 +34,42 @@ DEFINES += _LARGEFILE64_SOURCE \
 
 HEADERS += \
     TcpSocket.hpp \
+    Connection.hpp \
+    EpollServer.hpp \
+    UringServer.hpp \
+    Server.hpp \
+    core/IoUring.hpp \
+    RequestHandler.hpp \
+    StoreWriter.hpp \
+    Journal.hpp \
+    Likes.hpp \
+    LikesParser.hpp \
+    Response.hpp \
+    core/Buffer.hpp \
+    core/HashIndex.hpp \
+    core/IntFormat.hpp \
+    core/MpscQueue.hpp \
+    core/Published.hpp \
+    core/SeqLock.hpp \
+    core/StableVector.hpp \
+    platform/linux/epoll.hpp \
+    platform/linux/sched.hpp \
+    platform/linux/io_uring.hpp \
+    platform/linux/mman.hpp \
     platform/x86_64/syscall.hpp \
     platform/linux/socket.hpp \
     miniz.h \
     AccountParser.hpp \
     Account.hpp \
+    AccountStore.hpp \
+    AccountIndex.hpp \
+    AccountWriter.hpp \
+    Dictionary.hpp \
     common.hpp \
     HttpParser.hpp \
+    HeaderScanner.hpp \
     Request.hpp \
+    RequestRouter.hpp \
     ParseUtils.hpp \
     Time.hpp \
     platform/linux/io.hpp \
@@ -28,6 +28,10 @@
 //};
 
 #include "AccountParser.hpp"
+#include "AccountStore.hpp"
+#include "Journal.hpp"
+#include "Likes.hpp"
+#include "StoreWriter.hpp"
 
 #include <codecvt>
 #include <locale>
@@ -42,6 +46,8 @@
 
 #include "Time.hpp"
 
+#include "EpollServer.hpp"
+#include "UringServer.hpp"
 #include "HttpParser.hpp"
 #include "ParseUtils.hpp"
 
@@ -54,10 +60,11 @@ void print_stats(const std::string &name, const std::map<T, size_t> &st) {
 }
 
 #define BENCH_ONLY 1
+#define RUN_SERVER 1
 
 using namespace ef;
 
-int main() {
+int main(int argc, char **argv) {
     //    {
     //        hlcup::Request req;
     //        std::string    buf(
@@ -120,6 +127,8 @@ int main() {
 
     hlcup::Account       acc;
     hlcup::AccountParser parser;
+    hlcup::AccountStore  store;
+    hlcup::LikeStore     likes;
 
     mz_zip_reader_init_file(&zip, "/home/me/prj/hlcup2/rating/data/data.zip", 0);
     mz_uint           num_files = mz_zip_reader_get_num_files(&zip);
@@ -158,6 +167,8 @@ int main() {
         //        p = pe;
         while (p < pe) {
             if (!parser.parse(p, pe, acc)) break;
+            store.add(acc);
+            likes.load(acc.id, acc.likes);
             ++cnt;
 #if !BENCH_ONLY
             if (acc.birth != hlcup::kInvalidTimestamp) {
@@ -249,5 +260,40 @@ int main() {
     std::cout << cnt << std::endl;
     std::cout << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count() << std::endl;
 
+#if RUN_SERVER
+    auto config = hlcup::ServerConfig::fromArgs(argc, argv);
+
+    // From here on the store has one writer, the loader above is done with it
+    store.buildUniqueIndexes();
+    likes.build();
+
+    hlcup::Journal journal;
+    if (config.journal != nullptr) {
+        int err = journal.open(config.journal);
+        if (err < 0) {
+            fmt::print(stderr, "journal {}: {}\n", config.journal, std::strerror(-err));
+            return 1;
+        }
+    }
+
+    hlcup::AccountIndex index(store);
+    hlcup::StoreWriter  writer(store, &index, config.journal != nullptr ? &journal : nullptr, &likes);
+    if (config.journal != nullptr) {
+        auto replay_start = std::chrono::steady_clock::now();
+        auto replayed     = writer.replay(journal);
+        fmt::print("replayed {} updates in {}ms\n", replayed,
+                   std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - replay_start).count());
+    }
+
+    index.build();
+    index.start();
+    likes.start();
+    writer.start();
+
+    config.writer = &writer;
+    if (config.backend == hlcup::ServerConfig::kUring) return hlcup::UringServer(config).run();
+    return hlcup::EpollServer(config).run();
+#else
     return 0;
+#endif
 }
@@ -1,3 +1,4 @@
 TEMPLATE = subdirs
 SUBDIRS = hlcup2.pro \
-    testserver
+    testserver \
+    bench
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <linux/bpf.h>
+
+#include "syscall.hpp"
+
+namespace ef {
+namespace platform {
+
+[[maybe_unused]] static inline int bpf(int cmd, bpf_attr *attr) { return syscall<int>(SC::bpf, cmd, attr, sizeof(bpf_attr)); }
+
+}  // namespace platform
+}  // namespace ef
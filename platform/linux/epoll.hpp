@@ -0,0 +1,17 @@
+#pragma once
+
+#include <sys/epoll.h>
+
+#include "syscall.hpp"
+
+namespace ef {
+namespace platform {
+
+[[maybe_unused]] static inline int epoll_create1(int flags) { return syscall<int>(SC::epoll_create1, flags); }
+[[maybe_unused]] static inline int epoll_ctl(int epfd, int op, int fd, epoll_event *event) { return syscall<int>(SC::epoll_ctl, epfd, op, fd, event); }
+[[maybe_unused]] static inline int epoll_wait(int epfd, epoll_event *events, int maxevents, int timeout) {
+    return syscall<int>(SC::epoll_wait, epfd, events, maxevents, timeout);
+}
+
+}  // namespace platform
+}  // namespace ef
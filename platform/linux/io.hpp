@@ -1,5 +1,7 @@
 #pragma once
 
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <cstddef>
 #include <cstdint>
@@ -18,7 +20,11 @@ static const constexpr int kStderrFileno = 2;
 [[maybe_unused]] static inline long pread(int fd, void *buf, size_t size, off_t offset) { return syscall<long>(SC::pread64, fd, buf, size, offset); }
 [[maybe_unused]] static inline long pwrite(int fd, const void *buf, size_t size, off_t offset) { return syscall<long>(SC::pwrite64, fd, buf, size, offset); }
 
+[[maybe_unused]] static inline int open(const char *path, int flags, mode_t mode = 0) { return syscall<int>(SC::openat, AT_FDCWD, path, flags, mode); }
 [[maybe_unused]] static inline int close(int fd) { return syscall<int>(SC::close, fd); }
+[[maybe_unused]] static inline int fstat(int fd, struct stat *st) { return syscall<int>(SC::fstat, fd, st); }
+[[maybe_unused]] static inline int fallocate(int fd, int mode, off_t offset, off_t len) { return syscall<int>(SC::fallocate, fd, mode, offset, len); }
+[[maybe_unused]] static inline int fsync(int fd) { return syscall<int>(SC::fsync, fd); }
 
 }  // namespace platform
 }  // namespace ef
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <signal.h>
+
+#include "syscall.hpp"
+
+namespace ef {
+namespace platform {
+
+[[maybe_unused]] static inline int io_uring_setup(unsigned entries, io_uring_params *params) { return syscall<int>(SC::io_uring_setup, entries, params); }
+[[maybe_unused]] static inline int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall<int>(SC::io_uring_enter, fd, to_submit, min_complete, flags, 0L, _NSIG / 8);
+}
+[[maybe_unused]] static inline int io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return syscall<int>(SC::io_uring_register, fd, opcode, arg, nr_args);
+}
+
+}  // namespace platform
+}  // namespace ef
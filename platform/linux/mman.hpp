@@ -0,0 +1,24 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include "syscall.hpp"
+
+namespace ef {
+namespace platform {
+
+// Returns -errno on failure, check with is_mmap_error()
+[[maybe_unused]] static inline void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    return reinterpret_cast<void *>(syscall<long>(SC::mmap, addr, length, prot, flags, fd, offset));
+}
+[[maybe_unused]] static inline int munmap(void *addr, size_t length) { return syscall<int>(SC::munmap, addr, length); }
+[[maybe_unused]] static inline int msync(void *addr, size_t length, int flags) { return syscall<int>(SC::msync, addr, length, flags); }
+
+[[maybe_unused]] static inline bool is_mmap_error(void *ptr) {
+    long val = reinterpret_cast<long>(ptr);
+    return val < 0 && val > -4096;
+}
+
+}  // namespace platform
+}  // namespace ef
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <sched.h>
+#include <sys/types.h>
+
+#include "syscall.hpp"
+
+namespace ef {
+namespace platform {
+
+[[maybe_unused]] static inline int sched_setaffinity(pid_t pid, size_t size, const cpu_set_t *mask) {
+    return syscall<int>(SC::sched_setaffinity, pid, size, mask);
+}
+
+[[maybe_unused]] static inline int set_affinity(int cpu) {
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    return ef::platform::sched_setaffinity(0, sizeof(cpuset), &cpuset);
+}
+
+}  // namespace platform
+}  // namespace ef
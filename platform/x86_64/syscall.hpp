@@ -339,6 +339,9 @@ enum class SC : long {
     pkey_alloc             = 330,
     pkey_free              = 331,
     statx                  = 332,
+    io_uring_setup         = 425,
+    io_uring_enter         = 426,
+    io_uring_register      = 427,
 };
 
 [[maybe_unused]] static inline long syscall(long n) {
@@ -1,4 +1,20 @@
 #include "tst_hlcuptest.h"
+#include "tst_requestrouter.h"
+#include "tst_headerscanner.h"
+#include "tst_responsequeue.h"
+#include "tst_accountwriter.h"
+#include "tst_intformat.h"
+#include "tst_checksum.h"
+#include "tst_pcap.h"
+#include "tst_tcpoptions.h"
+#include "tst_timerwheel.h"
+#include "tst_trace.h"
+#include "tst_storewriter.h"
+#include "tst_accountindex.h"
+#include "tst_journal.h"
+#include "tst_hashindex.h"
+#include "tst_likes.h"
+#include "tst_connection.h"
 
 #include <gtest/gtest.h>
 
@@ -6,8 +6,39 @@ CONFIG -= app_bundle
 CONFIG += thread
 CONFIG -= qt
 
+INCLUDEPATH += \
+        .. \
+        ../platform/x86_64 \
+        ../platform/linux
+
 HEADERS += \
-        tst_hlcuptest.h
+        tst_hlcuptest.h \
+        tst_requestrouter.h \
+        tst_headerscanner.h \
+        tst_responsequeue.h \
+        tst_accountwriter.h \
+        tst_intformat.h \
+        tst_checksum.h \
+        tst_pcap.h \
+        tst_tcpoptions.h \
+        tst_timerwheel.h \
+        tst_trace.h \
+        tst_storewriter.h \
+        tst_accountindex.h \
+        tst_journal.h \
+        tst_hashindex.h \
+        tst_likes.h \
+        tst_connection.h
 
 SOURCES += \
         main.cpp
+
+RAGEL_FILES += \
+        ../HttpParser.cpp.rl
+
+ragel.output = $$OUT_PWD/ragel_${QMAKE_FILE_IN_BASE}
+ragel.input = RAGEL_FILES
+ragel.commands = ragel -G2 ${QMAKE_FILE_IN} -o ${QMAKE_FILE_OUT}
+ragel.variable_out = SOURCES
+ragel.name = RAGEL
+QMAKE_EXTRA_COMPILERS += ragel
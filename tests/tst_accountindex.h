@@ -0,0 +1,145 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../AccountIndex.hpp"
+#include "../StoreWriter.hpp"
+
+using namespace testing;
+
+namespace {
+
+std::unique_ptr<hlcup::AccountUpdate> indexUpdate(hlcup::AccountUpdate::Kind kind, hlcup::u32 id, hlcup::Account::Status status) {
+    std::unique_ptr<hlcup::AccountUpdate> u(new hlcup::AccountUpdate);
+    u->kind       = kind;
+    u->acc.id     = id;
+    u->acc.status = status;
+    if (kind == hlcup::AccountUpdate::kNew) u->acc.sex = id % 2 ? hlcup::Account::kMale : hlcup::Account::kFemale;
+    return u;
+}
+
+}  // namespace
+
+TEST(AccountIndexTest, MergesDeltaUntilRebuildCatchesUp) {
+    using hlcup::AccountIndex;
+    using hlcup::AccountUpdate;
+
+    hlcup::AccountStore store;
+    hlcup::Account      acc;
+    for (hlcup::u32 id = 1; id <= 10; ++id) {
+        acc.id     = id;
+        acc.sex    = id % 2 ? hlcup::Account::kMale : hlcup::Account::kFemale;
+        acc.status = hlcup::Account::kFree;
+        store.add(acc);
+    }
+
+    AccountIndex index(store);
+    index.build();
+    hlcup::StoreWriter writer(store, &index);
+    writer.start();
+
+    writer.submit(indexUpdate(AccountUpdate::kUpdate, 4, hlcup::Account::kOccupied));
+    writer.submit(indexUpdate(AccountUpdate::kUpdate, 7, hlcup::Account::kOccupied));
+    writer.submit(indexUpdate(AccountUpdate::kNew, 12, hlcup::Account::kFree));
+    writer.submit(indexUpdate(AccountUpdate::kUpdate, 4, hlcup::Account::kComplicated));
+    writer.sync();
+
+    std::vector<hlcup::u32> ids;
+    {
+        AccountIndex::View view(index);
+        EXPECT_EQ(3u, view.deltaSize());
+
+        view.select(AccountIndex::kStatus, hlcup::Account::kFree, ids);
+        EXPECT_THAT(ids, ElementsAre(12, 10, 9, 8, 6, 5, 3, 2, 1));
+        EXPECT_EQ(9u, view.count(AccountIndex::kStatus, hlcup::Account::kFree));
+
+        view.select(AccountIndex::kStatus, hlcup::Account::kOccupied, ids);
+        EXPECT_THAT(ids, ElementsAre(7));
+        EXPECT_EQ(1u, view.count(AccountIndex::kStatus, hlcup::Account::kComplicated));
+        EXPECT_EQ(6u, view.count(AccountIndex::kSex, hlcup::Account::kFemale));
+    }
+
+    index.start();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (index.rebuilds() == 0 && std::chrono::steady_clock::now() < deadline) std::this_thread::sleep_for(AccountIndex::kPoll);
+    ASSERT_EQ(1u, index.rebuilds());
+
+    AccountIndex::View view(index);
+    EXPECT_EQ(0u, view.deltaSize());
+    view.select(AccountIndex::kStatus, hlcup::Account::kFree, ids);
+    EXPECT_THAT(ids, ElementsAre(12, 10, 9, 8, 6, 5, 3, 2, 1));
+    view.select(AccountIndex::kStatus, hlcup::Account::kComplicated, ids);
+    EXPECT_THAT(ids, ElementsAre(4));
+    EXPECT_EQ(0u, view.count(AccountIndex::kCountry, 5));
+}
+
+TEST(AccountIndexTest, SwapsSnapshotsUnderReaders) {
+    using hlcup::AccountIndex;
+
+    hlcup::AccountStore store;
+    AccountIndex        index(store);
+    index.build();
+    hlcup::StoreWriter writer(store, &index);
+    writer.start();
+    index.start();
+
+    static const hlcup::u32 kAccounts = 3000;
+    std::atomic<bool>       done{false};
+    std::thread             reader([&] {
+        std::vector<hlcup::u32> ids;
+        hlcup::u32              last = 0;
+        while (!done.load()) {
+            AccountIndex::View view(index);
+            view.select(AccountIndex::kStatus, hlcup::Account::kFree, ids);
+            // Accounts only ever appear, with ids in order, so every view holds a prefix at least as long as before
+            ASSERT_GE(ids.size(), last);
+            for (size_t i = 0; i < ids.size(); ++i) ASSERT_EQ(ids.size() - i, ids[i]);
+            ASSERT_EQ(ids.size(), view.count(AccountIndex::kStatus, hlcup::Account::kFree));
+            last = static_cast<hlcup::u32>(ids.size());
+        }
+    });
+
+    for (hlcup::u32 id = 1; id <= kAccounts; ++id) {
+        writer.submit(indexUpdate(hlcup::AccountUpdate::kNew, id, hlcup::Account::kFree));
+        if (id % 1000 != 0) continue;
+        // Pauses long enough for the rebuilder to swap snapshots in between
+        writer.sync();
+        std::this_thread::sleep_for(AccountIndex::kQuiet * 2);
+    }
+    done.store(true);
+    reader.join();
+
+    EXPECT_GE(index.rebuilds(), 2u);
+    AccountIndex::View view(index);
+    EXPECT_EQ(kAccounts, view.count(AccountIndex::kStatus, hlcup::Account::kFree));
+}
+
+TEST(AccountIndexTest, RebuildTrimsTheLog) {
+    using hlcup::AccountIndex;
+
+    hlcup::AccountStore store;
+    AccountIndex        index(store);
+    index.build();
+
+    // Ids without rows, as if the writer had logged them
+    for (size_t i = 0; i < 3 * AccountIndex::kLogChunk + 5; ++i) index.touch(static_cast<hlcup::u32>(i % 100));
+    EXPECT_EQ(4u, index.logChunks());
+    EXPECT_EQ(100u, AccountIndex::View(index).deltaSize());
+
+    index.start();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (index.rebuilds() == 0 && std::chrono::steady_clock::now() < deadline) std::this_thread::sleep_for(AccountIndex::kPoll);
+    ASSERT_EQ(1u, index.rebuilds());
+    EXPECT_EQ(1u, index.logChunks());
+    EXPECT_EQ(0u, AccountIndex::View(index).deltaSize());
+
+    // The log goes on past the trimmed chunks
+    for (size_t i = 0; i < AccountIndex::kLogChunk; ++i) index.touch(7);
+    EXPECT_EQ(2u, index.logChunks());
+    EXPECT_EQ(1u, AccountIndex::View(index).deltaSize());
+}
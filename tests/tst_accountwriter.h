@@ -0,0 +1,67 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../AccountWriter.hpp"
+
+using namespace testing;
+
+static hlcup::StringRef put_string(hlcup::Account &acc, hlcup::u32 &offset, const char *s) {
+    hlcup::StringRef ref{offset, static_cast<hlcup::u32>(std::strlen(s))};
+    std::memcpy(acc.string_data + offset, s, ref.size);
+    offset += ref.size;
+    return ref;
+}
+
+TEST(AccountWriterTest, EscapesOnce) {
+    std::string out;
+    hlcup::Json::escape("Мо\"\\\x01 x\xf0\x9f\x98\x80", out);
+    EXPECT_EQ("\\u041c\\u043e\\\"\\\\\\u0001 x\\ud83d\\ude00", out);
+
+    hlcup::Dictionary cities("city");
+    EXPECT_EQ(1u, cities.add("Лейпориж"));
+    EXPECT_EQ(2u, cities.add("Роттеродам"));
+    EXPECT_EQ(1u, cities.add("Лейпориж"));
+    EXPECT_EQ(",\"city\":\"\\u041b\\u0435\\u0439\\u043f\\u043e\\u0440\\u0438\\u0436\"", cities.fragment(1));
+    EXPECT_EQ("", cities.fragment(hlcup::Dictionary::kNull));
+}
+
+TEST(AccountWriterTest, WritesRequestedFields) {
+    hlcup::Account acc;
+    hlcup::u32     offset = 0;
+    acc.id                = 1337;
+    acc.sex               = hlcup::Account::kMale;
+    acc.status            = hlcup::Account::kOccupied;
+    acc.birth             = -123456789;
+    acc.premium.start     = 1500000000;
+    acc.premium.finish    = 1600000000;
+    acc.email             = put_string(acc, offset, "foo@bar.ru");
+    acc.fname             = put_string(acc, offset, "Иван");
+    acc.city              = put_string(acc, offset, "Роттеродам");
+
+    hlcup::AccountStore store;
+    store.add(acc);
+    acc.clear();
+    acc.id     = 7;
+    acc.sex    = hlcup::Account::kFemale;
+    acc.status = hlcup::Account::kFree;
+    acc.email  = put_string(acc, offset, "a@b.c");
+    store.add(acc);
+
+    hlcup::AccountWriter writer(store);
+    hlcup::Buffer        out;
+    hlcup::u32           ids[] = {1337, 5, 7};
+    writer.writeList(out, ids, 3, hlcup::AccountWriter::kRecommendFields | hlcup::AccountWriter::kSex | hlcup::AccountWriter::kCity);
+
+    EXPECT_EQ(
+        "{\"accounts\":["
+        "{\"id\":1337,\"email\":\"foo@bar.ru\",\"sex\":\"m\",\"status\":\"\\u0437\\u0430\\u043d\\u044f\\u0442\\u044b\","
+        "\"fname\":\"\\u0418\\u0432\\u0430\\u043d\",\"city\":\"\\u0420\\u043e\\u0442\\u0442\\u0435\\u0440\\u043e\\u0434\\u0430\\u043c\","
+        "\"birth\":-123456789,\"premium\":{\"start\":1500000000,\"finish\":1600000000}},"
+        "{\"id\":7,\"email\":\"a@b.c\",\"sex\":\"f\",\"status\":\"\\u0441\\u0432\\u043e\\u0431\\u043e\\u0434\\u043d\\u044b\"}"
+        "]}",
+        std::string(out.data(), out.size()));
+}
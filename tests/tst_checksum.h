@@ -0,0 +1,126 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+#include "../testserver/checksum.hpp"
+
+using namespace testing;
+
+// Full scalar checksum of `len` bytes in memory order, as cksum_generic computes it
+static uint16_t scalar_checksum(std::vector<uint8_t> &buf, size_t offset, size_t len) { return htons(cksum_generic(buf.data() + offset, len, 0)); }
+
+TEST(ChecksumTest, AccumulateMatchesScalar) {
+    std::mt19937         rng(1624);
+    std::vector<uint8_t> buf(2048 + 64);
+    for (auto &b : buf) b = static_cast<uint8_t>(rng());
+
+    for (size_t offset = 0; offset < 16; offset += 2) {
+        for (size_t len = 0; len <= 1600; ++len) {
+            uint16_t vec = static_cast<uint16_t>(~csum_fold(csum_accumulate(buf.data() + offset, len, 0)));
+            ASSERT_EQ(scalar_checksum(buf, offset, len), vec) << "offset " << offset << " len " << len;
+        }
+    }
+
+    // All ones exercises the carries, the initial sum is a large multiple of 0xffff, i.e. zero
+    std::vector<uint8_t> ones(9000, 0xff);
+    EXPECT_EQ(scalar_checksum(ones, 0, ones.size()), static_cast<uint16_t>(~csum_fold(csum_accumulate(ones.data(), ones.size(), 0))));
+    EXPECT_EQ(scalar_checksum(ones, 0, 1001), static_cast<uint16_t>(~csum_fold(csum_accumulate(ones.data(), 1001, 0xffffffffffffull))));
+}
+
+TEST(ChecksumTest, Replace) {
+    std::mt19937 rng(1071);
+
+    for (int i = 0; i < 10000; ++i) {
+        std::vector<uint8_t> buf(20);
+        for (auto &b : buf) b = static_cast<uint8_t>(rng());
+        buf[10] = buf[11] = 0;
+        uint16_t check    = scalar_checksum(buf, 0, buf.size());
+
+        uint16_t old16 = csum_load16(&buf[2]);
+        uint32_t old32 = csum_load32(&buf[12]);
+        uint16_t new16 = static_cast<uint16_t>(rng());
+        uint32_t new32 = static_cast<uint32_t>(rng());
+        memcpy(&buf[2], &new16, sizeof(new16));
+        memcpy(&buf[12], &new32, sizeof(new32));
+
+        uint16_t updated = csum_replace4(csum_replace2(check, old16, new16), old32, new32);
+        uint16_t full    = scalar_checksum(buf, 0, buf.size());
+        // 0x0000 and 0xffff are the same one's complement value, eqn. 3 may give either
+        if (full != updated) { ASSERT_TRUE((full == 0 && updated == 0xffff) || (full == 0xffff && updated == 0)) << i; }
+    }
+}
+
+TEST(ChecksumTest, TemplateMatchesFullRecompute) {
+    std::mt19937 rng(793);
+
+    // ip header, tcp header and up to 1460 bytes of options and payload, at an odd address like in FrameHdr
+    std::vector<uint8_t> frame(1 + 20 + 20 + 1460);
+    uint8_t *            ip  = frame.data() + 1;
+    uint8_t *            tcp = ip + 20;
+
+    iphdr tpl_ip{};
+    tpl_ip.ihl      = 5;
+    tpl_ip.version  = 4;
+    tpl_ip.tos      = 16;
+    tpl_ip.tot_len  = htons(40 + 97);
+    tpl_ip.frag_off = htons(0x4000);
+    tpl_ip.ttl      = 64;
+    tpl_ip.protocol = IPPROTO_TCP;
+
+    tcphdr tpl_tcp{};
+    tpl_tcp.source = htons(80);
+    tpl_tcp.doff   = 5;
+    tpl_tcp.psh    = 1;
+    tpl_tcp.ack    = 1;
+    tpl_tcp.window = htons(65483);
+
+    ChecksumTemplate tpl;
+    tpl.init(&tpl_ip, &tpl_tcp);
+
+    for (int i = 0; i < 2000; ++i) {
+        size_t   extra = rng() % 1461;
+        uint16_t doff  = static_cast<uint16_t>(5 + (rng() % 2) * 3);
+        if (extra < (doff - 5u) * 4) extra = (doff - 5u) * 4;
+
+        iphdr ih   = tpl_ip;
+        ih.saddr   = static_cast<uint32_t>(rng());
+        ih.daddr   = static_cast<uint32_t>(rng());
+        ih.id      = static_cast<uint16_t>(rng() % 4 == 0 ? rng() : 0);
+        ih.tot_len = htons(static_cast<uint16_t>(40 + extra));
+
+        tcphdr th  = tpl_tcp;
+        th.dest    = static_cast<uint16_t>(rng());
+        th.seq     = static_cast<uint32_t>(rng());
+        th.ack_seq = static_cast<uint32_t>(rng());
+        th.doff    = doff;
+        th.syn     = rng() % 2;
+        th.fin     = rng() % 2;
+        th.psh     = rng() % 2;
+        th.window  = static_cast<uint16_t>(rng());
+
+        memcpy(ip, &ih, sizeof(ih));
+        memcpy(tcp, &th, sizeof(th));
+        for (size_t k = 0; k < extra; ++k) tcp[20 + k] = static_cast<uint8_t>(rng());
+
+        iphdr  aligned_ip;
+        memcpy(&aligned_ip, ip, sizeof(aligned_ip));
+        std::vector<uint8_t> aligned_tcp(tcp, tcp + 20 + extra);
+
+        uint16_t ip_check = tpl.ipCheck(ip);
+        aligned_ip.check  = 0;
+        uint16_t expected = htons(cksum_generic(reinterpret_cast<unsigned char *>(&aligned_ip), sizeof(aligned_ip), 0));
+        if (expected != ip_check) { ASSERT_TRUE((expected == 0 && ip_check == 0xffff) || (expected == 0xffff && ip_check == 0)) << i; }
+
+        reinterpret_cast<tcphdr *>(aligned_tcp.data())->check = 0;
+        ASSERT_EQ(compute_tcp_checksum(&aligned_ip, aligned_tcp.data()), tpl.tcpCheck(ip, tcp, 20 + extra)) << i;
+
+        // Offloaded: summing the segment over the partial check gives the same result
+        reinterpret_cast<tcphdr *>(aligned_tcp.data())->check = tpl.tcpPseudo(ip, 20 + extra);
+        uint16_t completed = static_cast<uint16_t>(~csum_fold(csum_accumulate(aligned_tcp.data(), aligned_tcp.size(), 0)));
+        ASSERT_EQ(tpl.tcpCheck(ip, tcp, 20 + extra), completed) << i;
+    }
+}
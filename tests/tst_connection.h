@@ -0,0 +1,62 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../Connection.hpp"
+
+using namespace testing;
+
+namespace {
+
+struct RecordingHandler {
+    std::vector<std::string> answered;  // type and body of every request handled
+
+    void handle(const hlcup::Request &req, const char *body, hlcup::u32 body_size, hlcup::ResponseQueue &) {
+        answered.push_back(std::to_string(req.type) + ":" + std::string(body, body_size));
+    }
+};
+
+// Feeds `reads` to the connection one by one, the way the server loops do
+std::vector<std::string> answer(const std::vector<std::string> &reads) {
+    hlcup::Connection conn(-1);
+    RecordingHandler  handler;
+    for (const std::string &read : reads) {
+        conn.in.append(read.data(), read.size());
+        conn.process(handler);
+    }
+    return handler.answered;
+}
+
+}  // namespace
+
+TEST(ConnectionTest, HeadersSplitBetweenReads) {
+    const std::string filter = std::to_string(hlcup::Request::kFilter) + ":";
+    const std::string post   = std::to_string(hlcup::Request::kAccountsNew) + ":";
+
+    EXPECT_THAT(answer({"GET /accounts/filter/?request_id=1 HTTP/1.1\r\nHost: localhost\r\nUser-Ag",
+                        "ent: tank\r\nConnection: keep-alive\r\n",
+                        "\r\nGET /accounts/filter/?request_id=2 HTTP/1.1\r\n\r\n"}),
+                ElementsAre(filter, filter));
+
+    // The request line ends the first read
+    EXPECT_THAT(answer({"GET /accounts/filter/?request_id=1 HTTP/1.1\r\n", "Host: localhost\r", "\n\r\n"}), ElementsAre(filter));
+
+    EXPECT_THAT(answer({"POST /accounts/new/?request_id=3 HTTP/1.1\r\nHost: localhost\r\nConte",
+                        "nt-Length: 5\r\nConnection: keep-alive\r\n\r\n12", "345"}),
+                ElementsAre(post + "12345"));
+}
+
+TEST(ConnectionTest, RequestLineSplitBetweenReads) {
+    const std::string post = std::to_string(hlcup::Request::kAccountsNew) + ":";
+
+    EXPECT_THAT(answer({"POST /accounts/", "new/?request_id=4 HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}"}), ElementsAre(post + "{}"));
+
+    std::string              request = "POST /accounts/new/?request_id=4 HTTP/1.1\r\nHost: localhost\r\nContent-Length: 2\r\n\r\n{}";
+    std::vector<std::string> bytes;
+    for (char ch : request) bytes.emplace_back(1, ch);
+    EXPECT_THAT(answer(bytes), ElementsAre(post + "{}"));
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../AccountStore.hpp"
+#include "../StoreWriter.hpp"
+#include "../core/HashIndex.hpp"
+
+using namespace testing;
+
+namespace {
+
+struct VectorKey {
+    const std::vector<std::string> *keys;
+
+    std::string_view operator()(hlcup::u32 id) const { return (*keys)[id]; }
+};
+
+}  // namespace
+
+TEST(HashIndexTest, FindsInsertsAndErases) {
+    std::vector<std::string>     keys;
+    hlcup::HashIndex<VectorKey> index(VectorKey{&keys});
+
+    for (hlcup::u32 id = 0; id < 100000; ++id) {
+        keys.push_back("user" + std::to_string(id) + "@mail.ru");
+        ASSERT_TRUE(index.insert(keys.back(), id));
+    }
+    EXPECT_EQ(100000u, index.size());
+    EXPECT_FALSE(index.insert("user7@mail.ru", 7));
+    EXPECT_EQ(77777u, index.find("user77777@mail.ru"));
+    EXPECT_EQ(index.kNone, index.find("user100000@mail.ru"));
+    EXPECT_EQ(index.kNone, index.find(""));
+
+    EXPECT_FALSE(index.erase("user5@mail.ru", 6));
+    EXPECT_TRUE(index.erase("user5@mail.ru", 5));
+    EXPECT_EQ(index.kNone, index.find("user5@mail.ru"));
+
+    // The account takes a new key and another one takes the freed one
+    keys[5] = "five@mail.ru";
+    ASSERT_TRUE(index.insert(keys[5], 5));
+    keys.push_back("user5@mail.ru");
+    ASSERT_TRUE(index.insert(keys.back(), 100000));
+    EXPECT_EQ(5u, index.find("five@mail.ru"));
+    EXPECT_EQ(100000u, index.find("user5@mail.ru"));
+    EXPECT_EQ(100001u, index.size());
+}
+
+TEST(HashIndexTest, ReadersFindWhatWasPublished) {
+    static const hlcup::u32 kKeys = 200000;
+
+    std::vector<std::string> keys(kKeys);
+    for (hlcup::u32 id = 0; id < kKeys; ++id) keys[id] = std::to_string(id * 7919u) + "@x.ru";
+
+    hlcup::HashIndex<VectorKey> index(VectorKey{&keys});
+    std::atomic<hlcup::u32>     published{0};
+    std::thread                 reader([&] {
+        for (hlcup::u32 seen = 0; seen < kKeys;) {
+            seen = published.load(std::memory_order_acquire);
+            // Every key inserted before `seen` is found, through any number of table growths
+            for (hlcup::u32 id = seen / 2; id < seen; id += 37) ASSERT_EQ(id, index.find(keys[id]));
+            for (hlcup::u32 id = seen + 1; id < kKeys; id += 4099) {
+                hlcup::u32 found = index.find(keys[id]);
+                ASSERT_TRUE(found == index.kNone || found == id);
+            }
+        }
+    });
+
+    for (hlcup::u32 id = 0; id < kKeys; ++id) {
+        index.insert(keys[id], id);
+        published.store(id + 1, std::memory_order_release);
+    }
+    reader.join();
+}
+
+TEST(HashIndexTest, StoreRejectsTakenEmailsAndPhones) {
+    hlcup::AccountStore store;
+    hlcup::Account      acc;
+    for (hlcup::u32 id = 1; id <= 3; ++id) {
+        std::string email = "u" + std::to_string(id) + "@\xd0\xbf.ru";  // escaped as п in the store
+        std::memcpy(acc.string_data, email.data(), email.size());
+        acc.id     = id;
+        acc.email  = hlcup::StringRef{0, static_cast<hlcup::u32>(email.size())};
+        acc.phone  = id == 1 ? hlcup::StringRef{100, 13} : hlcup::StringRef{hlcup::Account::kInvalidOffset, 0};
+        acc.sex    = hlcup::Account::kMale;
+        acc.status = hlcup::Account::kFree;
+        std::memcpy(acc.string_data + 100, "8(912)3456789", 13);
+        store.add(acc);
+    }
+    store.buildUniqueIndexes();
+    EXPECT_EQ(2u, store.findEmail("u2@\xd0\xbf.ru"));
+    EXPECT_EQ(1u, store.findPhone("8(912)3456789"));
+    EXPECT_EQ(hlcup::Account::kInvalidId, store.findEmail("u4@\xd0\xbf.ru"));
+
+    hlcup::StoreWriter writer(store);
+    writer.start();
+    auto submit = [&writer](hlcup::AccountUpdate::Kind kind, hlcup::u32 id, const char *email, const char *phone) {
+        std::unique_ptr<hlcup::AccountUpdate> u(new hlcup::AccountUpdate);
+        u->kind       = kind;
+        u->acc.id     = id;
+        u->acc.sex    = hlcup::Account::kFemale;
+        u->acc.status = hlcup::Account::kFree;
+        hlcup::u32 offset = 0;
+        for (auto field : {std::make_pair(&u->acc.email, email), std::make_pair(&u->acc.phone, phone)}) {
+            if (field.second == nullptr) continue;
+            hlcup::u32 size = static_cast<hlcup::u32>(std::strlen(field.second));
+            std::memcpy(u->acc.string_data + offset, field.second, size);
+            *field.first = hlcup::StringRef{offset, size};
+            offset += size;
+        }
+        writer.submit(std::move(u));
+    };
+
+    submit(hlcup::AccountUpdate::kNew, 4, "u1@\xd0\xbf.ru", nullptr);        // taken email
+    submit(hlcup::AccountUpdate::kNew, 5, "u5@x.ru", "8(912)3456789");      // taken phone
+    submit(hlcup::AccountUpdate::kUpdate, 2, "u3@\xd0\xbf.ru", nullptr);     // another account's email
+    submit(hlcup::AccountUpdate::kUpdate, 1, "new@x.ru", "8(912)0000000");  // frees both of account 1
+    submit(hlcup::AccountUpdate::kNew, 6, "u1@\xd0\xbf.ru", "8(912)3456789");
+    writer.sync();
+    writer.stop();
+
+    EXPECT_FALSE(store.exists(4));
+    EXPECT_FALSE(store.exists(5));
+    EXPECT_EQ(2u, store.findEmail("u2@\xd0\xbf.ru"));
+    EXPECT_EQ(3u, store.findEmail("u3@\xd0\xbf.ru"));
+    EXPECT_EQ(1u, store.findEmail("new@x.ru"));
+    EXPECT_EQ(1u, store.findPhone("8(912)0000000"));
+    EXPECT_EQ(6u, store.findEmail("u1@\xd0\xbf.ru"));
+    EXPECT_EQ(6u, store.findPhone("8(912)3456789"));
+}
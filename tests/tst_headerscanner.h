@@ -0,0 +1,57 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../HeaderScanner.hpp"
+
+using namespace testing;
+
+TEST(HeaderScannerTest, FindsEndOfHeaders) {
+    std::string buf("Host: localhost\r\nUser-Agent: tank\r\nConnection: keep-alive\r\n\r\nGET");
+    const char *end = hlcup::HeaderScanner::scan(buf.data(), buf.data() + buf.size(), nullptr);
+    ASSERT_NE(nullptr, end);
+    EXPECT_EQ(std::string("GET"), std::string(end));
+
+    std::string empty("\r\n");
+    EXPECT_EQ(empty.data() + 2, hlcup::HeaderScanner::scan(empty.data(), empty.data() + empty.size(), nullptr));
+
+    std::string partial("Host: localhost\r\nUser-Agent: tank\r\nConnection: keep-alive\r\n\r");
+    EXPECT_EQ(nullptr, hlcup::HeaderScanner::scan(partial.data(), partial.data() + partial.size(), nullptr));
+
+    // Nothing past the request line yet, the bytes behind `pe` are left over from an earlier request
+    std::string stale("\r\n");
+    EXPECT_EQ(nullptr, hlcup::HeaderScanner::scan(stale.data(), stale.data(), nullptr));
+    EXPECT_EQ(nullptr, hlcup::HeaderScanner::scan(stale.data(), stale.data() + 1, nullptr));
+}
+
+TEST(HeaderScannerTest, ContentLength) {
+    std::string buf("Host: localhost\r\nCoNtEnT-LeNgTh : 1234\r\nConnection: keep-alive\r\n\r\n");
+    hlcup::u32  len = 0;
+    EXPECT_NE(nullptr, hlcup::HeaderScanner::scan(buf.data(), buf.data() + buf.size(), &len));
+    EXPECT_EQ(1234u, len);
+
+    std::string tail("content-length: 7\r\n\r\n");
+    len = 0;
+    EXPECT_NE(nullptr, hlcup::HeaderScanner::scan(tail.data(), tail.data() + tail.size(), &len));
+    EXPECT_EQ(7u, len);
+}
+
+TEST(ParseUtilsTest, ParseUint) {
+    const std::string cases[] = {"0\r\n", "42\r\n", "12345678\r\n", "1234567890 ", "7"};
+    const hlcup::u32  values[] = {0, 42, 12345678, 1234567890, 7};
+
+    for (size_t i = 0; i < 5; i++) {
+        const char *p = cases[i].data();
+        hlcup::u32  v = 0;
+        EXPECT_TRUE(hlcup::ParseUtils::parseUint(p, cases[i].data() + cases[i].size(), v));
+        EXPECT_EQ(values[i], v);
+    }
+
+    std::string bad("x1");
+    const char *p = bad.data();
+    hlcup::u32  v;
+    EXPECT_FALSE(hlcup::ParseUtils::parseUint(p, bad.data() + bad.size(), v));
+}
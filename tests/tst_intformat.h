@@ -0,0 +1,28 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../core/IntFormat.hpp"
+
+using namespace testing;
+
+template <typename T>
+static std::string format_int(T val) {
+    char  buf[16];
+    char *end = hlcup::IntFormat::write(buf, val);
+    EXPECT_EQ(hlcup::IntFormat::digits(val), static_cast<hlcup::u32>(end - buf));
+    return std::string(buf, end);
+}
+
+TEST(IntFormatTest, Unsigned) {
+    for (hlcup::u32 v : {0u, 7u, 9u, 10u, 99u, 100u, 101u, 999u, 1000u, 65535u, 1299999u, 999999999u, 1000000000u, 4294967295u}) {
+        EXPECT_EQ(std::to_string(v), format_int(v));
+    }
+}
+
+TEST(IntFormatTest, Signed) {
+    for (hlcup::i32 v : {0, -1, -10, 1500000000, -631152000, 2147483647, -2147483647 - 1}) { EXPECT_EQ(std::to_string(v), format_int(v)); }
+}
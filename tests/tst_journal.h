@@ -0,0 +1,118 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <string>
+
+#include "../Journal.hpp"
+#include "../StoreWriter.hpp"
+
+using namespace testing;
+
+namespace {
+
+struct JournalFile {
+    std::string path = testing::TempDir() + "hlcup_journal_" + std::to_string(::getpid());
+
+    ~JournalFile() { ::unlink(path.c_str()); }
+};
+
+void setString(hlcup::Account &acc, hlcup::StringRef &ref, hlcup::u32 &offset, const std::string &value) {
+    std::memcpy(acc.string_data + offset, value.data(), value.size());
+    ref = hlcup::StringRef{offset, static_cast<hlcup::u32>(value.size())};
+    offset += static_cast<hlcup::u32>(value.size());
+}
+
+}  // namespace
+
+TEST(JournalTest, ReplaysCommittedRecordsOnly) {
+    JournalFile file;
+    {
+        hlcup::Journal journal;
+        ASSERT_EQ(0, journal.open(file.path.c_str(), 1 << 16));
+
+        hlcup::AccountUpdate u;
+        hlcup::u32           offset = 0;
+        u.kind                      = hlcup::AccountUpdate::kNew;
+        u.acc.id                    = 42;
+        u.acc.sex                   = hlcup::Account::kFemale;
+        u.acc.status                = hlcup::Account::kOccupied;
+        u.acc.birth                 = 631152000;
+        u.acc.premium.start         = 1;
+        setString(u.acc, u.acc.email, offset, "a@b.ru");
+        setString(u.acc, u.acc.city, offset, "Москва");
+        u.acc.interests = {offset};
+        for (const char *interest : {"Пиво", "Кино"}) {
+            offset += static_cast<hlcup::u32>(std::strlen(interest));
+            std::memcpy(u.acc.string_data + u.acc.interests.back(), interest, std::strlen(interest));
+            u.acc.interests.push_back(offset);
+        }
+        u.acc.likes = {{7, 1500000000}, {9, 1500000001}};
+        ASSERT_TRUE(journal.append(u));
+
+        u.acc.clear();
+        u.kind       = hlcup::AccountUpdate::kUpdate;
+        u.acc.id     = 42;
+        u.acc.status = hlcup::Account::kFree;
+        ASSERT_TRUE(journal.append(u));
+        journal.commit();
+
+        // Appended but never committed, as if the process died before the group was
+        u.acc.status = hlcup::Account::kComplicated;
+        ASSERT_TRUE(journal.append(u));
+    }
+
+    hlcup::Journal journal;
+    ASSERT_EQ(0, journal.open(file.path.c_str(), 1 << 16));
+
+    std::vector<std::string> seen;
+    EXPECT_EQ(2u, journal.replay([&seen](const hlcup::AccountUpdate &u) {
+        const hlcup::Account &acc = u.acc;
+        std::string           s   = std::to_string(u.kind) + " " + std::to_string(acc.id) + " " + std::to_string(acc.status);
+        if (acc.email.offset != hlcup::Account::kInvalidOffset) s += " " + acc.getString(acc.email);
+        if (acc.city.offset != hlcup::Account::kInvalidOffset) s += " " + acc.getString(acc.city);
+        if (acc.fname.offset != hlcup::Account::kInvalidOffset) s += " fname";
+        for (size_t i = 0; i < acc.getInterestsCount(); ++i) s += " " + acc.getString(acc.getInterest(i));
+        for (const auto &like : acc.likes) s += " " + std::to_string(like.to_id) + "@" + std::to_string(like.ts);
+        if (acc.birth != hlcup::kInvalidTimestamp) s += " " + std::to_string(acc.birth);
+        seen.push_back(s);
+    }));
+    EXPECT_THAT(seen, ElementsAre("0 42 2 a@b.ru Москва Пиво Кино 7@1500000000 9@1500000001 631152000", "1 42 0"));
+}
+
+TEST(JournalTest, WriterJournalsWhatItApplies) {
+    JournalFile file;
+    {
+        hlcup::AccountStore store;
+        hlcup::Journal      journal;
+        ASSERT_EQ(0, journal.open(file.path.c_str(), 1 << 20));
+        hlcup::StoreWriter writer(store, nullptr, &journal);
+        writer.start();
+
+        for (hlcup::u32 id = 1; id <= 1000; ++id) {
+            std::unique_ptr<hlcup::AccountUpdate> u(new hlcup::AccountUpdate);
+            u->kind       = id % 10 == 0 ? hlcup::AccountUpdate::kUpdate : hlcup::AccountUpdate::kNew;
+            u->acc.id     = id % 10 == 0 ? id - 1 : id;
+            u->acc.sex    = hlcup::Account::kMale;
+            u->acc.birth  = static_cast<hlcup::Timestamp>(id);
+            u->acc.status = hlcup::Account::kFree;
+            writer.submit(std::move(u));
+        }
+        writer.stop();
+    }
+
+    hlcup::AccountStore store;
+    hlcup::Journal      journal;
+    ASSERT_EQ(0, journal.open(file.path.c_str()));
+    hlcup::StoreWriter writer(store, nullptr, &journal);
+    EXPECT_EQ(1000u, writer.replay(journal));
+
+    hlcup::StoredAccount acc;
+    ASSERT_TRUE(store.read(9, acc));
+    EXPECT_EQ(10, acc.birth);
+    EXPECT_FALSE(store.read(10, acc));
+    EXPECT_TRUE(store.read(999, acc));
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../Journal.hpp"
+#include "../Likes.hpp"
+#include "../LikesParser.hpp"
+#include "../StoreWriter.hpp"
+
+using namespace testing;
+
+namespace {
+
+std::vector<std::string> likesOf(const hlcup::LikeStore &likes, hlcup::LikeStore::Direction d, hlcup::u32 id) {
+    hlcup::LikeStore::View   view(likes);
+    std::vector<std::string> out;
+    view.forEach(d, id, [&out](const hlcup::Account::Like &like) { out.push_back(std::to_string(like.to_id) + "@" + std::to_string(like.ts)); });
+    return out;
+}
+
+}  // namespace
+
+TEST(LikesTest, ParsesBatches) {
+    std::vector<hlcup::LikeEdge> likes;
+    std::string body = "{\"likes\":[\n{\"likee\": 35, \"ts\": 1464729120, \"liker\": 4},\n{\"liker\":7,\"likee\":3,\"ts\":1}\n]}";
+    ASSERT_TRUE(hlcup::LikesParser::parse(body.data(), body.data() + body.size(), likes));
+    ASSERT_EQ(2u, likes.size());
+    EXPECT_EQ(4u, likes[0].liker);
+    EXPECT_EQ(35u, likes[0].likee);
+    EXPECT_EQ(1464729120, likes[0].ts);
+    EXPECT_EQ(7u, likes[1].liker);
+    EXPECT_EQ(3u, likes[1].likee);
+
+    std::string empty = "{\"likes\": []}";
+    EXPECT_TRUE(hlcup::LikesParser::parse(empty.data(), empty.data() + empty.size(), likes));
+    EXPECT_TRUE(likes.empty());
+
+    for (std::string bad : {"", "{}", "{\"likes\":[{\"likee\":1,\"liker\":2}]}", "{\"likes\":[{\"likee\":1,\"ts\":2,\"liker\":x}]}",
+                            "{\"likes\":[{\"likee\":1,\"ts\":2,\"liker\":3}}", "{\"likes\":[{\"likee\":1,\"ts\":2,\"liker\":3,\"id\":4}]}",
+                            "{\"likes\":[{\"likee\":1,\"ts\":2,\"liker\":3}]} x"}) {
+        EXPECT_FALSE(hlcup::LikesParser::parse(bad.data(), bad.data() + bad.size(), likes)) << bad;
+    }
+}
+
+TEST(LikesTest, MergesBuffersUntilCompacted) {
+    using hlcup::LikeStore;
+
+    LikeStore likes;
+    likes.load(1, {{5, 100}, {3, 101}});
+    likes.load(2, {{5, 102}});
+    likes.build();
+
+    likes.add(1, 4, 200);
+    likes.add(9, 5, 201);
+    EXPECT_THAT(likesOf(likes, LikeStore::kForward, 1), ElementsAre("3@101", "5@100", "4@200"));
+    EXPECT_THAT(likesOf(likes, LikeStore::kReverse, 5), ElementsAre("1@100", "2@102", "9@201"));
+    EXPECT_THAT(likesOf(likes, LikeStore::kReverse, 100), ElementsAre());
+    {
+        LikeStore::View view(likes);
+        EXPECT_TRUE(view.contains(1, 4));
+        EXPECT_TRUE(view.contains(2, 5));
+        EXPECT_FALSE(view.contains(2, 4));
+        EXPECT_EQ(3u, view.count(LikeStore::kReverse, 5));
+    }
+
+    // Enough likes to freeze the buffers, with a reader running through the compaction
+    likes.start();
+    std::atomic<bool> done{false};
+    std::thread       reader([&] {
+        while (!done.load()) {
+            LikeStore::View view(likes);
+            ASSERT_TRUE(view.contains(1, 4));
+            ASSERT_GE(view.count(LikeStore::kReverse, 5), 3u);
+        }
+    });
+    for (hlcup::u32 i = 0; i < LikeStore::kCompactLikes; ++i) likes.add(10 + i % 1000, 5, 300 + i);
+    likes.maintain();
+    for (int i = 0; i < 5000 && likes.compactions() == 0; ++i) {
+        std::this_thread::sleep_for(LikeStore::kPoll);
+        likes.maintain();
+    }
+    likes.add(1, 2, 400);
+    done.store(true);
+    reader.join();
+
+    ASSERT_EQ(1u, likes.compactions());
+    EXPECT_THAT(likesOf(likes, LikeStore::kForward, 1), ElementsAre("3@101", "4@200", "5@100", "2@400"));
+    EXPECT_EQ(3u + LikeStore::kCompactLikes, LikeStore::View(likes).count(LikeStore::kReverse, 5));
+    EXPECT_THAT(likesOf(likes, LikeStore::kForward, 10), SizeIs(LikeStore::kCompactLikes / 1000 + 1));
+}
+
+TEST(LikesTest, WriterAppliesAndJournalsBatches) {
+    std::string path = testing::TempDir() + "hlcup_likes_journal_" + std::to_string(::getpid());
+
+    hlcup::AccountStore store;
+    hlcup::Account      acc;
+    for (hlcup::u32 id = 1; id <= 3; ++id) {
+        acc.id = id;
+        store.add(acc);
+    }
+
+    {
+        hlcup::LikeStore likes;
+        likes.build();
+        hlcup::Journal journal;
+        ASSERT_EQ(0, journal.open(path.c_str(), 1 << 16));
+        hlcup::StoreWriter writer(store, nullptr, &journal, &likes);
+        writer.start();
+
+        std::string batch = "{\"likes\":[{\"likee\":2,\"ts\":10,\"liker\":1},{\"likee\":3,\"ts\":11,\"liker\":1}]}";
+        std::string bad   = "{\"likes\":[{\"likee\":2,\"ts\":10,\"liker\":1},{\"likee\":4,\"ts\":11,\"liker\":1}]}";
+        EXPECT_EQ(hlcup::ResponseQueue::k202, writer.postLikes(batch.data(), static_cast<hlcup::u32>(batch.size())));
+        EXPECT_EQ(hlcup::ResponseQueue::k400, writer.postLikes(bad.data(), static_cast<hlcup::u32>(bad.size())));
+        writer.sync();
+        EXPECT_THAT(likesOf(likes, hlcup::LikeStore::kForward, 1), ElementsAre("2@10", "3@11"));
+        writer.stop();
+    }
+
+    hlcup::LikeStore likes;
+    likes.build();
+    hlcup::Journal journal;
+    ASSERT_EQ(0, journal.open(path.c_str()));
+    hlcup::StoreWriter writer(store, nullptr, nullptr, &likes);
+    EXPECT_EQ(1u, writer.replay(journal));
+    EXPECT_THAT(likesOf(likes, hlcup::LikeStore::kReverse, 3), ElementsAre("1@11"));
+    ::unlink(path.c_str());
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../testserver/pcap.hpp"
+
+using namespace testing;
+
+TEST(PcapTest, RoundTrip) {
+    PcapWriter out;
+    out.add("abc", 3, 1, 999999999);
+    out.add("", 0, 2, 5);
+    out.add("0123456789", 10, 3, 0);
+
+    PcapReader in;
+    ASSERT_EQ(0, in.assign(out.data()));
+
+    PcapPacket pkt;
+    ASSERT_TRUE(in.next(pkt));
+    EXPECT_EQ("abc", std::string(pkt.data, pkt.len));
+    EXPECT_EQ(1u, pkt.sec);
+    EXPECT_EQ(999999999u, pkt.nsec);
+    ASSERT_TRUE(in.next(pkt));
+    EXPECT_EQ(0u, pkt.len);
+    ASSERT_TRUE(in.next(pkt));
+    EXPECT_EQ("0123456789", std::string(pkt.data, pkt.len));
+    EXPECT_FALSE(in.next(pkt));
+
+    // Big endian microsecond file, as written on another host
+    std::string be("\xa1\xb2\xc3\xd4\x00\x02\x00\x04", 8);
+    be += std::string(8, '\0') + std::string("\x00\x00\xff\xff\x00\x00\x00\x01", 8);
+    be += std::string("\x00\x00\x00\x07\x00\x00\x00\x02\x00\x00\x00\x02\x00\x00\x00\x02xy", 18);
+    ASSERT_EQ(0, in.assign(be));
+    ASSERT_TRUE(in.next(pkt));
+    EXPECT_EQ("xy", std::string(pkt.data, pkt.len));
+    EXPECT_EQ(7u, pkt.sec);
+    EXPECT_EQ(2000u, pkt.nsec);
+
+    EXPECT_EQ(-EINVAL, in.assign(std::string(24, '\0')));
+    std::string truncated = out.data().substr(0, out.data().size() - 1);
+    ASSERT_EQ(0, in.assign(truncated));
+    ASSERT_TRUE(in.next(pkt));
+    ASSERT_TRUE(in.next(pkt));
+    EXPECT_FALSE(in.next(pkt));
+}
+
+TEST(PcapTest, SyntheticFlows) {
+    PcapWriter out;
+    synthetic_flows(out, 100, 16, 3, 80, 97);
+    EXPECT_EQ(100u * (3 + 4), out.count());
+
+    PcapReader in;
+    ASSERT_EQ(0, in.assign(out.data()));
+
+    PcapPacket pkt;
+    size_t     syns = 0, fins = 0, data = 0;
+    while (in.next(pkt)) {
+        std::string frame(pkt.data, pkt.len);
+        iphdr *     iph  = reinterpret_cast<iphdr *>(&frame[ETH_HLEN]);
+        tcphdr *    tcph = reinterpret_cast<tcphdr *>(&frame[ETH_HLEN + sizeof(iphdr)]);
+
+        EXPECT_EQ(htons(80), tcph->dest);
+        EXPECT_EQ(0, cksum_generic(reinterpret_cast<unsigned char *>(iph), sizeof(iphdr), 0));
+        uint16_t check = tcph->check;
+        tcph->check    = 0;
+        EXPECT_EQ(check, compute_tcp_checksum(iph, tcph));
+
+        syns += tcph->syn;
+        fins += tcph->fin;
+        data += pkt.len > ETH_HLEN + sizeof(iphdr) + sizeof(tcphdr);
+    }
+    EXPECT_EQ(100u, syns);
+    EXPECT_EQ(100u, fins);
+    EXPECT_EQ(300u, data);
+}
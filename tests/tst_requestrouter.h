@@ -0,0 +1,62 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../RequestRouter.hpp"
+
+using namespace testing;
+
+static hlcup::RequestRouter::Route route_of(const std::string &line) { return hlcup::RequestRouter::route(line.data(), line.data() + line.size()); }
+
+TEST(RequestRouterTest, GetRoutes) {
+    auto r = route_of("GET /accounts/filter/?sex_eq=f&limit=10&query_id=1 HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(hlcup::RequestRouter::kMatched, r.status);
+    EXPECT_EQ(hlcup::Request::kFilter, r.type);
+    EXPECT_EQ('s', *r.params);
+
+    r = route_of("GET /accounts/group/?keys=city&limit=10&query_id=1 HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(hlcup::Request::kGroup, r.type);
+    EXPECT_EQ('k', *r.params);
+
+    r = route_of("GET /accounts/1234/recommend/?limit=10&query_id=1 HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(hlcup::Request::kRecommend, r.type);
+    EXPECT_EQ(1234u, r.entity_id);
+    EXPECT_EQ('l', *r.params);
+
+    r = route_of("\r\nGET /accounts/77/suggest/?limit=10&query_id=1 HTTP/1.1\r\n\r\n");
+    EXPECT_EQ(hlcup::Request::kSuggest, r.type);
+    EXPECT_EQ(77u, r.entity_id);
+}
+
+TEST(RequestRouterTest, PostRoutes) {
+    auto r = route_of("POST /accounts/new/?query_id=12 HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}");
+    EXPECT_EQ(hlcup::Request::kAccountsNew, r.type);
+    EXPECT_EQ('q', *r.params);
+
+    r = route_of("POST /accounts/likes/?query_id=12 HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}");
+    EXPECT_EQ(hlcup::Request::kAccountsLikes, r.type);
+
+    r = route_of("POST /accounts/9/?query_id=12 HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}");
+    EXPECT_EQ(hlcup::Request::kAccountsUpdate, r.type);
+    EXPECT_EQ(9u, r.entity_id);
+}
+
+TEST(RequestRouterTest, UnknownAndShort) {
+    EXPECT_EQ(hlcup::RequestRouter::kUnknown, route_of("DELETE /accounts/filter/?query_id=1 HTTP/1.1\r\n\r\n").status);
+    EXPECT_EQ(hlcup::RequestRouter::kUnknown, route_of("GET /accounts/friends/?query_id=1 HTTP/1.1\r\n\r\n").status);
+    EXPECT_EQ(hlcup::RequestRouter::kUnknown, route_of("POST /accounts/filter/?query_id=1 HTTP/1.1\r\n\r\n").status);
+    EXPECT_EQ(hlcup::RequestRouter::kUnknown, route_of("GET /accounts/12/likes/?query_id=1 HTTP/1.1\r\n\r\n").status);
+    EXPECT_EQ(hlcup::RequestRouter::kShort, route_of("GET /accounts/filt").status);
+    EXPECT_EQ(hlcup::RequestRouter::kShort, route_of("POST /accounts/new/?query_id=1").status);
+
+    // Complete lines shorter than the compares load
+    EXPECT_EQ(hlcup::RequestRouter::kUnknown, route_of("GET / HTTP/1.1\r\n").status);
+    std::string line("POST /accounts/new/? HTTP/1.1\r\n");
+    auto        r = hlcup::RequestRouter::route(line.data(), line.data() + line.size());
+    EXPECT_EQ(hlcup::RequestRouter::kMatched, r.status);
+    EXPECT_EQ(hlcup::Request::kAccountsNew, r.type);
+    EXPECT_EQ(line.data() + 20, r.params);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+
+#include "../Response.hpp"
+
+using namespace testing;
+
+static std::string drain(hlcup::ResponseQueue &q, size_t chunk) {
+    std::string out;
+    iovec       iov[4];
+    while (!q.empty()) {
+        unsigned n    = q.fill(iov, 4);
+        size_t   sent = 0;
+        for (unsigned i = 0; i < n && sent < chunk; ++i) {
+            size_t len = std::min(chunk - sent, iov[i].iov_len);
+            out.append(reinterpret_cast<const char *>(iov[i].iov_base), len);
+            sent += len;
+        }
+        q.consume(sent);
+    }
+    return out;
+}
+
+TEST(ResponseQueueTest, StaticAnswers) {
+    hlcup::ResponseQueue q;
+    q.add(hlcup::ResponseQueue::k404);
+    q.add(hlcup::ResponseQueue::k202);
+
+    iovec iov[4];
+    ASSERT_EQ(2u, q.fill(iov, 4));
+    EXPECT_EQ(hlcup::details::kAnswer404.data, iov[0].iov_base);
+
+    EXPECT_EQ(std::string(hlcup::details::kAnswer404.data) + hlcup::details::kAnswer202.data, drain(q, 1000));
+    EXPECT_TRUE(q.empty());
+}
+
+TEST(ResponseQueueTest, ContentLengthAndPartialWrites) {
+    hlcup::ResponseQueue q;
+    for (int i = 0; i < 3; ++i) {
+        size_t start = q.bodyStart();
+        q.body().append("{\"accounts\":[]}", 15);
+        q.add200(start);
+    }
+    q.add(hlcup::ResponseQueue::k400);
+
+    std::string one = std::string(hlcup::details::kHeader200.data) + "15\r\n\r\n{\"accounts\":[]}";
+    EXPECT_EQ(one + one + one + hlcup::details::kAnswer400.data, drain(q, 7));
+}
+
+TEST(ResponseQueueTest, CopyRanges) {
+    hlcup::ResponseQueue q;
+    q.add(hlcup::ResponseQueue::k201);
+    size_t start = q.bodyStart();
+    q.body().append("{\"accounts\":[]}", 15);
+    q.add200(start);
+
+    std::string all = std::string(hlcup::details::kAnswer201.data) + hlcup::details::kHeader200.data + "15\r\n\r\n{\"accounts\":[]}";
+    ASSERT_EQ(all.size(), q.size());
+
+    // Every cut of the stream, as a sender splitting it into segments would take it
+    for (size_t off = 0; off < all.size(); off += 7) {
+        size_t      n = std::min<size_t>(23, all.size() - off);
+        std::string seg(n, '\0');
+        q.copy(off, &seg[0], n);
+        EXPECT_EQ(all.substr(off, n), seg) << off;
+    }
+
+    q.consume(10);
+    EXPECT_EQ(all.size() - 10, q.size());
+    std::string rest(q.size(), '\0');
+    q.copy(0, &rest[0], rest.size());
+    EXPECT_EQ(all.substr(10), rest);
+
+    q.consume(q.size());
+    EXPECT_TRUE(q.empty());
+    EXPECT_EQ(0u, q.size());
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "../StoreWriter.hpp"
+#include "../core/MpscQueue.hpp"
+#include "../core/SeqLock.hpp"
+
+using namespace testing;
+
+TEST(StoreWriterTest, QueueKeepsEachProducersOrder) {
+    static const hlcup::u32 kProducers = 4, kItems = 50000;
+
+    hlcup::MpscQueue<hlcup::u64> queue(1024);
+    std::vector<std::thread>     producers;
+    for (hlcup::u32 p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&queue, p] {
+            for (hlcup::u32 i = 0; i < kItems; ++i) {
+                hlcup::u64 v = hlcup::u64(p) << 32 | i;
+                while (!queue.push(std::move(v))) std::this_thread::yield();
+            }
+        });
+    }
+
+    std::vector<hlcup::u32> next(kProducers, 0);
+    hlcup::u64              v;
+    for (hlcup::u64 n = 0; n < hlcup::u64(kProducers) * kItems;) {
+        if (!queue.pop(v)) continue;
+        ASSERT_EQ(next[v >> 32]++, static_cast<hlcup::u32>(v)) << (v >> 32);
+        ++n;
+    }
+    EXPECT_FALSE(queue.pop(v));
+    for (auto &th : producers) th.join();
+}
+
+TEST(StoreWriterTest, SeqLockedReadsAreNeverTorn) {
+    struct Row {
+        hlcup::u64 words[8];
+    };
+
+    hlcup::SeqLocked<Row> row;
+    std::atomic<bool>     done{false};
+
+    std::thread writer([&] {
+        for (hlcup::u64 i = 1; i <= 300000; ++i) {
+            row.update([i](Row &r) {
+                for (auto &w : r.words) w = i;
+            });
+        }
+        done.store(true);
+    });
+
+    hlcup::u64 reads = 0, last = 0;
+    while (!done.load()) {
+        Row r = row.load();
+        for (auto w : r.words) ASSERT_EQ(r.words[0], w);
+        ASSERT_LE(last, r.words[0]);
+        last = r.words[0];
+        ++reads;
+    }
+    writer.join();
+    EXPECT_EQ(300000u, row.load().words[7]);
+    EXPECT_GT(reads, 0u);
+}
+
+TEST(StoreWriterTest, AppliesUpdatesWhileReadersRead) {
+    hlcup::AccountStore store;
+    hlcup::StoreWriter  writer(store);
+    writer.start();
+
+    static const hlcup::u32 kAccounts = 20000;
+    std::atomic<bool>       done{false};
+    std::thread             reader([&] {
+        hlcup::StoredAccount acc;
+        while (!done.load()) {
+            for (hlcup::u32 id = 1; id <= kAccounts; id += 97) {
+                if (!store.read(id, acc)) continue;
+                // Rows are published whole: the email always belongs to the row and birth was set with it
+                std::string_view email = store.fragment(acc.email);
+                ASSERT_EQ(",\"email\":\"" + std::to_string(id) + "@x.ru\"", email);
+                ASSERT_EQ(static_cast<hlcup::Timestamp>(id), acc.birth % 1000000);
+            }
+        }
+    });
+
+    for (hlcup::u32 round = 0; round < 2; ++round) {
+        for (hlcup::u32 id = 1; id <= kAccounts; ++id) {
+            std::unique_ptr<hlcup::AccountUpdate> u(new hlcup::AccountUpdate);
+            std::string                           email = std::to_string(id) + "@x.ru";
+            std::memcpy(u->acc.string_data, email.data(), email.size());
+
+            u->kind       = round == 0 ? hlcup::AccountUpdate::kNew : hlcup::AccountUpdate::kUpdate;
+            u->acc.id     = id;
+            u->acc.birth  = static_cast<hlcup::Timestamp>(round * 1000000 + id);
+            u->acc.email  = hlcup::StringRef{0, static_cast<hlcup::u32>(email.size())};
+            u->acc.sex    = hlcup::Account::kMale;
+            u->acc.status = hlcup::Account::kFree;
+            if (round == 1) u->acc.sex = hlcup::Account::kInvalidSex;  // absent from the patch, stays
+            writer.submit(std::move(u));
+        }
+    }
+
+    writer.sync();
+    done.store(true);
+    reader.join();
+    writer.stop();
+
+    EXPECT_EQ(2u * kAccounts, writer.applied());
+    hlcup::StoredAccount acc;
+    ASSERT_TRUE(store.read(kAccounts, acc));
+    EXPECT_EQ(hlcup::Timestamp(1000000 + kAccounts), acc.birth);
+    EXPECT_EQ(hlcup::Account::kMale, acc.sex);
+    EXPECT_FALSE(store.read(kAccounts + 1, acc));
+    EXPECT_EQ(",\"email\":\"1@x.ru\"", store.fragment(store.read(1, acc) ? acc.email : hlcup::StringRef{0, 0}));
+}
+
+TEST(StoreWriterTest, BoundsNewIds) {
+    hlcup::AccountStore store;
+    hlcup::Account      acc;
+    acc.id = 1000;
+    store.add(acc);
+
+    EXPECT_TRUE(store.acceptsNewId(1));
+    EXPECT_TRUE(store.acceptsNewId(1001 + hlcup::AccountStore::kIdHeadroom - 1));
+    EXPECT_FALSE(store.acceptsNewId(1001 + hlcup::AccountStore::kIdHeadroom));
+    EXPECT_FALSE(store.acceptsNewId(100000000));
+    EXPECT_FALSE(store.acceptsNewId(hlcup::Account::kInvalidId - 1));
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "../testserver/tcp_options.hpp"
+
+using namespace testing;
+
+static TcpOptions parse_options(const std::string &bytes, bool *ok = nullptr) {
+    TcpOptions opts;
+    bool       res = parse_tcp_options(reinterpret_cast<const uint8_t *>(bytes.data()), bytes.size(), opts);
+    if (ok != nullptr) *ok = res;
+    return opts;
+}
+
+TEST(TcpOptionsTest, ParseLinuxSyn) {
+    // mss 65495, sack-permitted, timestamps, nop, wscale 7
+    TcpOptions opts = parse_options(std::string("\x02\x04\xff\xd7\x04\x02\x08\x0a\x00\x00\x01\x00\x00\x00\x00\x02\x01\x03\x03\x07", 20));
+    EXPECT_EQ(65495, opts.mss);
+    EXPECT_TRUE(opts.sack_ok);
+    EXPECT_TRUE(opts.has_ts);
+    EXPECT_EQ(256u, opts.ts_val);
+    EXPECT_EQ(2u, opts.ts_ecr);
+    EXPECT_EQ(7, opts.wscale);
+
+    opts = parse_options(std::string("\x01\x01\x08\x0a\x12\x34\x56\x78\x9a\xbc\xde\xf0", 12));
+    EXPECT_TRUE(opts.has_ts);
+    EXPECT_EQ(0x12345678u, opts.ts_val);
+    EXPECT_EQ(0x9abcdef0u, opts.ts_ecr);
+    EXPECT_EQ(0, opts.mss);
+    EXPECT_EQ(TcpOptions::kNoWscale, opts.wscale);
+
+    // Shifts above 14 are clamped, unknown options skipped, parsing stops at end of list
+    opts = parse_options(std::string("\x03\x03\x1e\x1e\x04\xaa\xbb\x00\x02\x04\x05\xb4", 12));
+    EXPECT_EQ(14, opts.wscale);
+    EXPECT_EQ(0, opts.mss);
+}
+
+TEST(TcpOptionsTest, ParseMalformed) {
+    bool ok = true;
+    parse_options(std::string("\x02", 1), &ok);
+    EXPECT_FALSE(ok);
+    parse_options(std::string("\x02\x00\x05\xb4", 4), &ok);
+    EXPECT_FALSE(ok);
+
+    TcpOptions opts = parse_options(std::string("\x02\x04\x05\xb4\x08\x0a\x00\x00", 8), &ok);
+    EXPECT_FALSE(ok);
+    EXPECT_EQ(1460, opts.mss);
+    EXPECT_FALSE(opts.has_ts);
+}
+
+TEST(TcpOptionsTest, EmitRoundTrip) {
+    for (int mask = 0; mask < 16; ++mask) {
+        TcpOptions opts;
+        if (mask & 1) opts.mss = 1460;
+        if (mask & 2) opts.wscale = 7;
+        opts.sack_ok = (mask & 4) != 0;
+        if (mask & 8) {
+            opts.has_ts = true;
+            opts.ts_val = 0x01020304;
+            opts.ts_ecr = 0xa0b0c0d0;
+        }
+
+        uint8_t buf[40];
+        uint8_t len = emit_tcp_options(buf, opts);
+        ASSERT_EQ(0, len % 4) << mask;
+        ASSERT_LE(len, 20) << mask;
+
+        bool       ok;
+        TcpOptions parsed = parse_options(std::string(reinterpret_cast<char *>(buf), len), &ok);
+        EXPECT_TRUE(ok);
+        EXPECT_EQ(opts.mss, parsed.mss) << mask;
+        EXPECT_EQ(opts.wscale, parsed.wscale) << mask;
+        EXPECT_EQ(opts.sack_ok, parsed.sack_ok) << mask;
+        EXPECT_EQ(opts.has_ts, parsed.has_ts) << mask;
+        EXPECT_EQ(opts.ts_val, parsed.ts_val) << mask;
+        EXPECT_EQ(opts.ts_ecr, parsed.ts_ecr) << mask;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../testserver/timer_wheel.hpp"
+
+using namespace testing;
+
+TEST(TimerWheelTest, FiresOnTime) {
+    TimerWheel<uint32_t> wheel(1000);
+
+    // Deadlines on every level, both sides of the wheel boundaries, in the past and beyond the top wheel
+    std::vector<uint64_t> deadlines = {0, 1000, 1001, 1063, 1064, 1065, 1000 + 4095, 1000 + 4096, 1000 + 300000, 1000 + (1u << 24) + 5, 1000 + (3u << 24)};
+    std::mt19937_64       rnd(1);
+    for (int i = 0; i < 2000; ++i) deadlines.push_back(1000 + rnd() % (1u << 20));
+    for (uint32_t i = 0; i < deadlines.size(); ++i) wheel.schedule(deadlines[i], i);
+    EXPECT_EQ(deadlines.size(), wheel.size());
+
+    std::vector<std::pair<uint64_t, uint32_t>> fired;  // tick it fired on, item
+    for (uint64_t now = 1000; now < 1000 + (4u << 24); now += 997) {
+        wheel.advance(now + 997, [&](uint32_t item, uint64_t deadline) {
+            EXPECT_EQ(deadlines[item], deadline);
+            fired.emplace_back(wheel.now() - 1, item);
+        });
+    }
+
+    ASSERT_EQ(deadlines.size(), fired.size());
+    EXPECT_EQ(0u, wheel.size());
+    for (size_t i = 0; i < fired.size(); ++i) {
+        EXPECT_EQ(std::max<uint64_t>(deadlines[fired[i].second], 1000), fired[i].first) << fired[i].second;
+        if (i > 0) {
+            EXPECT_LE(fired[i - 1].first, fired[i].first);
+        }
+    }
+}
+
+TEST(TimerWheelTest, RearmFromCallback) {
+    TimerWheel<int> wheel;
+    wheel.schedule(10, 0);
+
+    // Each firing schedules the next one, the ones already due go off on the next tick of the same advance
+    std::vector<uint64_t> ticks;
+    wheel.advance(200, [&](int n, uint64_t deadline) {
+        ticks.push_back(wheel.now() - 1);
+        if (n < 4) wheel.schedule(deadline + (n % 2 == 0 ? 0 : 70), n + 1);
+    });
+    EXPECT_THAT(ticks, ElementsAre(10, 11, 80, 81, 150));
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <gmock/gmock-matchers.h>
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <string>
+
+#include "../testserver/trace.hpp"
+
+using namespace testing;
+
+TEST(TraceTest, RingWrapsAndDecodes) {
+    std::string path = "/tmp/tst_trace." + std::to_string(getpid());
+
+    {
+        TraceRing ring;
+        ASSERT_EQ(0, ring.open(path.c_str(), 16, 3));
+
+        struct {
+            ethhdr eth;
+            iphdr  iph;
+            tcphdr tcph;
+        } f{};
+        f.iph.saddr   = htonl(0x0a000002);
+        f.iph.daddr   = htonl(0x0a000001);
+        f.tcph.source = htons(40000);
+        f.tcph.dest   = htons(80);
+        f.tcph.doff   = 8;
+        f.tcph.ack    = 1;
+
+        for (uint32_t i = 0; i < 40; ++i) {
+            f.tcph.seq    = htonl(i);
+            f.iph.tot_len = htons(static_cast<uint16_t>(52 + i));
+            ring.record(i % 2 == 0 ? kTraceRx : kTraceTx, i, &f.eth, &f.iph, &f.tcph);
+        }
+        ring.calibrate();
+    }
+
+    TraceFile file;
+    ASSERT_EQ(0, file.load(path.c_str()));
+    unlink(path.c_str());
+
+    EXPECT_EQ(3u, file.hdr.core);
+    EXPECT_EQ(40u, file.hdr.head);
+    ASSERT_EQ(15u, file.events.size());  // one slot short of the capacity
+    for (size_t i = 0; i < file.events.size(); ++i) {
+        EXPECT_EQ(25 + i, ntohl(file.events[i].seq));
+        EXPECT_EQ(25 + i, file.events[i].status);
+        if (i > 0) {
+            EXPECT_LE(file.ns(file.events[i - 1].tsc), file.ns(file.events[i].tsc));
+        }
+    }
+
+    const TraceEvent &last = file.events.back();
+    EXPECT_EQ(kTraceTx, last.dir);
+    EXPECT_EQ(0x10, last.tcp_flags);
+    EXPECT_THAT(trace_format(last, 1000000001, 3), HasSubstr("core 3 tx 10.0.0.2:40000 > 10.0.0.1:80 [A] seq 39 ack 0 win 0 len 39"));
+
+    // Options are dropped from the rebuilt frame and its lengths, the payload is what is missing from the capture
+    uint8_t  frame[64];
+    uint32_t orig_len;
+    EXPECT_EQ(54u, trace_frame(last, frame, &orig_len));
+    EXPECT_EQ(54u + 39, orig_len);
+}
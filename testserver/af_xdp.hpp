@@ -0,0 +1,273 @@
+#pragma once
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <bpf.hpp>
+#include <mman.hpp>
+#include <socket.hpp>
+
+#include "../fmt/format.hpp"
+
+// AF_XDP socket for the raw-packet server. A small XDP program redirects IPv4/TCP segments for our port into the
+// socket, everything else goes on to the kernel stack. It attaches in generic (SKB) mode and binds with
+// XDP_COPY, so it works on veth pairs and loopback without driver support.
+//
+// The UMEM is split in two: the first half only ever cycles through the fill and rx rings, the second half
+// holds tx frames which keep their pre-filled headers between uses and come back through the completion ring.
+
+// One of the four shared rings, `local` is our cached producer (fill, tx) or consumer (rx, completion) index
+template <typename T>
+struct XskRing {
+    uint32_t *producer = nullptr;
+    uint32_t *consumer = nullptr;
+    T *       ring     = nullptr;
+    uint32_t  mask     = 0;
+    uint32_t  local    = 0;
+
+    T &at(uint32_t idx) { return ring[idx & mask]; }
+
+    // Consumer side
+    uint32_t available() const { return __atomic_load_n(producer, __ATOMIC_ACQUIRE) - local; }
+    void     release(uint32_t n) {
+        local += n;
+        __atomic_store_n(consumer, local, __ATOMIC_RELEASE);
+    }
+
+    // Producer side
+    uint32_t space() const { return mask + 1 - (local - __atomic_load_n(consumer, __ATOMIC_ACQUIRE)); }
+    void     submit(uint32_t n) {
+        local += n;
+        __atomic_store_n(producer, local, __ATOMIC_RELEASE);
+    }
+};
+
+struct XskSocket {
+    static const uint32_t kChunkSize = 2048;
+    static const uint32_t kChunks    = 4096;
+    static const uint32_t kRxChunks  = kChunks / 2;
+    static const uint32_t kRingSize  = 2048;
+
+    int   fd      = -1;
+    int   map_fd  = -1;
+    int   prog_fd = -1;
+    int   link_fd = -1;
+    char *umem    = nullptr;
+
+    XskRing<uint64_t> fill;
+    XskRing<uint64_t> comp;
+    XskRing<xdp_desc> rx;
+    XskRing<xdp_desc> tx;
+
+    std::vector<uint64_t> tx_free;  // chunk addresses of the tx half not queued to the kernel
+    uint32_t              tx_pending = 0;
+
+    ~XskSocket() {
+        if (link_fd >= 0) ef::platform::close(link_fd);
+        if (prog_fd >= 0) ef::platform::close(prog_fd);
+        if (map_fd >= 0) ef::platform::close(map_fd);
+        if (fd >= 0) ef::platform::close(fd);
+        if (umem != nullptr) ef::platform::munmap(umem, size_t(kChunks) * kChunkSize);
+    }
+
+    int open(const char *if_name, uint32_t queue, uint16_t port) {
+        int ifindex = static_cast<int>(if_nametoindex(if_name));
+        if (ifindex == 0) return -ENODEV;
+
+        void *mem = ef::platform::mmap(nullptr, size_t(kChunks) * kChunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (ef::platform::is_mmap_error(mem)) return report("mmap(umem)", static_cast<int>(reinterpret_cast<long>(mem)));
+        umem = static_cast<char *>(mem);
+
+        fd = ef::platform::socket(AF_XDP, SOCK_RAW, 0);
+        if (fd < 0) return report("socket(AF_XDP)", fd);
+
+        xdp_umem_reg reg{};
+        reg.addr       = reinterpret_cast<uint64_t>(umem);
+        reg.len        = uint64_t(kChunks) * kChunkSize;
+        reg.chunk_size = kChunkSize;
+
+        int err = ef::platform::setsockopt(fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg));
+        if (err < 0) return report("setsockopt(XDP_UMEM_REG)", err);
+
+        for (int ring : {XDP_UMEM_FILL_RING, XDP_UMEM_COMPLETION_RING, XDP_RX_RING, XDP_TX_RING}) {
+            err = ef::platform::setsockopt(fd, SOL_XDP, ring, static_cast<int>(kRingSize));
+            if (err < 0) return report("setsockopt(ring size)", err);
+        }
+
+        xdp_mmap_offsets off{};
+        socklen_t        optlen = sizeof(off);
+        err                     = ef::platform::getsockopt(fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen);
+        if (err < 0) return report("getsockopt(XDP_MMAP_OFFSETS)", err);
+
+        if ((err = mapRing(fill, off.fr, XDP_UMEM_PGOFF_FILL_RING)) < 0) return err;
+        if ((err = mapRing(comp, off.cr, XDP_UMEM_PGOFF_COMPLETION_RING)) < 0) return err;
+        if ((err = mapRing(rx, off.rx, XDP_PGOFF_RX_RING)) < 0) return err;
+        if ((err = mapRing(tx, off.tx, XDP_PGOFF_TX_RING)) < 0) return err;
+
+        for (uint32_t i = 0; i < kRxChunks; ++i) fill.at(fill.local + i) = uint64_t(i) * kChunkSize;
+        fill.submit(kRxChunks);
+        for (uint32_t i = kChunks; i > kRxChunks; --i) tx_free.push_back(uint64_t(i - 1) * kChunkSize);
+
+        sockaddr_xdp addr{};
+        addr.sxdp_family   = AF_XDP;
+        addr.sxdp_flags    = XDP_COPY;
+        addr.sxdp_ifindex  = static_cast<uint32_t>(ifindex);
+        addr.sxdp_queue_id = queue;
+        err                = ef::platform::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+        if (err < 0) return report("bind(AF_XDP)", err);
+
+        return attachProgram(ifindex, queue, port);
+    }
+
+    char *chunk(uint64_t addr) const { return umem + addr; }
+
+    // Tx chunk to build a frame in, nullptr while every tx chunk is queued
+    char *txChunk() {
+        if (tx_free.empty()) reclaim();
+        return tx_free.empty() ? nullptr : chunk(tx_free.back());
+    }
+
+    // Queues `len` bytes at `offset` into the chunk last returned by txChunk()
+    void txPush(uint32_t offset, uint32_t len) {
+        if (tx.space() == 0) kick();
+
+        xdp_desc &desc = tx.at(tx.local);
+        desc.addr      = tx_free.back() + offset;
+        desc.len       = len;
+        desc.options   = 0;
+        tx_free.pop_back();
+        tx.submit(1);
+        ++tx_pending;
+    }
+
+    // Copy mode transmits from the send path only, so every burst needs one sendto()
+    int kick() {
+        if (tx_pending == 0) return 0;
+        tx_pending = 0;
+        int err    = static_cast<int>(ef::platform::sendto(fd, nullptr, 0, MSG_DONTWAIT, nullptr, 0));
+        reclaim();
+        return err == -EAGAIN || err == -EBUSY ? 0 : err;
+    }
+
+    // Returns processed rx chunks to the fill ring
+    void refill(uint32_t n) {
+        for (uint32_t i = 0; i < n; ++i) fill.at(fill.local + i) = rx.at(rx.local + i).addr & ~uint64_t(kChunkSize - 1);
+        fill.submit(n);
+        rx.release(n);
+    }
+
+private:
+    void reclaim() {
+        uint32_t n = comp.available();
+        for (uint32_t i = 0; i < n; ++i) tx_free.push_back(comp.at(comp.local + i) & ~uint64_t(kChunkSize - 1));
+        comp.release(n);
+    }
+
+    template <typename T>
+    int mapRing(XskRing<T> &ring, const xdp_ring_offset &off, uint64_t pgoff) {
+        size_t size = off.desc + kRingSize * sizeof(T);
+        void * ptr  = ef::platform::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, static_cast<off_t>(pgoff));
+        if (ef::platform::is_mmap_error(ptr)) return report("mmap(xsk ring)", static_cast<int>(reinterpret_cast<long>(ptr)));
+
+        char *base    = static_cast<char *>(ptr);
+        ring.producer = reinterpret_cast<uint32_t *>(base + off.producer);
+        ring.consumer = reinterpret_cast<uint32_t *>(base + off.consumer);
+        ring.ring     = reinterpret_cast<T *>(base + off.desc);
+        ring.mask     = kRingSize - 1;
+        ring.local    = 0;
+        return 0;
+    }
+
+    // XSKMAP with our socket at `queue` and a program redirecting IPv4 TCP segments to `port` into it
+    int attachProgram(int ifindex, uint32_t queue, uint16_t port) {
+        bpf_attr attr{};
+        attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+        attr.key_size    = sizeof(uint32_t);
+        attr.value_size  = sizeof(int);
+        attr.max_entries = 64;
+        map_fd           = ef::platform::bpf(BPF_MAP_CREATE, &attr);
+        if (map_fd < 0) return report("bpf(BPF_MAP_CREATE)", map_fd);
+
+        // Offsets below assume a 20-byte IP header, packets with options go to the kernel
+        const int kPass = 20;
+        bpf_insn  prog[] = {
+            mem(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(xdp_md, data)),
+            mem(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, offsetof(xdp_md, data_end)),
+            mem(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0),
+            imm(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, ETH_HLEN + 20 + 20),
+            jmp(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 4, kPass),
+            mem(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, 12),
+            jmp(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 6, kPass, htons(ETH_P_IP)),
+            mem(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HLEN + 9),
+            jmp(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 8, kPass, IPPROTO_TCP),
+            mem(BPF_LDX | BPF_MEM | BPF_B, BPF_REG_5, BPF_REG_2, ETH_HLEN),
+            imm(BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_5, 0x0f),
+            jmp(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 11, kPass, 5),
+            mem(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_5, BPF_REG_2, ETH_HLEN + 20 + 2),
+            jmp(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_5, 0, 13, kPass, htons(port)),
+            mem(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(xdp_md, rx_queue_index)),
+            bpf_insn{BPF_LD | BPF_IMM | BPF_DW, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, map_fd},
+            bpf_insn{0, 0, 0, 0, 0},
+            imm(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, XDP_PASS),  // action when the map slot is empty
+            bpf_insn{BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map},
+            bpf_insn{BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+            imm(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, XDP_PASS),  // kPass
+            bpf_insn{BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+        };
+
+        static char log[1 << 14];
+        attr           = bpf_attr{};
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.insns     = reinterpret_cast<uint64_t>(prog);
+        attr.insn_cnt  = sizeof(prog) / sizeof(prog[0]);
+        attr.license   = reinterpret_cast<uint64_t>("GPL");
+        attr.log_buf   = reinterpret_cast<uint64_t>(log);
+        attr.log_size  = sizeof(log);
+        attr.log_level = 1;
+        prog_fd        = ef::platform::bpf(BPF_PROG_LOAD, &attr);
+        if (prog_fd < 0) {
+            fmt::print(stderr, "verifier log:\n{}\n", log);
+            return report("bpf(BPF_PROG_LOAD)", prog_fd);
+        }
+
+        attr        = bpf_attr{};
+        attr.map_fd = static_cast<uint32_t>(map_fd);
+        attr.key    = reinterpret_cast<uint64_t>(&queue);
+        attr.value  = reinterpret_cast<uint64_t>(&fd);
+        int err     = ef::platform::bpf(BPF_MAP_UPDATE_ELEM, &attr);
+        if (err < 0) return report("bpf(BPF_MAP_UPDATE_ELEM)", err);
+
+        // A link detaches on its own when the process exits
+        attr                            = bpf_attr{};
+        attr.link_create.prog_fd        = static_cast<uint32_t>(prog_fd);
+        attr.link_create.target_ifindex = static_cast<uint32_t>(ifindex);
+        attr.link_create.attach_type    = BPF_XDP;
+        attr.link_create.flags          = XDP_FLAGS_SKB_MODE;
+        link_fd                         = ef::platform::bpf(BPF_LINK_CREATE, &attr);
+        if (link_fd < 0) return report("bpf(BPF_LINK_CREATE)", link_fd);
+
+        return 0;
+    }
+
+    static bpf_insn mem(uint8_t code, uint8_t dst, uint8_t src, int16_t off) { return bpf_insn{code, dst, src, off, 0}; }
+    static bpf_insn imm(uint8_t code, uint8_t dst, int32_t val) { return bpf_insn{code, dst, 0, 0, val}; }
+
+    // Jump from instruction `pc` to `target`
+    static bpf_insn jmp(uint8_t code, uint8_t dst, uint8_t src, int pc, int target, int32_t val = 0) {
+        return bpf_insn{code, dst, src, static_cast<int16_t>(target - pc - 1), val};
+    }
+
+    static int report(const char *what, int err) {
+        fmt::print(stderr, "xsk: {} failed: {}\n", what, err);
+        return err;
+    }
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <emmintrin.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Internet checksums for the reply path.
+//
+// Sums are kept in memory order: 16-bit words are read as they lie in the packet, not byte swapped, and the
+// result is stored back the same way (RFC 1071 byte order independence). That lets the bulk routine add 32-bit
+// little-endian lanes into 64-bit accumulators and fold at the end.
+
+// Byte-pair reference implementations, result in host order
+static inline uint16_t cksum_generic(unsigned char *p, size_t len, uint16_t initial) {
+    uint32_t        sum = htons(initial);
+    const uint16_t *u16 = reinterpret_cast<const uint16_t *>(p);
+
+    while (len >= (sizeof(*u16) * 4)) {
+        sum += u16[0];
+        sum += u16[1];
+        sum += u16[2];
+        sum += u16[3];
+        len -= sizeof(*u16) * 4;
+        u16 += 4;
+    }
+    while (len >= sizeof(*u16)) {
+        sum += *u16;
+        len -= sizeof(*u16);
+        u16 += 1;
+    }
+
+    /* if length is in odd bytes */
+    if (len == 1) sum += *reinterpret_cast<const uint8_t *>(u16);
+
+    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    return ntohs(static_cast<uint16_t>(~sum));
+}
+
+// Result in memory order, ready to be stored in tcph->check
+static inline unsigned short compute_tcp_checksum(void *iph, void *tcph) {
+    struct iphdr * pIph    = reinterpret_cast<iphdr *>(iph);
+    struct tcphdr *tcphdrp = reinterpret_cast<tcphdr *>(tcph);
+
+    unsigned long   sum       = 0;
+    unsigned short  tcpLen    = ntohs(pIph->tot_len) - uint16_t(pIph->ihl * 4);
+    unsigned short *ipPayload = reinterpret_cast<uint16_t *>(tcphdrp);
+    // add the pseudo header
+    // the source ip
+    sum += (pIph->saddr >> 16) & 0xFFFF;
+    sum += (pIph->saddr) & 0xFFFF;
+    // the dest ip
+    sum += (pIph->daddr >> 16) & 0xFFFF;
+    sum += (pIph->daddr) & 0xFFFF;
+    // protocol and reserved: 6
+    sum += htons(6);
+    // the length
+    sum += htons(tcpLen);
+
+    // add the IP payload
+    // initialize checksum to 0
+    //    tcphdrp->check = 0;
+    while (tcpLen > 1) {
+        sum += *ipPayload++;
+        tcpLen -= 2;
+    }
+    // if any bytes left, pad the bytes and add
+    if (tcpLen > 0) {
+        // printf("+++++++++++padding, %dn", tcpLen);
+        sum += ((*ipPayload) & htons(0xFF00));
+    }
+    // Fold 32-bit sum to 16 bits: add carrier to result
+    while (sum >> 16) { sum = (sum & 0xffff) + (sum >> 16); }
+    sum = ~sum;
+    // set computation result
+    return static_cast<uint16_t>(sum);
+}
+
+static inline uint16_t csum_load16(const void *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t csum_load32(const void *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint16_t csum_fold(uint64_t sum) {
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return static_cast<uint16_t>(sum);
+}
+
+// Adds `len` bytes to an unfolded sum below 2^56. `data` must sit at an even offset of the checksummed region.
+// 32-bit lanes are widened into 64-bit accumulators, which cannot overflow for anything packet sized.
+static inline uint64_t csum_accumulate(const void *data, size_t len, uint64_t sum) {
+    const uint8_t *p    = static_cast<const uint8_t *>(data);
+    const __m128i  zero = _mm_setzero_si128();
+    __m128i        acc0 = zero;
+    __m128i        acc1 = zero;
+
+    while (len >= 32) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+        acc0      = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+        acc1      = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+        acc0      = _mm_add_epi64(acc0, _mm_unpacklo_epi32(b, zero));
+        acc1      = _mm_add_epi64(acc1, _mm_unpackhi_epi32(b, zero));
+        p += 32;
+        len -= 32;
+    }
+    if (len >= 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        acc0      = _mm_add_epi64(acc0, _mm_unpacklo_epi32(a, zero));
+        acc1      = _mm_add_epi64(acc1, _mm_unpackhi_epi32(a, zero));
+        p += 16;
+        len -= 16;
+    }
+
+    acc0         = _mm_add_epi64(acc0, acc1);
+    uint64_t vec = static_cast<uint64_t>(_mm_cvtsi128_si64(acc0)) + static_cast<uint64_t>(_mm_cvtsi128_si64(_mm_unpackhi_epi64(acc0, acc0)));
+
+    sum += vec;
+
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, sizeof(v));
+        sum += (v & 0xffffffff) + (v >> 32);
+        p += 8;
+        len -= 8;
+    }
+    if (len > 0) {
+        uint64_t v = 0;
+        memcpy(&v, p, len);
+        sum += (v & 0xffffffff) + (v >> 32);
+    }
+    return sum;
+}
+
+// RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m'), all values in memory order
+static inline uint16_t csum_replace2(uint16_t check, uint16_t old_val, uint16_t new_val) {
+    uint32_t sum = uint32_t(uint16_t(~check)) + uint16_t(~old_val) + new_val;
+    return static_cast<uint16_t>(~csum_fold(sum));
+}
+
+static inline uint16_t csum_replace4(uint16_t check, uint32_t old_val, uint32_t new_val) {
+    uint64_t sum = uint64_t(uint16_t(~check)) + uint32_t(~old_val) + new_val;
+    return static_cast<uint16_t>(~csum_fold(sum));
+}
+
+// Checksums of replies built on the tx template: the ip checksum is patched from the template's for the fields
+// that change per reply, the tcp sum starts from the constant header words and adds the rest, options and payload
+// included. Everything else in the headers must match the template.
+struct ChecksumTemplate {
+    // `ip` and `tcp` point at 20-byte headers, any alignment
+    void init(const void *ip, const void *tcp) {
+        memcpy(&ip_, ip, sizeof(ip_));
+        ip_.check = 0;
+        ip_check_ = static_cast<uint16_t>(~csum_fold(csum_accumulate(&ip_, sizeof(ip_), 0)));
+
+        const uint8_t *t = static_cast<const uint8_t *>(tcp);
+        tcp_base_        = uint64_t(csum_load16(t + offsetof(tcphdr, source))) + csum_load16(t + offsetof(tcphdr, urg_ptr)) + htons(IPPROTO_TCP);
+    }
+
+    uint16_t ipCheck(const void *ip) const {
+        const uint8_t *p     = static_cast<const uint8_t *>(ip);
+        uint16_t       check = ip_check_;
+        check                = csum_replace2(check, ip_.tot_len, csum_load16(p + offsetof(iphdr, tot_len)));
+        check                = csum_replace2(check, ip_.id, csum_load16(p + offsetof(iphdr, id)));
+        check                = csum_replace4(check, ip_.saddr, csum_load32(p + offsetof(iphdr, saddr)));
+        check                = csum_replace4(check, ip_.daddr, csum_load32(p + offsetof(iphdr, daddr)));
+        return check;
+    }
+
+    // `tcp_len` covers the header, options and payload that follow it contiguously
+    uint16_t tcpCheck(const void *ip, const void *tcp, size_t tcp_len) const {
+        const uint8_t *p = static_cast<const uint8_t *>(ip);
+        const uint8_t *t = static_cast<const uint8_t *>(tcp);
+
+        uint64_t sum = tcp_base_;
+        sum += uint64_t(csum_load32(p + offsetof(iphdr, saddr))) + csum_load32(p + offsetof(iphdr, daddr)) + htons(static_cast<uint16_t>(tcp_len));
+        sum += uint64_t(csum_load16(t + offsetof(tcphdr, dest))) + csum_load32(t + offsetof(tcphdr, seq)) + csum_load32(t + offsetof(tcphdr, ack_seq));
+        sum += uint64_t(csum_load16(t + 12)) + csum_load16(t + offsetof(tcphdr, window));  // doff and flags, window
+        sum = csum_accumulate(t + sizeof(tcphdr), tcp_len - sizeof(tcphdr), sum);
+        return static_cast<uint16_t>(~csum_fold(sum));
+    }
+
+    // What tcph->check holds when the NIC or the kernel finishes the sum (CHECKSUM_PARTIAL, GSO): the folded pseudo
+    // header, not inverted, for the whole `tcp_len` even if it is cut into segments later
+    uint16_t tcpPseudo(const void *ip, size_t tcp_len) const {
+        const uint8_t *p   = static_cast<const uint8_t *>(ip);
+        uint64_t       sum = uint64_t(csum_load32(p + offsetof(iphdr, saddr))) + csum_load32(p + offsetof(iphdr, daddr));
+        sum += htons(IPPROTO_TCP) + htons(static_cast<uint16_t>(tcp_len));
+        return csum_fold(sum);
+    }
+
+private:
+    iphdr    ip_{};
+    uint16_t ip_check_ = 0;
+    uint64_t tcp_base_ = 0;
+};
@@ -25,9 +25,13 @@
 
 #include <net/if.h>
 
+#include <algorithm>
 #include <atomic>
 #include <bitset>
+#include <memory>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <io.hpp>
 #include <socket.hpp>
@@ -38,14 +42,30 @@
 
 #include "../fmt/format.hpp"
 
+#include "../Connection.hpp"
+#include "../RequestHandler.hpp"
+
+#include "af_xdp.hpp"
+#include "checksum.hpp"
+#include "pcap.hpp"
+#include "tcp_options.hpp"
+#include "tcp_table.hpp"
+#include "timer_wheel.hpp"
+#include "trace.hpp"
 #include "utils.hpp"
 
 #define BUSY_WAIT 1
-#define USE_TX_RING 0
+#define USE_TX_RING 1
 #define USE_SEND_THREAD 0
 #define USE_CUSTOM_HANDSHAKE 1
-#define USE_TCP_OPTIONS 0
+#define USE_TCP_OPTIONS 1  // mss, window scale, sack-permitted and timestamps
 #define USE_VNET_HDR 0
+#define USE_TCP_TABLE 1  // stateful connections, needs USE_CUSTOM_HANDSHAKE
+#define USE_TPACKET_V3 0  // block rx ring, trades up to kRetireBlockMs of latency for batching
+#define USE_AF_XDP 0      // xsk rx/tx rings instead of the packet sockets
+#define USE_FANOUT 0      // a PACKET_FANOUT group of rx sockets, one worker thread with its own rings per core
+#define USE_TRACE 1       // per-core binary packet trace in /dev/shm, decoded by --trace
+#define USE_HTTP 1        // requests go through HttpParser and RequestHandler, needs USE_TCP_TABLE
 
 const unsigned int kSendFlags = MSG_DONTWAIT;
 
@@ -61,31 +81,6 @@ static const uint16_t kPort = 80;
 
 using namespace ef;
 
-uint16_t cksum_generic(unsigned char *p, size_t len, uint16_t initial) {
-    uint32_t        sum = htons(initial);
-    const uint16_t *u16 = reinterpret_cast<const uint16_t *>(p);
-
-    while (len >= (sizeof(*u16) * 4)) {
-        sum += u16[0];
-        sum += u16[1];
-        sum += u16[2];
-        sum += u16[3];
-        len -= sizeof(*u16) * 4;
-        u16 += 4;
-    }
-    while (len >= sizeof(*u16)) {
-        sum += *u16;
-        len -= sizeof(*u16);
-        u16 += 1;
-    }
-
-    /* if length is in odd bytes */
-    if (len == 1) sum += *reinterpret_cast<const uint8_t *>(u16);
-
-    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
-    return ntohs(static_cast<uint16_t>(~sum));
-}
-
 #if 0
 uint32_t pseudo_header_initial(const int8_t *buf, size_t len) {
     const uint16_t *hwbuf      = (const uint16_t *)buf;
@@ -167,44 +162,6 @@ void dump_tcph(tcphdr *hdr) {
         hdr->urg, hdr->res2, ntohs(hdr->window), ntohs(hdr->check), ntohs(hdr->urg_ptr));
 }
 
-unsigned short compute_tcp_checksum(void *iph, void *tcph) {
-    struct iphdr * pIph    = reinterpret_cast<iphdr *>(iph);
-    struct tcphdr *tcphdrp = reinterpret_cast<tcphdr *>(tcph);
-
-    unsigned long   sum       = 0;
-    unsigned short  tcpLen    = ntohs(pIph->tot_len) - uint16_t(pIph->ihl * 4);
-    unsigned short *ipPayload = reinterpret_cast<uint16_t *>(tcphdrp);
-    // add the pseudo header
-    // the source ip
-    sum += (pIph->saddr >> 16) & 0xFFFF;
-    sum += (pIph->saddr) & 0xFFFF;
-    // the dest ip
-    sum += (pIph->daddr >> 16) & 0xFFFF;
-    sum += (pIph->daddr) & 0xFFFF;
-    // protocol and reserved: 6
-    sum += htons(6);
-    // the length
-    sum += htons(tcpLen);
-
-    // add the IP payload
-    // initialize checksum to 0
-    //    tcphdrp->check = 0;
-    while (tcpLen > 1) {
-        sum += *ipPayload++;
-        tcpLen -= 2;
-    }
-    // if any bytes left, pad the bytes and add
-    if (tcpLen > 0) {
-        // printf("+++++++++++padding, %dn", tcpLen);
-        sum += ((*ipPayload) & htons(0xFF00));
-    }
-    // Fold 32-bit sum to 16 bits: add carrier to result
-    while (sum >> 16) { sum = (sum & 0xffff) + (sum >> 16); }
-    sum = ~sum;
-    // set computation result
-    return static_cast<uint16_t>(sum);
-}
-
 // static int build_vnet_header(void *header) {
 //    struct virtio_net_hdr *vh = reinterpret_cast<virtio_net_hdr *>(header);
 
@@ -234,14 +191,10 @@ unsigned short compute_tcp_checksum(void *iph, void *tcph) {
 //    return sizeof(*vh);
 //}
 
-static int CNTR = 10;
-
 static sockaddr_ll g_host_addr{};
 
 // static int g_csocks[0xffff] = {0};
 // static std::bitset<0xffff> g_fins(0);
-[[maybe_unused]] static int g_sockets[0xffff]         = {0};
-static uint32_t             g_port_timestamps[0xffff] = {0};
 
 [[maybe_unused]] static int get_iface_addr(const char *if_name, int sock, sockaddr_ll &addr) {
     int   err;
@@ -325,7 +278,7 @@ struct RingBuffer {
     PacketReq req;
     size_t    frame_idx = 0;
 
-    RingBuffer(uint16_t mtu = 1 << 12, unsigned blocks_count = 64) : req(mtu, blocks_count) {}
+    RingBuffer(unsigned frame_size = 1 << 12, unsigned blocks_count = 64) : req(frame_size, blocks_count) {}
 
     size_t size() const { return req.tp_block_nr * req.tp_block_size; }
 
@@ -344,6 +297,30 @@ struct RingBuffer {
     }
 };
 
+// TPACKET_V3 rx ring. The kernel packs variable-size frames into a block and hands the whole block over when it
+// is full or kRetireBlockMs after its first frame, so one status check and one release cover a burst.
+struct BlockRing {
+    static const unsigned kRetireBlockMs = 1;
+
+    char *       data = nullptr;
+    tpacket_req3 req{};
+    unsigned     block_idx = 0;
+
+    BlockRing(unsigned block_size = 1 << 18, unsigned blocks_count = 16, unsigned frame_size = 1 << 11) {
+        req.tp_block_size     = block_size;
+        req.tp_block_nr       = blocks_count;
+        req.tp_frame_size     = frame_size;  // only checked for sanity, frames are packed back to back
+        req.tp_frame_nr       = block_size / frame_size * blocks_count;
+        req.tp_retire_blk_tov = kRetireBlockMs;
+    }
+
+    size_t size() const { return size_t(req.tp_block_nr) * req.tp_block_size; }
+
+    tpacket_block_desc *currentBlock() const { return reinterpret_cast<tpacket_block_desc *>(data + size_t(block_idx) * req.tp_block_size); }
+
+    void nextBlock() { block_idx = (block_idx + 1) % req.tp_block_nr; }
+};
+
 struct FrameHdr {
     //    intmax_t tp : TPACKET_HDRLEN * 8 - sizeof(struct sockaddr_ll) * 8;
     //    struct {
@@ -378,11 +355,51 @@ struct FrameHdr {
     //#endif
 } __attribute__((packed));
 
-static RingBuffer rx_ring;
+// Rings, the tx batch and the connection table are thread_local: with USE_FANOUT every worker owns a set and the
+// fanout hash keeps each flow on one worker, so the per packet path shares nothing between cores
+#if USE_TPACKET_V3
+static thread_local BlockRing rx_block_ring;
+#else
+static thread_local RingBuffer rx_ring;
+#endif
+#if USE_AF_XDP
+#if USE_VNET_HDR
+#error "AF_XDP has no checksum offload, turn USE_VNET_HDR off"
+#endif
+#if USE_FANOUT
+#error "the xsk socket is bound to queue 0 only, turn USE_FANOUT off"
+#endif
+static XskSocket g_xsk;
+#endif
+
+#if USE_VNET_HDR
+static const unsigned kTxFrameSize = 1 << 16;  // a whole TSO superframe, see kGsoMaxPayload
+#else
+static const unsigned kTxFrameSize = 1 << 12;
+#endif
+
 #if !USE_TX_RING
-static RingBuffer tx_ring(1 << 12, 1);
+static thread_local RingBuffer tx_ring(kTxFrameSize, 1);
 #else
-static RingBuffer tx_ring;
+static thread_local RingBuffer tx_ring(kTxFrameSize);
+#endif
+
+#if USE_TRACE
+static const uint32_t kTraceEvents = 1 << 16;  // per core, 4 MiB
+static thread_local TraceRing g_trace;
+
+static void open_trace(uint32_t core) {
+    std::string path = fmt::format("/dev/shm/testserver-trace.{}", core);
+    int         err  = g_trace.open(path.c_str(), kTraceEvents, core);
+    fmt::print(stderr, "trace open({}): {}\n", path, err);
+}
+#endif
+
+#if USE_FANOUT
+static const unsigned kFanoutWorkers = 4;  // capped at the number of cores
+// PACKET_FANOUT_HASH spreads by the flow hash. PACKET_FANOUT_CPU follows the core the packet arrived on and keeps
+// flows together only when the NIC's RSS already does
+static const int kFanoutMode = PACKET_FANOUT_HASH;
 #endif
 
 #include <pthread.h>
@@ -439,92 +456,669 @@ static inline __virtio16 __cpu_to_virtio16(bool little_endian, u16 val) {
         return htons(val);
 }
 
-static void debug_send(virtio_net_hdr vnet_hdr, size_t len) {
-    size_t vnet_hdr_len = sizeof(vnet_hdr);
+#if USE_TX_RING || USE_AF_XDP
+// Replies are queued in the tx ring (TP_STATUS_SEND_REQUEST frames or xsk descriptors) and go out with one
+// send(NULL) when the rx side runs dry, or earlier once kTxFlushBatch of them are waiting
+static const uint32_t kTxFlushBatch = 32;
+static const uint64_t kTxReportEvery = 1 << 16;  // packets
 
-    //			int err = -EINVAL;
-    if (len < vnet_hdr_len) {
-        fmt::print("1\n");
-        return;
-    }
-    len -= vnet_hdr_len;
+static thread_local uint32_t g_tx_pending  = 0;
+static thread_local uint64_t g_tx_packets  = 0;
+static thread_local uint64_t g_tx_syscalls = 0;
+#endif
 
-    if ((vnet_hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)
-        && (__virtio16_to_cpu(false, vnet_hdr.csum_start) + __virtio16_to_cpu(false, vnet_hdr.csum_offset) + 2 > __virtio16_to_cpu(false, vnet_hdr.hdr_len)))
-        vnet_hdr.hdr_len = __cpu_to_virtio16(false, __virtio16_to_cpu(false, vnet_hdr.csum_start) + __virtio16_to_cpu(false, vnet_hdr.csum_offset) + 2);
+#if USE_TX_RING && !USE_AF_XDP
+// Set by the offline replay: queued tx frames are appended here, stamped with the time of the rx frame being
+// handled, instead of being handed to the kernel
+struct TxCapture {
+    PcapWriter out;
+    uint32_t   sec  = 0;
+    uint32_t   nsec = 0;
+};
 
-    //    if ((vnet_hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) && (vnet_hdr.csum_start + vnet_hdr.csum_offset + 2 > vnet_hdr.hdr_len))
-    //        vnet_hdr.hdr_len = vnet_hdr.csum_start + vnet_hdr.csum_offset + 2;
+static thread_local TxCapture *g_tx_capture = nullptr;
 
-    if (__virtio16_to_cpu(false, vnet_hdr.hdr_len) > len) {
-        fmt::print(stderr, "__virtio16_to_cpu(false, {}) = {} > {}\n", vnet_hdr.hdr_len, __virtio16_to_cpu(false, vnet_hdr.hdr_len), len);
-        fmt::print("2\n");
-        return;
+static void capture_tx() {
+    size_t nr = tx_ring.req.tp_frame_nr;
+    for (size_t i = g_tx_pending; i > 0; --i) {
+        size_t    idx   = (tx_ring.frame_idx + nr - i) % nr;
+        FrameHdr *frame = reinterpret_cast<FrameHdr *>(tx_ring.data + idx * tx_ring.req.tp_block_size);
+        uint32_t  len   = frame->tp_len;
+#if USE_VNET_HDR
+        len -= sizeof(virtio_net_hdr);  // counted by tp_len, not on the wire
+#endif
+        g_tx_capture->out.add(&frame->eth, len, g_tx_capture->sec, g_tx_capture->nsec);
+        frame->tp_status = TP_STATUS_AVAILABLE;
     }
+}
+#endif
 
-    if (__virtio16_to_cpu(false, vnet_hdr.hdr_len) > len) {
-        fmt::print("3\n");
-        return;
+static void flush_tx([[maybe_unused]] int tx_sock) {
+#if USE_TX_RING || USE_AF_XDP
+    if (g_tx_pending == 0) return;
+
+#if USE_AF_XDP
+    CHECK_ERROR(g_xsk.kick());
+#else
+    if (g_tx_capture != nullptr) {
+        capture_tx();
+    } else {
+        CHECK_ERROR(platform::send(tx_sock, nullptr, 0, kSendFlags));
+    }
+#endif
+
+    uint64_t reported = g_tx_packets / kTxReportEvery;
+    g_tx_packets += g_tx_pending;
+    g_tx_syscalls++;
+    g_tx_pending = 0;
+    if (g_tx_packets / kTxReportEvery != reported) {
+        fmt::print(stderr, "tx ring: {} packets in {} sends, {:.2f} per send\n", g_tx_packets, g_tx_syscalls, double(g_tx_packets) / double(g_tx_syscalls));
     }
+#endif
+}
+
+// Next frame to build a reply in. With the tx ring it may still be queued from the previous lap, then it is
+// flushed and waited for
+static FrameHdr *tx_frame([[maybe_unused]] int tx_sock) {
+#if USE_AF_XDP
+    char *chunk;
+    while ((chunk = g_xsk.txChunk()) == nullptr) { g_xsk.kick(); }
+    return reinterpret_cast<FrameHdr *>(chunk);
+#elif USE_TX_RING
+    tpacket_hdr *hdr = reinterpret_cast<tpacket_hdr *>(tx_ring.current_frame);
+    while (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING)) { flush_tx(tx_sock); }
+#endif
+    return reinterpret_cast<FrameHdr *>(tx_ring.current_frame);
+}
+
+static thread_local ChecksumTemplate g_csum_tpl;  // set up by fill_tx_ring
+
+// Frames must come from the tx template with tot_len set and the tcp header, options and payload in place
+static void set_checksums(FrameHdr *frame) {
+    char *ip  = reinterpret_cast<char *>(frame) + offsetof(FrameHdr, iph);
+    char *tcp = reinterpret_cast<char *>(frame) + offsetof(FrameHdr, tcph);
+
+    frame->iph.check = g_csum_tpl.ipCheck(ip);
+#if !USE_VNET_HDR
+    frame->tcph.check = g_csum_tpl.tcpCheck(ip, tcp, ntohs(frame->iph.tot_len) - sizeof(iphdr));
+#else
+    // Completed by the kernel or the NIC from csum_start, see do_send()
+    (void)tcp;
+    frame->tcph.check = g_csum_tpl.tcpPseudo(ip, ntohs(frame->iph.tot_len) - sizeof(iphdr));
+#endif
 }
 
-static ssize_t do_send(int sock, FrameHdr *frame, size_t data_size, sockaddr_ll *) {
+// With USE_VNET_HDR a frame carrying more than `gso_size` bytes of payload is one TSO superframe: the kernel (or
+// the NIC) cuts it into gso_size segments, fixing up ip ids, lengths, sequence numbers and flags as it goes
+static ssize_t do_send(int sock, FrameHdr *frame, [[maybe_unused]] uint16_t gso_size) {
+#if USE_TRACE
+    char *base = reinterpret_cast<char *>(frame);
+    g_trace.record(kTraceTx, static_cast<uint32_t>(frame->tp_status), reinterpret_cast<ethhdr *>(base + offsetof(FrameHdr, eth)),
+                   reinterpret_cast<iphdr *>(base + offsetof(FrameHdr, iph)), reinterpret_cast<tcphdr *>(base + offsetof(FrameHdr, tcph)));
+#endif
+#if USE_VNET_HDR
+    // Packet sockets take the virtio fields in host order (legacy virtio on a little-endian cpu)
+    uint16_t hdr_len            = static_cast<uint16_t>(ETH_HLEN + sizeof(iphdr) + frame->tcph.doff * 4);
+    uint32_t payload            = frame->tp_len - hdr_len;
+    bool     gso                = gso_size != 0 && payload > gso_size;
+    frame->vnet_hdr.flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+    frame->vnet_hdr.hdr_len     = __cpu_to_virtio16(true, hdr_len);
+    frame->vnet_hdr.gso_type    = gso ? VIRTIO_NET_HDR_GSO_TCPV4 : VIRTIO_NET_HDR_GSO_NONE;
+    frame->vnet_hdr.gso_size    = __cpu_to_virtio16(true, gso ? gso_size : 0);
+    frame->vnet_hdr.csum_start  = __cpu_to_virtio16(true, ETH_HLEN + sizeof(iphdr));
+    frame->vnet_hdr.csum_offset = __cpu_to_virtio16(true, offsetof(tcphdr, check));
+
+    size_t                 sz    = sizeof(frame->vnet_hdr) + frame->tp_len;
+    [[maybe_unused]] void *start = &frame->vnet_hdr;
+#else
+    size_t                 sz    = frame->tp_len;
+    [[maybe_unused]] void *start = &frame->eth;
+#endif
+
 #if USE_SEND_THREAD
     tx_ring.nextFrame();
+    return 0;
+#elif USE_AF_XDP
+    g_xsk.txPush(offsetof(FrameHdr, eth), static_cast<uint32_t>(sz));
+    if (++g_tx_pending == kTxFlushBatch) flush_tx(sock);
+    return 0;
 #elif USE_TX_RING
+    frame->tp_len = static_cast<unsigned int>(sz);
     tx_ring.nextFrame();
+    if (++g_tx_pending == kTxFlushBatch) flush_tx(sock);
     return 0;
-//    return CHECK_ERROR(platform::send(sock, nullptr, 0, kSendFlags));
-#elif USE_VNET_HDR
-    frame->vnet_hdr.flags       = VIRTIO_NET_HDR_F_NEEDS_CSUM | VIRTIO_NET_HDR_F_DATA_VALID;
-    frame->vnet_hdr.hdr_len     = htons(sizeof(frame->eth) + sizeof(frame->iph) + sizeof(frame->tcph));
-    frame->vnet_hdr.gso_type    = data_size > 0 ? VIRTIO_NET_HDR_GSO_TCPV4 | VIRTIO_NET_HDR_GSO_ECN : VIRTIO_NET_HDR_GSO_NONE;
-    frame->vnet_hdr.gso_size    = data_size > 0 ? htons(1) : 0;
-    frame->vnet_hdr.csum_start  = htons(ETH_HLEN + sizeof(struct iphdr));
-    frame->vnet_hdr.csum_offset = htons(__builtin_offsetof(struct tcphdr, check));
-
-    size_t sz = sizeof(frame->vnet_hdr) + ETH_HLEN + sizeof(struct iphdr) + sizeof(struct tcphdr) + data_size;
-    debug_send(frame->vnet_hdr, sz);
-    ssize_t err = platform::send(sock, &frame->vnet_hdr, sz, kSendFlags);
-    if (err < 0) { fmt::print(stderr, "send(): {}\n", err); }
-    return err;
 #else
-    size_t  sz  = frame->tp_len;
-    ssize_t err = platform::send(sock, &frame->eth, sz, kSendFlags);
+    ssize_t err = platform::send(sock, start, sz, kSendFlags);
     if (err < 0) { fmt::print(stderr, "send(): {}\n", err); }
     return err;
 #endif
 }
 
-static ssize_t handle_frame([[maybe_unused]] int tx_sock, char *buffer) {
-    tpacket_hdr *tphdr = reinterpret_cast<tpacket_hdr *>(buffer);
-    sockaddr_ll *caddr = reinterpret_cast<sockaddr_ll *>(buffer + TPACKET_HDRLEN - sizeof(struct sockaddr_ll));
-    ethhdr *     eth   = reinterpret_cast<ethhdr *>(buffer + tphdr->tp_mac);
-    iphdr *      iph   = reinterpret_cast<iphdr *>(buffer + tphdr->tp_net);
+[[maybe_unused]] static uint64_t now_ms() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000 + static_cast<uint64_t>(ts.tv_nsec) / 1000000;
+}
+
+static const uint32_t kTickMs    = 10;     // trace clock calibration and the poll timeout
+static const uint16_t kRcvWindow = 65483;  // unscaled
+static const uint16_t kLocalMss  = 1460;   // advertised, and the most we put in one segment whatever the peer takes
+#if USE_TCP_OPTIONS
+static const uint8_t  kRcvWscale = 7;
+static const uint32_t kRcvBuffer = 1u << 22;  // advertised once scaling is on, requests are consumed on arrival
+#endif
+
+#if USE_HTTP && !USE_TCP_TABLE
+#error "USE_HTTP needs the connection state of USE_TCP_TABLE"
+#endif
+
+#if USE_TCP_TABLE
+static const uint32_t kIdleTimeoutMs = 10000;
+static const uint32_t kTimeWaitMs    = 1000;  // short 2*MSL, the peers are on the local network
+static const uint32_t kDelayedAckMs  = 40;
+
+static thread_local TcpTable g_tcp_table;
+
+struct TcpTimerRef {
+    FlowKey key;
+    uint8_t timer;  // TcpTimer
+};
+
+// One tick per millisecond of now_ms(), started at the first use on each worker
+static thread_local TimerWheel<TcpTimerRef> g_timers(now_ms());
+
+// Makes sure a wheel entry fires no later than `deadline`
+static void arm(TcpConn &conn, uint8_t timer, uint64_t deadline) {
+    uint64_t &armed = conn.armed_ms[timer];
+    if (armed != 0 && armed <= deadline) return;
+    armed = deadline;
+    g_timers.schedule(deadline, TcpTimerRef{conn.key, timer});
+}
+
+static uint32_t initial_seq(const FlowKey &key) { return static_cast<uint32_t>(rdtsc() >> 6) ^ key.addr ^ (uint32_t(key.port) << 16); }
+
+#if USE_HTTP
+static const uint32_t kMaxSendQueue = 1u << 20;  // queued answers beyond this stop us from taking more requests
+
+// Parser state, partial requests and the send queue of a connection, attached on its first request. The queue
+// holds every answer byte from the oldest unacknowledged one on and is the retransmission buffer too: segments
+// in flight refer to it by sequence number and frames are filled straight from its parts.
+struct HttpSession : hlcup::Connection {
+    uint32_t out_seq = 0;  // sequence number of the first byte in `out`
+
+    HttpSession() : Connection(-1) {}
+};
+
+static thread_local std::vector<std::unique_ptr<HttpSession>> g_sessions;  // TcpConn::session - 1 indexes it
+static thread_local std::vector<uint32_t>                     g_free_sessions;
+static thread_local hlcup::RequestHandler                     g_handler;
+
+static HttpSession &session(TcpConn &conn) {
+    if (conn.session == 0) {
+        if (g_free_sessions.empty()) {
+            g_sessions.emplace_back(new HttpSession);
+            conn.session = static_cast<uint32_t>(g_sessions.size());
+        } else {
+            conn.session = g_free_sessions.back();
+            g_free_sessions.pop_back();
+        }
+    }
+    return *g_sessions[conn.session - 1];
+}
+
+#if USE_VNET_HDR
+// Answer bytes one superframe takes: whatever fits a tx frame after the headers and the longest options, which
+// keeps the 16-bit ip length in range too
+static const uint32_t kGsoMaxPayload = kTxFrameSize - sizeof(FrameHdr) - 40;
+#endif
+#endif
+
+// Largest payload of one segment: the peer's MSS capped by ours, less the timestamp every segment carries
+[[maybe_unused]] static uint16_t send_mss(const TcpConn &conn) {
+    uint16_t mss = std::min(conn.peer_mss, kLocalMss);
+    return conn.ts_ok ? static_cast<uint16_t>(mss - 12) : mss;
+}
+
+static void close_conn(TcpConn *conn) {
+#if USE_HTTP
+    if (conn->session != 0) {
+        g_sessions[conn->session - 1]->reset(-1);
+        g_free_sessions.push_back(conn->session);
+    }
+#endif
+    g_tcp_table.erase(conn);
+}
+
+#if USE_TCP_OPTIONS
+// Everything negotiated goes on a SYN, afterwards only the timestamp
+static uint8_t segment_options(uint8_t *dst, const TcpConn &conn, uint8_t flags) {
+    TcpOptions opts;
+    if (flags & kTcpSyn) {
+        opts.mss     = kLocalMss;
+        opts.wscale  = conn.rcv_wscale != 0 ? conn.rcv_wscale : TcpOptions::kNoWscale;
+        opts.sack_ok = conn.sack_ok;
+    }
+    opts.has_ts = conn.ts_ok;
+    opts.ts_val = static_cast<uint32_t>(now_ms());
+    opts.ts_ecr = conn.ts_recent;
+    return emit_tcp_options(dst, opts);
+}
+
+static uint16_t advertised_window(const TcpConn &conn, uint8_t flags) {
+    // The window of a SYN is never scaled
+    if ((flags & kTcpSyn) || conn.rcv_wscale == 0) return kRcvWindow;
+    return static_cast<uint16_t>(kRcvBuffer >> conn.rcv_wscale);
+}
+#endif
+
+// Builds one segment from the connection state into the current tx frame. ACK is always set and acknowledges
+// rcv_nxt, `seq` is given explicitly so retransmissions can go out with their original numbers.
+static ssize_t send_segment(int tx_sock, const TcpConn &conn, uint8_t flags, uint32_t seq, const char *payload, uint16_t len) {
+    FrameHdr *frame = tx_frame(tx_sock);
+
+    memcpy(frame->eth.h_source, conn.local_mac, 6);
+    memcpy(frame->eth.h_dest, conn.peer_mac, 6);
+
+    frame->iph.saddr = conn.local_addr;
+    frame->iph.daddr = conn.key.addr;
+    frame->iph.id    = 0;
+
+    frame->tcph.source  = htons(kPort);
+    frame->tcph.dest    = conn.key.port;
+    frame->tcph.seq     = htonl(seq);
+    frame->tcph.ack_seq = htonl(conn.rcv_nxt);
+    frame->tcph.fin     = (flags & kTcpFin) != 0;
+    frame->tcph.syn     = (flags & kTcpSyn) != 0;
+    frame->tcph.rst     = (flags & kTcpRst) != 0;
+    frame->tcph.psh     = (flags & kTcpPsh) != 0;
+    frame->tcph.ack     = (flags & kTcpRst) == 0 || (flags & kTcpAck) != 0;
+
+#if USE_TCP_OPTIONS
+    uint8_t opt_len    = segment_options(reinterpret_cast<uint8_t *>(&frame->tcph) + sizeof(tcphdr), conn, flags);
+    frame->tcph.window = htons(advertised_window(conn, flags));
+#else
+    uint8_t opt_len    = 0;
+    frame->tcph.window = htons(kRcvWindow);
+#endif
+    frame->tcph.doff = 5 + opt_len / 4;
+
+    char *dst = reinterpret_cast<char *>(&frame->tcph) + sizeof(tcphdr) + opt_len;
+    if (payload != nullptr) {
+        memcpy(dst, payload, len);
+#if USE_HTTP
+    } else if (len > 0) {
+        const HttpSession &s = *g_sessions[conn.session - 1];
+        s.out.copy(seq - s.out_seq, dst, len);
+#endif
+    }
+    frame->iph.tot_len = htons(static_cast<uint16_t>(sizeof(FrameHdr) - offsetof(FrameHdr, iph) + opt_len + len));
+
+    set_checksums(frame);
+
+    frame->tp_len    = static_cast<unsigned int>(sizeof(FrameHdr) - offsetof(FrameHdr, eth) + opt_len + len);
+    frame->tp_status = TP_STATUS_SEND_REQUEST;
+
+    // Only http_push() builds segments longer than the MSS, retransmissions go out the same way
+    return do_send(tx_sock, frame, len > send_mss(conn) ? send_mss(conn) : 0);
+}
+
+// Sends new data (or SYN/FIN) at snd_nxt and remembers it for retransmission. A null payload with a length
+// takes the data from the connection's send queue
+static ssize_t transmit(int tx_sock, TcpConn &conn, uint8_t flags, const char *payload, uint16_t len, uint64_t now) {
+    TcpSegment &seg = conn.unacked[conn.n_unacked++];
+    seg.payload     = payload;
+    seg.len         = len;
+    seg.flags       = flags;
+    seg.seq         = conn.snd_nxt;
+
+    conn.snd_nxt += TcpConn::segmentLen(seg);
+    if (conn.rto_deadline_ms == 0) {
+        conn.rto_deadline_ms = now + conn.rto_ms;
+        arm(conn, kTimerRto, conn.rto_deadline_ms);
+    }
+    conn.ack_deadline_ms = 0;  // carried by this segment
+
+    return send_segment(tx_sock, conn, flags, seg.seq, payload, len);
+}
+
+static void retransmit(int tx_sock, const TcpConn &conn) {
+    for (uint8_t i = 0; i < conn.n_unacked; ++i) {
+        const TcpSegment &seg = conn.unacked[i];
+        send_segment(tx_sock, conn, seg.flags, seg.seq, seg.payload, seg.len);
+    }
+}
+
+static ssize_t send_ack(int tx_sock, TcpConn &conn) {
+    conn.ack_deadline_ms = 0;
+    return send_segment(tx_sock, conn, kTcpAck, conn.snd_nxt, nullptr, 0);
+}
+
+// Holds the ACK back for kDelayedAckMs in case an answer can carry it, the second segment in a row that wants
+// one gets it right away
+[[maybe_unused]] static ssize_t delay_ack(int tx_sock, TcpConn &conn, uint64_t now) {
+    if (conn.ack_deadline_ms != 0) return send_ack(tx_sock, conn);
+    conn.ack_deadline_ms = now + kDelayedAckMs;
+    arm(conn, kTimerAck, conn.ack_deadline_ms);
+    return 0;
+}
+
+#if USE_HTTP
+// Sends queued answer bytes in MSS-sized segments while the peer's window and the in-flight slots allow, then
+// our FIN once the peer has closed and nothing is left. With USE_VNET_HDR a segment spans as many MSS as a
+// superframe holds and is cut on the way out. Returns the number of segments sent
+static int http_push(int tx_sock, TcpConn &conn, uint64_t now) {
+    int      sent = 0;
+    uint32_t end  = conn.snd_nxt;
+    if (conn.session != 0) {
+        const HttpSession &s   = *g_sessions[conn.session - 1];
+        uint32_t           max_len = send_mss(conn);
+#if USE_VNET_HDR
+        max_len = kGsoMaxPayload / max_len * max_len;
+#endif
+        end = s.out_seq + static_cast<uint32_t>(s.out.size());
+
+        while (seq_lt(conn.snd_nxt, end) && conn.n_unacked < kMaxInFlight) {
+            uint32_t in_flight = conn.snd_nxt - conn.snd_una;
+            if (in_flight >= conn.snd_wnd) break;
+
+            uint32_t len = std::min({end - conn.snd_nxt, max_len, conn.snd_wnd - in_flight});
+            transmit(tx_sock, conn, conn.snd_nxt + len == end ? kTcpPsh : 0, nullptr, static_cast<uint16_t>(len), now);
+            ++sent;
+        }
+    }
+
+    if (conn.state == TcpState::kCloseWait && conn.snd_nxt == end && conn.n_unacked < kMaxInFlight) {
+        conn.state = TcpState::kLastAck;
+        transmit(tx_sock, conn, kTcpFin, nullptr, 0, now);
+        ++sent;
+    }
+    return sent;
+}
+#endif
+
+// Answers a segment that belongs to no connection, unless it is a reset itself
+static ssize_t send_reset(int tx_sock, ethhdr *eth, iphdr *iph, tcphdr *tcph, uint16_t data_size) {
+    if (tcph->rst) return 0;
+
+    TcpConn tmp{};
+    tmp.key        = FlowKey{iph->saddr, tcph->source};
+    tmp.local_addr = iph->daddr;
+    memcpy(tmp.peer_mac, eth->h_source, 6);
+    memcpy(tmp.local_mac, eth->h_dest, 6);
+
+    if (tcph->ack) return send_segment(tx_sock, tmp, kTcpRst, ntohl(tcph->ack_seq), nullptr, 0);
+
+    tmp.rcv_nxt = ntohl(tcph->seq) + data_size + tcph->syn + tcph->fin;
+    return send_segment(tx_sock, tmp, kTcpRst | kTcpAck, 0, nullptr, 0);
+}
+
+// Wheel entries stay in place when a deadline moves or is cleared, so each one checks what its connection still
+// wants when it fires: acts once the deadline has passed, re-arms when it was pushed out, does nothing otherwise
+static void tcp_timer(int tx_sock, const TcpTimerRef &ref, uint64_t armed, uint64_t now) {
+    TcpConn *conn = g_tcp_table.find(ref.key);
+    if (conn == nullptr || conn->armed_ms[ref.timer] != armed) return;  // closed, or an earlier entry took over
+    conn->armed_ms[ref.timer] = 0;
+
+    switch (ref.timer) {
+        case kTimerRto:
+            if (conn->rto_deadline_ms == 0) return;
+            if (now < conn->rto_deadline_ms) return arm(*conn, kTimerRto, conn->rto_deadline_ms);
+
+            if (++conn->retries > TcpTable::kMaxRetries) {
+                send_segment(tx_sock, *conn, kTcpRst, conn->snd_nxt, nullptr, 0);
+                return close_conn(conn);
+            }
+            retransmit(tx_sock, *conn);
+            conn->rto_ms          = std::min(conn->rto_ms * 2, TcpTable::kMaxRtoMs);
+            conn->rto_deadline_ms = now + conn->rto_ms;
+            return arm(*conn, kTimerRto, conn->rto_deadline_ms);
+
+        case kTimerAck:
+            if (conn->ack_deadline_ms == 0) return;
+            if (now < conn->ack_deadline_ms) return arm(*conn, kTimerAck, conn->ack_deadline_ms);
+            send_ack(tx_sock, *conn);
+            return;
+
+        case kTimerAge: {
+            uint64_t deadline = conn->last_active_ms + (conn->state == TcpState::kTimeWait ? kTimeWaitMs : kIdleTimeoutMs);
+            if (now < deadline) return arm(*conn, kTimerAge, deadline);
+
+            switch (conn->state) {
+                case TcpState::kTimeWait:
+                case TcpState::kCloseWait:
+                case TcpState::kFinWait2:
+                    return close_conn(conn);
+                case TcpState::kEstablished:
+                    if (!conn->inFlight()) {
+                        conn->state = TcpState::kFinWait1;
+                        transmit(tx_sock, *conn, kTcpFin, nullptr, 0, now);
+                    }
+                    break;
+                default:
+                    break;  // the retransmission timer gives up on these
+            }
+            return arm(*conn, kTimerAge, now + kIdleTimeoutMs);
+        }
+    }
+}
+
+// Expires the timers due by `now`. Costs a compare until a new millisecond starts, so it runs per segment as well
+// as from the idle loop
+static void tcp_tick(int tx_sock, uint64_t now) {
+    g_timers.advance(now + 1, [&](const TcpTimerRef &ref, uint64_t armed) { tcp_timer(tx_sock, ref, armed, now); });
+}
+
+static ssize_t handle_segment(int tx_sock, ethhdr *eth, iphdr *iph, tcphdr *tcph, [[maybe_unused]] char *data, uint16_t data_size) {
+    uint64_t now = now_ms();
+    tcp_tick(tx_sock, now);
+
+    FlowKey  key{iph->saddr, tcph->source};
+    TcpConn *conn = g_tcp_table.find(key);
+    uint32_t seq  = ntohl(tcph->seq);
+
+#if USE_TCP_OPTIONS
+    TcpOptions opts;
+    if (tcph->doff > 5) parse_tcp_options(reinterpret_cast<uint8_t *>(tcph) + sizeof(tcphdr), tcph->doff * 4u - sizeof(tcphdr), opts);
+#endif
+
+    if (conn == nullptr) {
+        if (!tcph->syn || tcph->ack || tcph->rst) return send_reset(tx_sock, eth, iph, tcph, data_size);
+
+        conn = g_tcp_table.insert(key);
+        if (conn == nullptr) return 0;  // full, the peer retries its SYN
+
+        memcpy(conn->peer_mac, eth->h_source, 6);
+        memcpy(conn->local_mac, eth->h_dest, 6);
+        conn->local_addr     = iph->daddr;
+        conn->state          = TcpState::kSynRcvd;
+        conn->snd_una        = initial_seq(key);
+        conn->snd_nxt        = conn->snd_una;
+        conn->snd_wnd        = ntohs(tcph->window);
+        conn->rcv_nxt        = seq + 1;
+        conn->last_active_ms = now;
+        conn->peer_mss       = kTcpDefaultMss;
+        arm(*conn, kTimerAge, now + kIdleTimeoutMs);
+#if USE_TCP_OPTIONS
+        if (opts.mss != 0) conn->peer_mss = opts.mss;
+        if (opts.wscale != TcpOptions::kNoWscale) {
+            conn->snd_wscale = opts.wscale;
+            conn->rcv_wscale = kRcvWscale;
+        }
+        conn->sack_ok   = opts.sack_ok;
+        conn->ts_ok     = opts.has_ts;
+        conn->ts_recent = opts.ts_val;
+#endif
+        return transmit(tx_sock, *conn, kTcpSyn, nullptr, 0, now);
+    }
+
+    if (tcph->rst) {
+        if (seq == conn->rcv_nxt) close_conn(conn);
+        return 0;
+    }
+
+    conn->last_active_ms = now;
+#if USE_TCP_OPTIONS
+    if (conn->ts_ok && opts.has_ts && seq_le(seq, conn->rcv_nxt)) conn->ts_recent = opts.ts_val;
+#endif
+
+    if (tcph->syn) {
+        // Our SYN-ACK got lost and the peer repeats its SYN
+        if (conn->state == TcpState::kSynRcvd && seq + 1 == conn->rcv_nxt) retransmit(tx_sock, *conn);
+        return 0;
+    }
+    if (!tcph->ack) return 0;
+
+    uint32_t ack = ntohl(tcph->ack_seq);
+    if (seq_lt(conn->snd_una, ack) && seq_le(ack, conn->snd_nxt)) {
+        conn->snd_una   = ack;
+        uint32_t queued = conn->ackSegments(ack);
+#if USE_HTTP
+        if (queued > 0) {
+            HttpSession &s = *g_sessions[conn->session - 1];
+            s.out.consume(queued);
+            s.out_seq += queued;
+        }
+#else
+        (void)queued;
+#endif
+        conn->retries         = 0;
+        conn->rto_ms          = TcpTable::kInitialRtoMs;
+        conn->rto_deadline_ms = conn->inFlight() ? now + conn->rto_ms : 0;
+        if (conn->rto_deadline_ms != 0) arm(*conn, kTimerRto, conn->rto_deadline_ms);
+
+        if (conn->state == TcpState::kSynRcvd) conn->state = TcpState::kEstablished;
+        if (!conn->inFlight()) {
+            if (conn->state == TcpState::kLastAck) {
+                close_conn(conn);
+                return 0;
+            }
+            if (conn->state == TcpState::kFinWait1) conn->state = TcpState::kFinWait2;
+        }
+    } else if (conn->state == TcpState::kSynRcvd) {
+        return 0;
+    }
+    conn->snd_wnd = uint32_t(ntohs(tcph->window)) << conn->snd_wscale;
+
+    ssize_t sent = 0;
+#if USE_HTTP
+    // The ack or window update may have made room for more of the queue
+    if (conn->state == TcpState::kEstablished || conn->state == TcpState::kCloseWait) sent = http_push(tx_sock, *conn, now);
+#endif
+
+    if (seq != conn->rcv_nxt) {
+        // Out of order or a retransmission of something we already have: repeat our ACK
+        if (data_size > 0 || tcph->fin) return send_ack(tx_sock, *conn);
+        return 0;
+    }
+
+    if (data_size > 0 && (conn->state == TcpState::kEstablished || conn->state == TcpState::kFinWait1 || conn->state == TcpState::kFinWait2)) {
+#if USE_HTTP
+        if (conn->state == TcpState::kEstablished) {
+            HttpSession &s = session(*conn);
+            if (s.out.size() > kMaxSendQueue) return sent;  // unacked, the peer resends once the queue drained
+
+            conn->rcv_nxt += data_size;
+            if (s.out.empty()) s.out_seq = conn->snd_nxt;
+            s.in.append(data, data_size);
+            s.process(g_handler);
+
+            // The answers carry the ACK, a request still incomplete gets a delayed one unless the FIN below sends it
+            if (http_push(tx_sock, *conn, now) == 0 && !tcph->fin) sent = delay_ack(tx_sock, *conn, now);
+        } else {
+            conn->rcv_nxt += data_size;
+            sent = send_ack(tx_sock, *conn);
+        }
+#else
+        uint16_t resp_size = static_cast<uint16_t>(response.size());
+        if (conn->n_unacked == kMaxInFlight || conn->snd_nxt - conn->snd_una + resp_size > conn->snd_wnd) return 0;
+
+        // Every request gets the same answer until the parser is wired in
+        conn->rcv_nxt += data_size;
+        if (conn->state == TcpState::kEstablished) {
+            sent = transmit(tx_sock, *conn, kTcpPsh, response.data(), resp_size, now);
+        } else {
+            sent = send_ack(tx_sock, *conn);
+        }
+#endif
+    }
+
+    if (tcph->fin) {
+        conn->rcv_nxt += 1;
+        switch (conn->state) {
+            case TcpState::kEstablished:
+#if USE_HTTP
+                // Our FIN goes after whatever is still queued, or right away
+                conn->state = TcpState::kCloseWait;
+                if (http_push(tx_sock, *conn, now) == 0) return send_ack(tx_sock, *conn);
+                return sent;
+#else
+                conn->state = TcpState::kLastAck;
+                if (conn->n_unacked == kMaxInFlight) return send_ack(tx_sock, *conn);
+                return transmit(tx_sock, *conn, kTcpFin, nullptr, 0, now);
+#endif
+            case TcpState::kFinWait1:
+            case TcpState::kFinWait2:
+                conn->state = TcpState::kTimeWait;
+                arm(*conn, kTimerAge, now + kTimeWaitMs);
+                return send_ack(tx_sock, *conn);
+            default:
+                conn->rcv_nxt -= 1;
+                break;
+        }
+    }
+
+    return sent;
+}
+
+#endif
+
+#if USE_TCP_OPTIONS
+// Stateless replies follow the options of the segment they answer. The template window is left as is, which
+// with scaling on advertises kRcvWindow << kRcvWscale
+[[maybe_unused]] static uint8_t reply_options(FrameHdr *frame, tcphdr *tcph) {
+    TcpOptions in, out;
+    if (tcph->doff > 5) parse_tcp_options(reinterpret_cast<uint8_t *>(tcph) + sizeof(tcphdr), tcph->doff * 4u - sizeof(tcphdr), in);
+
+    if (tcph->syn) {
+        out.mss     = kLocalMss;
+        out.sack_ok = in.sack_ok;
+        if (in.wscale != TcpOptions::kNoWscale) out.wscale = kRcvWscale;
+    }
+    out.has_ts = in.has_ts;
+    out.ts_val = static_cast<uint32_t>(now_ms());
+    out.ts_ecr = in.ts_val;
+    return emit_tcp_options(reinterpret_cast<uint8_t *>(&frame->tcph) + sizeof(tcphdr), out);
+}
+#endif
+
+// `mac` and `net` are offsets of the ethernet and ip headers from `buffer`, which is whatever frame header the
+// ring uses, `status` is that header's status word for the trace
+static ssize_t handle_packet([[maybe_unused]] int tx_sock, char *buffer, uint16_t mac, uint16_t net, [[maybe_unused]] uint32_t sec,
+                             [[maybe_unused]] uint32_t status) {
+    ethhdr *eth = reinterpret_cast<ethhdr *>(buffer + mac);
+    iphdr * iph = reinterpret_cast<iphdr *>(buffer + net);
 
     if (iph->protocol != 6) return 0;
 
-    tcphdr *tcph = reinterpret_cast<tcphdr *>(buffer + tphdr->tp_net + iph->ihl * 4);
+    tcphdr *tcph = reinterpret_cast<tcphdr *>(buffer + net + iph->ihl * 4);
     if (tcph->dest != htons(kPort)) return 0;
 
-    [[maybe_unused]] char *data      = buffer + tphdr->tp_net + iph->ihl * 4 + tcph->doff * 4;
+    [[maybe_unused]] char *data      = buffer + net + iph->ihl * 4 + tcph->doff * 4;
     uint16_t               data_size = ntohs(iph->tot_len) - uint16_t(tcph->doff * 4) - uint16_t(iph->ihl * 4);
 
     //    if (data_size <= 0) return;
 
-    if (CNTR) {
-        dump_tpacket_hdr(tphdr);
-        dump_addr(caddr);
-        dump_eth(eth);
-        dump_iph(iph);
-        dump_tcph(tcph);
-    }
+#if USE_TRACE
+    g_trace.record(kTraceRx, status, eth, iph, tcph);
+#endif
 
-    if (CNTR) CNTR--;
+#if USE_TCP_TABLE
+    return handle_segment(tx_sock, eth, iph, tcph, data, data_size);
+#endif
 
 #if USE_CUSTOM_HANDSHAKE
     if (tcph->fin == 1) {
-        FrameHdr *frame = reinterpret_cast<FrameHdr *>(tx_ring.current_frame);
+        FrameHdr *frame = tx_frame(tx_sock);
 
         memcpy(frame->eth.h_source, eth->h_dest, 6);
         memcpy(frame->eth.h_dest, eth->h_source, 6);
@@ -544,33 +1138,20 @@ static ssize_t handle_frame([[maybe_unused]] int tx_sock, char *buffer) {
         //        frame->tcph.window = htons(65483);
 
 #if USE_TCP_OPTIONS
-        char *opts = reinterpret_cast<char *>(&frame->tcph) + sizeof(tcphdr);
-        memcpy(opts, "\x02\x04\xff\xd7\x04\x02\x08\x0a\x52\x1e\x65\x61\x52\x1e\x65\x61\x01\x03\x03\x07", 20);
-        uint32_t tsval                           = *reinterpret_cast<uint32_t *>(reinterpret_cast<char *>(tcph) + sizeof(tcphdr) + 8);
-        *reinterpret_cast<uint32_t *>(opts + 8)  = tsval;
-        *reinterpret_cast<uint32_t *>(opts + 12) = tsval;
-        frame->tcph.doff                         = 10;
+        frame->tcph.doff = 5 + reply_options(frame, tcph) / 4;
 #endif
 
         frame->iph.tot_len = htons(sizeof(FrameHdr) - offsetof(FrameHdr, iph) + (frame->tcph.doff - 5) * 4);
 
-#if USE_VNET_HDR
-        frame->iph.check = 0;
-        frame->iph.check = htons(cksum_generic(reinterpret_cast<uint8_t *>(&frame->iph), iph->ihl * 4, 0));
-#else
-        frame->iph.check  = 0;
-        frame->tcph.check = 0;
-        frame->iph.check  = htons(cksum_generic(reinterpret_cast<uint8_t *>(&frame->iph), iph->ihl * 4, 0));
-        frame->tcph.check = compute_tcp_checksum(&frame->iph, &frame->tcph);
-#endif
+        set_checksums(frame);
 
         frame->tp_len    = sizeof(FrameHdr) - offsetof(FrameHdr, eth) + (frame->tcph.doff - 5) * 4;
         frame->tp_status = TP_STATUS_SEND_REQUEST;
 
-        return do_send(tx_sock, frame, 0, caddr);
+        return do_send(tx_sock, frame, 0);
     }
     if (tcph->syn == 1) {
-        FrameHdr *frame = reinterpret_cast<FrameHdr *>(tx_ring.current_frame);
+        FrameHdr *frame = tx_frame(tx_sock);
 
         //        uint32_t ack_seq     = tcph->ack_seq;
         //        uint32_t new_ack_seq = ntohl(tcph->seq) + data_size;
@@ -598,42 +1179,27 @@ static ssize_t handle_frame([[maybe_unused]] int tx_sock, char *buffer) {
         //        frame->tcph.window = htons(65483);
 
 #if USE_TCP_OPTIONS
-        char *opts = reinterpret_cast<char *>(&frame->tcph) + sizeof(tcphdr);
-        memcpy(opts, "\x02\x04\xff\xd7\x04\x02\x08\x0a\x52\x1e\x65\x61\x52\x1e\x65\x61\x01\x03\x03\x07", 20);
-        uint32_t tsval                           = *reinterpret_cast<uint32_t *>(reinterpret_cast<char *>(tcph) + sizeof(tcphdr) + 8);
-        *reinterpret_cast<uint32_t *>(opts + 8)  = tsval;
-        *reinterpret_cast<uint32_t *>(opts + 12) = tsval;
-        frame->tcph.doff                         = 10;
+        frame->tcph.doff = 5 + reply_options(frame, tcph) / 4;
 #endif
 
         frame->iph.tot_len = htons(sizeof(FrameHdr) - offsetof(FrameHdr, iph) + (frame->tcph.doff - 5) * 4);
         //        iph->check  = 0;
         //        tcph->check = 0;
 
-#if USE_VNET_HDR
-        frame->iph.check = 0;
-        frame->iph.check = htons(cksum_generic(reinterpret_cast<uint8_t *>(&frame->iph), iph->ihl * 4, 0));
-#else
-        frame->iph.check  = 0;
-        frame->tcph.check = 0;
-        frame->iph.check  = htons(cksum_generic(reinterpret_cast<uint8_t *>(&frame->iph), iph->ihl * 4, 0));
-        frame->tcph.check = compute_tcp_checksum(&frame->iph, &frame->tcph);
-#endif
+        set_checksums(frame);
 
         frame->tp_len    = sizeof(FrameHdr) - offsetof(FrameHdr, eth) + (frame->tcph.doff - 5) * 4;
         frame->tp_status = TP_STATUS_SEND_REQUEST;
         //        tx_ring.nextFrame();
-        return do_send(tx_sock, frame, 0, caddr);
+        return do_send(tx_sock, frame, 0);
     }
 
 #endif
 
     if (data_size > 0) {
-        g_port_timestamps[tcph->source] = tphdr->tp_sec;
-
         //        fmt::print("data: {} `{:.{}}`\n", data_size, data, data_size);
 
-        FrameHdr *frame = reinterpret_cast<FrameHdr *>(tx_ring.current_frame);
+        FrameHdr *frame = tx_frame(tx_sock);
 
         //        uint16_t resp_size   = static_cast<uint16_t>(response.size());
         uint32_t ack_seq = tcph->ack_seq;
@@ -664,20 +1230,7 @@ static ssize_t handle_frame([[maybe_unused]] int tx_sock, char *buffer) {
 #endif
 
 #if USE_TCP_OPTIONS
-        char *    tcph_opts  = reinterpret_cast<char *>(tcph) + sizeof(tcphdr);
-        uint32_t *timestamps = reinterpret_cast<uint32_t *>(tcph_opts + 4);
-        uint32_t  tsval      = timestamps[0];
-        uint32_t  tsecr      = timestamps[1];
-
-        char *opts_dest  = reinterpret_cast<char *>(&frame->tcph) + sizeof(tcphdr);
-        opts_dest[0]     = 0x1;
-        opts_dest[1]     = 0x1;
-        opts_dest[2]     = 8;
-        opts_dest[3]     = 10;
-        timestamps       = reinterpret_cast<uint32_t *>(opts_dest + 4);
-        timestamps[1]    = tsval;
-        timestamps[0]    = htonl(ntohl(tsecr));
-        frame->tcph.doff = 8;
+        frame->tcph.doff = 5 + reply_options(frame, tcph) / 4;
 #endif
 
         char *dest_data = reinterpret_cast<char *>(&frame->tcph) + frame->tcph.doff * 4;
@@ -687,23 +1240,9 @@ static ssize_t handle_frame([[maybe_unused]] int tx_sock, char *buffer) {
         //        frame->tcph.check = 0;
         //        frame->tcph.check = compute_tcp_checksum(&frame->iph, &frame->tcph);
 
-#if USE_VNET_HDR
-        frame->iph.check = 0;
-        frame->iph.check = htons(cksum_generic(reinterpret_cast<uint8_t *>(&frame->iph), iph->ihl * 4, 0));
-#else
-        frame->iph.check  = 0;
-        frame->tcph.check = 0;
-        frame->iph.check  = htons(cksum_generic(reinterpret_cast<uint8_t *>(&frame->iph), iph->ihl * 4, 0));
-        frame->tcph.check = compute_tcp_checksum(&frame->iph, &frame->tcph);
-#endif
+        set_checksums(frame);
         //        uint32_t send_data_size = static_cast<uint32_t>(data - reinterpret_cast<char *>(eth)) + resp_size;
 
-        if (CNTR) {
-            //            fmt::print("sending to sock {} data size {} :\n", sock, send_data_size);
-            dump_eth(&frame->eth);
-            dump_iph(&frame->iph);
-            dump_tcph(&frame->tcph);
-        }
         //            fmt::print("msg->msg_namelen: {}, sizeof(struct sockaddr_ll): {}\n", caddr_len, sizeof(struct sockaddr_ll));
         //            fmt::print("(saddr->sll_halen + offsetof(struct sockaddr_ll, sll_addr)): {}\n", (caddr.sll_halen + offsetof(struct sockaddr_ll,
         //            sll_addr)));
@@ -724,20 +1263,25 @@ static ssize_t handle_frame([[maybe_unused]] int tx_sock, char *buffer) {
 
         //        uint64_t current_ts = uint64_t(tphdr->tp_sec) * 1000000 + tphdr->tp_usec;
 
-        return do_send(tx_sock, frame, response.size(), caddr);
+        return do_send(tx_sock, frame, 0);
         //            fmt::print(stderr, "----------------\nraw send(): {}\n", sent_size);
     }
 
     return 0;
 }
 
+[[maybe_unused]] static ssize_t handle_frame(int tx_sock, char *buffer) {
+    tpacket_hdr *tphdr = reinterpret_cast<tpacket_hdr *>(buffer);
+    return handle_packet(tx_sock, buffer, tphdr->tp_mac, tphdr->tp_net, tphdr->tp_sec, static_cast<uint32_t>(tphdr->tp_status));
+}
+
 static int fill_tx_ring(RingBuffer &tx) {
-    FrameHdr tpl;
+    FrameHdr tpl{};
 
     //    tpl.addr = g_host_addr;
     //    tpl.tp.tp_mac     = offsetof(FrameHdr, eth);
     //    tpl.tp.tp_net     = offsetof(FrameHdr, iph);
-    tpl.tp_status = TP_STATUS_SENDING;
+    tpl.tp_status = TP_STATUS_AVAILABLE;
     tpl.tp_len    = sizeof(FrameHdr) - offsetof(FrameHdr, eth) + static_cast<uint32_t>(response.size());
     //    tpl.tp.tp_snaplen = tpl.tp.tp_len;
 
@@ -766,6 +1310,8 @@ static int fill_tx_ring(RingBuffer &tx) {
     tpl.tcph.res2   = 0;
     tpl.tcph.window = htons(65483);
 
+    g_csum_tpl.init(reinterpret_cast<char *>(&tpl) + offsetof(FrameHdr, iph), reinterpret_cast<char *>(&tpl) + offsetof(FrameHdr, tcph));
+
     do {
         memcpy(tx.current_frame, &tpl, sizeof(tpl));
         memcpy(tx.current_frame + sizeof(tpl), response.data(), response.size());
@@ -797,7 +1343,11 @@ static int create_packet_socket() {
     fmt::print(stderr, "set_mtu(): {}\n", err);
 
     CHECK_ERROR(platform::setsockopt(sock, SOL_PACKET, PACKET_LOSS, 1));
+#if !USE_VNET_HDR
+    // The direct path drops whatever the device cannot take as is, superframes need the stack to segment them
+    // on devices without TSO
     CHECK_ERROR(platform::setsockopt(sock, SOL_PACKET, PACKET_QDISC_BYPASS, 1));
+#endif
     int timestamps = SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_SYS_HARDWARE
                      | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_SCHED;
     CHECK_ERROR(platform::setsockopt(sock, SOL_PACKET, PACKET_TIMESTAMP, timestamps));
@@ -805,30 +1355,58 @@ static int create_packet_socket() {
     return sock;
 }
 
-static int socket_mmap_ring(int sock, int ring_type, RingBuffer &ring) {
-    int err;
-
-    err = platform::setsockopt(sock, SOL_PACKET, ring_type, &ring.req, sizeof(tpacket_req));
-    if (err < 0) {
-        fmt::print(stderr, "setsockopt(ring) failed: {}\n", err);
-        return err;
-    }
-
+static int mmap_ring(int sock, size_t size, char **data) {
     union {
         long  err;
         char *ptr;
     } mmap_ret;
 
-    mmap_ret.err = platform::syscall<long>(platform::SC::mmap, 0, ring.size(), PROT_READ | PROT_WRITE, MAP_SHARED, sock, 0);
+    mmap_ret.err = platform::syscall<long>(platform::SC::mmap, 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, sock, 0);
     if (mmap_ret.err < 0 && mmap_ret.err > -4096) {
         fmt::print(stderr, "mmap() failed: {} \n", mmap_ret.err);
         return static_cast<int>(mmap_ret.err);
     }
 
-    ring.current_frame = ring.data = mmap_ret.ptr;
+    *data = mmap_ret.ptr;
     return 0;
 }
 
+[[maybe_unused]] static int socket_mmap_ring(int sock, int ring_type, RingBuffer &ring) {
+    int err;
+
+    err = platform::setsockopt(sock, SOL_PACKET, ring_type, &ring.req, sizeof(tpacket_req));
+    if (err < 0) {
+        fmt::print(stderr, "setsockopt(ring) failed: {}\n", err);
+        return err;
+    }
+
+    err = mmap_ring(sock, ring.size(), &ring.data);
+    if (err < 0) return err;
+
+    ring.current_frame = ring.data;
+    return 0;
+}
+
+#if USE_TPACKET_V3
+static int socket_mmap_block_ring(int sock, BlockRing &ring) {
+    int err;
+
+    err = platform::setsockopt(sock, SOL_PACKET, PACKET_VERSION, TPACKET_V3);
+    if (err < 0) {
+        fmt::print(stderr, "setsockopt(PACKET_VERSION) failed: {}\n", err);
+        return err;
+    }
+
+    err = platform::setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &ring.req, sizeof(tpacket_req3));
+    if (err < 0) {
+        fmt::print(stderr, "setsockopt(ring) failed: {}\n", err);
+        return err;
+    }
+
+    return mmap_ring(sock, ring.size(), &ring.data);
+}
+#endif
+
 #ifndef SO_TIMESTAMPING
 #define SO_TIMESTAMPING 37
 #define SCM_TIMESTAMPING SO_TIMESTAMPING
@@ -889,11 +1467,75 @@ int hwtsInit(int sock, const char *interface) {
     return true;
 }
 
-static void packet_handler() {
-    //    set_affinity(pthread_self(), 1);
+// Called while the rx side has nothing for us: runs connection timers, flushes queued replies and, unless busy
+// waiting, sleeps in poll(). Returns false when poll() fails
+static bool rx_idle(int tx_sock, [[maybe_unused]] pollfd &pfd, [[maybe_unused]] uint64_t &next_tick_ms) {
+#if USE_TCP_TABLE || USE_TRACE
+    uint64_t now = now_ms();
+    if (now >= next_tick_ms) {
+#if USE_TCP_TABLE
+        tcp_tick(tx_sock, now);
+#endif
+#if USE_TRACE
+        g_trace.calibrate();
+#endif
+        next_tick_ms = now + kTickMs;
+    }
+#endif
+    flush_tx(tx_sock);
+#if !BUSY_WAIT
+    int err = platform::syscall<int>(platform::SC::poll, &pfd, 1, USE_TCP_TABLE ? kTickMs : 1000);
+    if (err < 0) {
+        fmt::print(stderr, "poll(): {}\n", err);
+        return false;
+    }
+#endif
+    return true;
+}
+
+#if USE_TPACKET_V3
+// Handles every frame of a retired block before giving the block back, replies for the whole burst are queued
+// before the next status check
+static void rx_blocks(int rx_sock, int tx_sock) {
+    pollfd pfd;
+    pfd.fd     = rx_sock;
+    pfd.events = POLLIN;
 
-    int rx_sock = create_packet_socket();
-    int tx_sock = create_packet_socket();
+    uint64_t next_tick_ms = 0;
+
+    uint32_t packets_in_block_max = 0;
+    while (true) {
+        tpacket_block_desc *block = rx_block_ring.currentBlock();
+        tpacket_hdr_v1 &    bh    = block->hdr.bh1;
+
+        while (!(__atomic_load_n(&bh.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            if (!rx_idle(tx_sock, pfd, next_tick_ms)) return;
+        }
+
+        char *ptr = reinterpret_cast<char *>(block) + bh.offset_to_first_pkt;
+        for (uint32_t i = 0; i < bh.num_pkts; ++i) {
+            tpacket3_hdr *hdr = reinterpret_cast<tpacket3_hdr *>(ptr);
+            handle_packet(tx_sock, ptr, hdr->tp_mac, hdr->tp_net, hdr->tp_sec, hdr->tp_status);
+            ptr += hdr->tp_next_offset;
+        }
+
+        if (packets_in_block_max < bh.num_pkts) {
+            packets_in_block_max = bh.num_pkts;
+            fmt::print(stderr, "max packets_in_block: {}\n", packets_in_block_max);
+        }
+
+        __atomic_store_n(&bh.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+        rx_block_ring.nextBlock();
+    }
+}
+#endif
+
+// Runs one rx/tx socket pair with its own rings on the calling thread, pinned to `core`
+static void packet_worker(int core, int rx_sock, int tx_sock) {
+    set_affinity(pthread_self(), core);
+#if USE_TRACE
+    open_trace(static_cast<uint32_t>(core));
+#endif
 
     //    struct packet_mreq mreq{};
     //    mreq.mr_ifindex = ifindex;
@@ -907,11 +1549,20 @@ static void packet_handler() {
     //    hwtsInit(rx_sock, "docker0");
 
     int err;
+#if USE_TPACKET_V3
+    err = socket_mmap_block_ring(rx_sock, rx_block_ring);
+#else
     err = socket_mmap_ring(rx_sock, PACKET_RX_RING, rx_ring);
+#endif
     if (err < 0) {
         fmt::print(stderr, "mmap(PACKET_RX_RING) failed: {}\n", err);
         return;
     }
+#if USE_VNET_HDR
+    err = platform::setsockopt(tx_sock, SOL_PACKET, PACKET_VNET_HDR, 1);
+    fmt::print(stderr, "setsockopt(PACKET_VNET_HDR): {}\n", err);
+#endif
+
 #if USE_TX_RING
     err = socket_mmap_ring(tx_sock, PACKET_TX_RING, tx_ring);
     if (err < 0) {
@@ -919,13 +1570,7 @@ static void packet_handler() {
         return;
     }
 #else
-
-#if USE_VNET_HDR
-    err = platform::setsockopt(tx_sock, SOL_PACKET, PACKET_VNET_HDR, 1);
-    fmt::print(stderr, "setsockopt(PACKET_VNET_HDR): {}\n", err);
-#endif
-
-    tx_ring.current_frame = tx_ring.data = reinterpret_cast<char *>(::aligned_alloc(8192, 8192));
+    tx_ring.current_frame = tx_ring.data = reinterpret_cast<char *>(::aligned_alloc(8192, std::max<size_t>(tx_ring.size(), 8192)));
 #endif
 
     fmt::print(stderr, "filling tx ring\n");
@@ -936,13 +1581,15 @@ static void packet_handler() {
     std::thread send_th(send_thread, tx_sock);
 #endif
 
-#if !BUSY_WAIT
+#if USE_TPACKET_V3
+    rx_blocks(rx_sock, tx_sock);
+#else
     pollfd pfd;
     pfd.fd     = rx_sock;
     pfd.events = POLLIN;
-#endif
 
-    int packets_in_row = 0, packets_in_row_max = 0;
+    int      packets_in_row = 0, packets_in_row_max = 0;
+    uint64_t next_tick_ms   = 0;
     while (true) {
         char *                  frame_ptr = rx_ring.current_frame;
         tpacket_hdr *           tphdr     = reinterpret_cast<tpacket_hdr *>(frame_ptr);
@@ -951,16 +1598,7 @@ static void packet_handler() {
         while (!(__atomic_load_n(&tphdr->tp_status, __ATOMIC_RELAXED) & TP_STATUS_USER)) {
             //        while (!(*status & TP_STATUS_USER)) {
             packets_in_row = 0;
-//            platform::send(tx_sock, nullptr, 0, kSendFlags);
-#if BUSY_WAIT
-//            __asm volatile("pause" ::: "memory");
-#else
-            err = platform::syscall<int>(platform::SC::poll, &pfd, 1, 1000);
-            if (err < 0) {
-                fmt::print(stderr, "poll(): {}\n", err);
-                break;
-            }
-#endif
+            if (!rx_idle(tx_sock, pfd, next_tick_ms)) break;
         }
 
 #if DEBUG
@@ -994,19 +1632,299 @@ static void packet_handler() {
 
         rx_ring.nextFrame();
     }
+#endif
 
     err = platform::close(rx_sock);
     fmt::print(stderr, "raw close(): {}\n", err);
 }
 
+[[maybe_unused]] static void packet_handler() {
+#if USE_FANOUT
+    unsigned workers = std::min(kFanoutWorkers, std::max(1u, std::thread::hardware_concurrency()));
+    int      group   = static_cast<int>(getpid() & 0xffff);
+
+    // All rx sockets join before any worker starts, the hash spreads over the final member count from the first
+    // packet handled
+    std::vector<std::pair<int, int>> socks;
+    for (unsigned i = 0; i < workers; ++i) {
+        int rx_sock = create_packet_socket();
+        int tx_sock = create_packet_socket();
+
+        int err = platform::setsockopt(rx_sock, SOL_PACKET, PACKET_FANOUT, group | (kFanoutMode | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+        fmt::print(stderr, "setsockopt(PACKET_FANOUT) worker {}: {}\n", i, err);
+        if (err < 0) return;
+
+        socks.emplace_back(rx_sock, tx_sock);
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < workers; ++i) threads.emplace_back(packet_worker, int(i), socks[i].first, socks[i].second);
+    packet_worker(0, socks[0].first, socks[0].second);
+    for (std::thread &th : threads) th.join();
+#else
+    packet_worker(0, create_packet_socket(), create_packet_socket());
+#endif
+}
+
+#if USE_AF_XDP
+static void xdp_handler() {
+    const char *if_name = if_nametoindex("eth0") != 0 ? "eth0" : "lo";
+
+#if USE_TRACE
+    open_trace(0);
+#endif
+
+    int err = g_xsk.open(if_name, 0, kPort);
+    fmt::print(stderr, "xsk open({}): {}\n", if_name, err);
+    if (err < 0) return;
+
+    // Tx chunks keep the template headers, replies only patch addresses, numbers and payload
+    RingBuffer tx_chunks(XskSocket::kChunkSize, XskSocket::kChunks - XskSocket::kRxChunks);
+    tx_chunks.current_frame = tx_chunks.data = g_xsk.chunk(uint64_t(XskSocket::kRxChunks) * XskSocket::kChunkSize);
+    fill_tx_ring(tx_chunks);
+
+    int    tx_sock = g_xsk.fd;
+    pollfd pfd;
+    pfd.fd     = g_xsk.fd;
+    pfd.events = POLLIN;
+
+    uint64_t next_tick_ms = 0;
+    uint32_t batch_max    = 0;
+    while (true) {
+        uint32_t n = g_xsk.rx.available();
+        if (n == 0) {
+            if (!rx_idle(tx_sock, pfd, next_tick_ms)) return;
+            continue;
+        }
+
+        for (uint32_t i = 0; i < n; ++i) {
+            const xdp_desc &desc = g_xsk.rx.at(g_xsk.rx.local + i);
+            handle_packet(tx_sock, g_xsk.chunk(desc.addr), 0, ETH_HLEN, 0, 0);
+        }
+        g_xsk.refill(n);
+
+        if (batch_max < n) {
+            batch_max = n;
+            fmt::print(stderr, "max packets_in_batch: {}\n", batch_max);
+        }
+    }
+}
+#endif
+
+#if USE_TX_RING && !USE_AF_XDP && !USE_SEND_THREAD
+// Offline harness: frames from `in` go through handle_frame as if they sat on a V1 rx ring, replies are queued in
+// an in-memory tx ring and captured to `out_path`. Our initial sequence numbers differ from the recorded ones, so
+// every flow's acknowledgements are shifted by the difference seen on its first ACK after the SYN.
+static int replay(PcapReader &in, const char *out_path) {
+#if USE_TRACE
+    open_trace(0);
+#endif
+
+    tx_ring.current_frame = tx_ring.data = static_cast<char *>(::aligned_alloc(4096, tx_ring.size()));
+    fill_tx_ring(tx_ring);
+
+    TxCapture capture;
+    g_tx_capture = &capture;
+
+    static const uint16_t kMac = TPACKET_ALIGN(TPACKET_HDRLEN);
+    alignas(64) static char rx_frame[kMac + 65536];
+    tpacket_hdr *           tphdr = reinterpret_cast<tpacket_hdr *>(rx_frame);
+
+    struct Flow {
+        uint32_t isn       = 0;
+        uint32_t ack_delta = 0;
+        bool     rebased   = false;
+    };
+    [[maybe_unused]] std::unordered_map<uint64_t, Flow> flows;
+
+    std::vector<uint64_t>     cycles;
+    [[maybe_unused]] uint64_t next_tick_ms = 0;
+
+    PcapPacket pkt;
+    while (in.next(pkt)) {
+        if (pkt.len < ETH_HLEN + sizeof(iphdr) + sizeof(tcphdr) || pkt.len > 65536) continue;
+        memcpy(rx_frame + kMac, pkt.data, pkt.len);
+
+        ethhdr *eth = reinterpret_cast<ethhdr *>(rx_frame + kMac);
+        iphdr * iph = reinterpret_cast<iphdr *>(rx_frame + kMac + ETH_HLEN);
+        if (eth->h_proto != htons(ETH_P_IP) || iph->protocol != IPPROTO_TCP || pkt.len < ETH_HLEN + iph->ihl * 4u + sizeof(tcphdr)) continue;
+
+        tcphdr *tcph = reinterpret_cast<tcphdr *>(rx_frame + kMac + ETH_HLEN + iph->ihl * 4);
+        if (tcph->dest != htons(kPort)) continue;
+
+#if USE_TCP_TABLE
+        uint64_t key = uint64_t(iph->saddr) << 16 | tcph->source;
+        auto     it  = flows.find(key);
+        if (it != flows.end() && tcph->ack && !tcph->syn) {
+            Flow &flow = it->second;
+            if (!flow.rebased) {
+                flow.ack_delta = flow.isn + 1 - ntohl(tcph->ack_seq);
+                flow.rebased   = true;
+            }
+            tcph->ack_seq = htonl(ntohl(tcph->ack_seq) + flow.ack_delta);
+        }
+#endif
+
+        tphdr->tp_status  = TP_STATUS_USER;
+        tphdr->tp_len     = pkt.len;
+        tphdr->tp_snaplen = pkt.len;
+        tphdr->tp_mac     = kMac;
+        tphdr->tp_net     = kMac + ETH_HLEN;
+        tphdr->tp_sec     = pkt.sec;
+        tphdr->tp_usec    = pkt.nsec / 1000;
+        capture.sec       = pkt.sec;
+        capture.nsec      = pkt.nsec;
+
+        uint64_t start_tsc = rdtscp();
+        handle_frame(-1, rx_frame);
+        cycles.push_back(rdtscp() - start_tsc);
+
+#if USE_TCP_TABLE
+        if (tcph->syn && !tcph->ack) {
+            if (TcpConn *conn = g_tcp_table.find(FlowKey{iph->saddr, tcph->source})) flows[key] = Flow{conn->snd_una, 0, false};
+        }
+
+        uint64_t now = now_ms();
+        if (now >= next_tick_ms) {
+            tcp_tick(-1, now);
+            next_tick_ms = now + kTickMs;
+        }
+#endif
+    }
+    flush_tx(-1);
+    g_tx_capture = nullptr;
+#if USE_TRACE
+    g_trace.calibrate();
+#endif
+
+#if USE_TCP_TABLE
+    fmt::print(stderr, "replay: {} frames in, {} out, {} connections open\n", cycles.size(), capture.out.count(), g_tcp_table.size());
+#else
+    fmt::print(stderr, "replay: {} frames in, {} out\n", cycles.size(), capture.out.count());
+#endif
+    if (!cycles.empty()) {
+        uint64_t total = 0;
+        for (uint64_t c : cycles) total += c;
+        std::sort(cycles.begin(), cycles.end());
+        fmt::print(stderr, "tsc cycles per frame: mean {:.0f}, p50 {}, p99 {}, max {}\n", double(total) / double(cycles.size()), cycles[cycles.size() / 2],
+                   cycles[cycles.size() * 99 / 100], cycles.back());
+    }
+
+    int err = capture.out.save(out_path);
+    fmt::print(stderr, "save({}): {}\n", out_path, err);
+    return err;
+}
+#endif
+
+// testserver --replay <in.pcap> <out.pcap>
+// testserver --synthetic <flows> <out.pcap> [<save generated input to.pcap>]
+static int replay_main(int argc, char **argv) {
+#if USE_TX_RING && !USE_AF_XDP && !USE_SEND_THREAD
+    static const uint32_t kSyntheticConcurrency = 64;
+    static const uint32_t kSyntheticRequests    = 4;
+
+    PcapReader in;
+    int        err;
+    if (strcmp(argv[1], "--synthetic") == 0) {
+#if USE_HTTP
+        // The client acknowledges whatever the handler answers to its request
+        HttpSession probe;
+        probe.in.append(kSyntheticRequest, sizeof(kSyntheticRequest) - 1);
+        probe.process(g_handler);
+        uint32_t response_len = static_cast<uint32_t>(probe.out.size());
+#else
+        uint32_t response_len = static_cast<uint32_t>(response.size());
+#endif
+        PcapWriter gen;
+        synthetic_flows(gen, static_cast<uint32_t>(strtoul(argv[2], nullptr, 10)), kSyntheticConcurrency, kSyntheticRequests, kPort, response_len);
+        if (argc > 4) {
+            err = gen.save(argv[4]);
+            fmt::print(stderr, "save({}): {}\n", argv[4], err);
+        }
+        err = in.assign(gen.data());
+    } else {
+        err = in.open(argv[2]);
+    }
+    if (err < 0) {
+        fmt::print(stderr, "pcap open({}): {}\n", argv[2], err);
+        return err;
+    }
+
+    return replay(in, argv[3]);
+#else
+    (void)argc;
+    (void)argv;
+    fmt::print(stderr, "replay needs USE_TX_RING without USE_AF_XDP and USE_SEND_THREAD\n");
+    return -ENOTSUP;
+#endif
+}
+
+// testserver --trace <out.pcapng | out.txt | -> <trace file>...
+// Merges the per-core trace rings by time into a pcapng with one interface per core, or into text
+static int trace_main(int argc, char **argv) {
+    std::vector<TraceFile> files(static_cast<size_t>(argc - 3));
+    for (size_t i = 0; i < files.size(); ++i) {
+        int err = files[i].load(argv[i + 3]);
+        if (err < 0) {
+            fmt::print(stderr, "trace load({}): {}\n", argv[i + 3], err);
+            return err;
+        }
+    }
+
+    struct Item {
+        uint64_t          ns;
+        uint32_t          file;
+        const TraceEvent *event;
+    };
+    std::vector<Item> items;
+    for (uint32_t f = 0; f < files.size(); ++f) {
+        for (const TraceEvent &e : files[f].events) items.push_back(Item{files[f].ns(e.tsc), f, &e});
+    }
+    std::stable_sort(items.begin(), items.end(), [](const Item &a, const Item &b) { return a.ns < b.ns; });
+
+    const char *out = argv[2];
+    size_t      len = strlen(out);
+    int         err = 0;
+    if (len > 7 && strcmp(out + len - 7, ".pcapng") == 0) {
+        PcapngWriter pcapng;
+        for (const TraceFile &f : files) pcapng.addInterface(fmt::format("core {}", f.hdr.core));
+
+        uint8_t frame[64];
+        for (const Item &item : items) {
+            uint32_t orig_len;
+            uint32_t caplen = trace_frame(*item.event, frame, &orig_len);
+            pcapng.add(item.file, frame, caplen, orig_len, item.ns);
+        }
+        err = pcapng.save(out);
+    } else {
+        FILE *f = strcmp(out, "-") == 0 ? stdout : std::fopen(out, "w");
+        if (f == nullptr) {
+            err = -errno;
+        } else {
+            for (const Item &item : items) {
+                std::string line = trace_format(*item.event, item.ns, files[item.file].hdr.core);
+                line += '\n';
+                std::fwrite(line.data(), 1, line.size(), f);
+            }
+            if (f != stdout && std::fclose(f) != 0) err = -EIO;
+        }
+    }
+
+    fmt::print(stderr, "trace: {} events from {} files to {}: {}\n", items.size(), files.size(), out, err);
+    return err;
+}
+
 #include <linux/filter.h>
 #include <sys/resource.h>
 
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof(array[0]))
 
-int main() {
+int main(int argc, char **argv) {
     int err;
 
+    if (argc >= 4 && (strcmp(argv[1], "--replay") == 0 || strcmp(argv[1], "--synthetic") == 0)) return replay_main(argc, argv) < 0;
+    if (argc >= 4 && strcmp(argv[1], "--trace") == 0) return trace_main(argc, argv) < 0;
+
     set_affinity(pthread_self(), 0);
     //    struct rlimit l;
     //    l.rlim_cur = 4096;
@@ -1021,8 +1939,6 @@ int main() {
     //    std::thread th;
     //    return 0;
 
-    size_t n_fins = 0, n_fins_ack = 0;
-
     int sock = platform::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, IPPROTO_TCP);
     fmt::print(stderr, "http socket(): {}\n", sock);
     if (sock < 0) { return 1; }
@@ -1072,78 +1988,12 @@ int main() {
 
     //    ::usleep(10 * 1000000);
     //    th.join();
+#if USE_AF_XDP
+    xdp_handler();
+#else
     packet_handler();
-
-    //    void *buffer = aligned_alloc(0x10000, 0x10000);
-
-    /*
-    for (;;) {
-        sockaddr_in caddr;
-        socklen_t   caddr_len = sizeof(caddr);
-
-        //        fmt::print(stderr, "!!!! accepting .... \n");
-        int csock = platform::accept(sock, reinterpret_cast<sockaddr *>(&caddr), &caddr_len);
-        //        fmt::print(stderr, "!!!! accepted: .... {}\n", csock);
-
-        if (csock < 0) {
-            fmt::print(stderr, "http accept(): {}. calling gc\n", csock);
-
-            while (true) {
-                timespec ts;
-                clock_gettime(CLOCK_REALTIME_COARSE, &ts);
-                uint32_t current_secs   = static_cast<uint32_t>(ts.tv_sec);
-                size_t   closed_sockets = 0;
-                for (size_t i = 0; i < 0xffff; i++) {
-                    if (g_port_timestamps[i] == 0) continue;
-                    if (g_port_timestamps[i] + 10 < current_secs) {
-                        //                        fmt::print("trying close port {} socket {}\n", i, g_sockets[i]);
-                        if (g_sockets[i] == 0) continue;
-                        n_fins++;
-                        int close_err = platform::close(g_sockets[i]);
-                        if (close_err >= 0) {
-                            n_fins_ack++;
-                            closed_sockets++;
-                            g_port_timestamps[i] = 0;
-                            g_sockets[i]         = 0;
-                        } else {
-                            fmt::print(stderr, "close err: {}\n", close_err);
-                        }
-                    }
-                }
-
-                if (closed_sockets > 0) { break; }
-
-                usleep(1000000);
-            }
-
-            fmt::print(stderr, "n_fins: {}, n_fins_ack: {}\n", n_fins, n_fins_ack);
-
-            continue;
-        }
-
-        g_sockets[caddr.sin_port] = csock;
-        //        fmt::print("open: {} -> {}\n", caddr.sin_port, csock);
-
-        if (CNTR) { fmt::print("Client connected: {}\n", csock); }
-
-#if 0
-        ssize_t sz = platform::recv(csock, buffer, 0x10000, 0);
-        if (sz < 0) {
-            fmt::print(stderr, "http recv(): {}\n", sz);
-            break;
-        }
-
-        platform::send(csock, response.data(), response.size(), MSG_DONTWAIT);
-
-        ::usleep(1500000);
-
-        platform::close(csock);
 #endif
-    }
 
-    err = platform::close(sock);
-    fmt::print(stderr, "raw close(): {}\n", err);
-*/
     //    th.join();
     return 0;
 }
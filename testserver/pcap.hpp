@@ -0,0 +1,268 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "checksum.hpp"
+
+// Classic libpcap files, Ethernet link type only. Files are read whole into memory so replaying them measures the
+// packet path and not the disk, and written from memory once the run is over.
+
+struct PcapPacket {
+    const char *data = nullptr;
+    uint32_t    len  = 0;  // captured length
+    uint32_t    sec  = 0;
+    uint32_t    nsec = 0;
+};
+
+class PcapReader {
+public:
+    static const uint32_t kLinkEthernet = 1;
+
+    // Returns 0 or -errno, -EINVAL for anything that is not an Ethernet pcap
+    int open(const char *path) {
+        FILE *f = std::fopen(path, "rb");
+        if (f == nullptr) return -errno;
+
+        std::string data;
+        char        buf[1 << 16];
+        size_t      n;
+        while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+        int err = std::ferror(f) ? -EIO : 0;
+        std::fclose(f);
+        if (err < 0) return err;
+
+        return assign(std::move(data));
+    }
+
+    int assign(std::string data) {
+        data_    = std::move(data);
+        pos_     = kFileHeaderSize;
+        swapped_ = false;
+        if (data_.size() < kFileHeaderSize) return -EINVAL;
+
+        uint32_t magic = load32(0);
+        if (magic == __builtin_bswap32(kMagicUsec) || magic == __builtin_bswap32(kMagicNsec)) {
+            swapped_ = true;
+            magic    = __builtin_bswap32(magic);
+        }
+        if (magic != kMagicUsec && magic != kMagicNsec) return -EINVAL;
+        nsec_ = magic == kMagicNsec;
+
+        if (load32(20) != kLinkEthernet) return -EINVAL;
+        return 0;
+    }
+
+    // False at the end of the file or on a truncated record
+    bool next(PcapPacket &pkt) {
+        if (pos_ + kRecordHeaderSize > data_.size()) return false;
+
+        uint32_t caplen = load32(pos_ + 8);
+        if (pos_ + kRecordHeaderSize + caplen > data_.size()) return false;
+
+        pkt.sec  = load32(pos_);
+        pkt.nsec = nsec_ ? load32(pos_ + 4) : load32(pos_ + 4) * 1000;
+        pkt.len  = caplen;
+        pkt.data = data_.data() + pos_ + kRecordHeaderSize;
+        pos_ += kRecordHeaderSize + caplen;
+        return true;
+    }
+
+    void rewind() { pos_ = kFileHeaderSize; }
+
+private:
+    friend class PcapWriter;
+
+    static const uint32_t kMagicUsec        = 0xa1b2c3d4;
+    static const uint32_t kMagicNsec        = 0xa1b23c4d;
+    static const size_t   kFileHeaderSize   = 24;
+    static const size_t   kRecordHeaderSize = 16;
+
+    uint32_t load32(size_t off) const {
+        uint32_t v;
+        memcpy(&v, data_.data() + off, sizeof(v));
+        return swapped_ ? __builtin_bswap32(v) : v;
+    }
+
+    std::string data_;
+    size_t      pos_     = kFileHeaderSize;
+    bool        swapped_ = false;
+    bool        nsec_    = false;
+};
+
+static inline int pcap_save(const std::string &data, const char *path) {
+    FILE *f = std::fopen(path, "wb");
+    if (f == nullptr) return -errno;
+    bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok      = std::fclose(f) == 0 && ok;
+    return ok ? 0 : -EIO;
+}
+
+// Nanosecond pcap in host byte order
+class PcapWriter {
+public:
+    PcapWriter() {
+        uint32_t hdr[6] = {PcapReader::kMagicNsec, 2 | (4u << 16), 0, 0, 0xffff, PcapReader::kLinkEthernet};
+        data_.append(reinterpret_cast<const char *>(hdr), sizeof(hdr));
+    }
+
+    void add(const void *frame, uint32_t len, uint32_t sec = 0, uint32_t nsec = 0) {
+        uint32_t rec[4] = {sec, nsec, len, len};
+        data_.append(reinterpret_cast<const char *>(rec), sizeof(rec));
+        data_.append(static_cast<const char *>(frame), len);
+        ++count_;
+    }
+
+    size_t count() const { return count_; }
+
+    const std::string &data() const { return data_; }
+
+    int save(const char *path) const { return pcap_save(data_, path); }
+
+private:
+    std::string data_;
+    size_t      count_ = 0;
+};
+
+// pcapng with one interface per trace source and nanosecond timestamps, host byte order
+class PcapngWriter {
+public:
+    PcapngWriter() {
+        // Section header: byte order magic, version 1.0, unknown section length
+        uint32_t shb[7] = {0x0a0d0d0a, 28, 0x1a2b3c4d, 1, 0xffffffff, 0xffffffff, 28};
+        data_.append(reinterpret_cast<const char *>(shb), sizeof(shb));
+    }
+
+    // Returns the interface id for add()
+    uint32_t addInterface(const std::string &name) {
+        uint32_t name_len = static_cast<uint32_t>(name.size());
+        uint32_t padded   = (name_len + 3) & ~3u;
+        uint32_t len      = 16 + 4 + padded + 8 + 4 + 4;  // header, if_name, if_tsresol, end of options, trailer
+
+        append32(1);
+        append32(len);
+        append32(PcapReader::kLinkEthernet);  // link type and reserved
+        append32(0);                          // no snap length
+        append32(2 | (name_len << 16));       // if_name
+        data_.append(name);
+        data_.append(padded - name_len, '\0');
+        append32(9 | (1u << 16));  // if_tsresol, 10^-9
+        append32(9);
+        append32(0);  // opt_endofopt
+        append32(len);
+        return interfaces_++;
+    }
+
+    void add(uint32_t iface, const void *frame, uint32_t caplen, uint32_t orig_len, uint64_t ns) {
+        uint32_t padded = (caplen + 3) & ~3u;
+        uint32_t len    = 28 + padded + 4;
+
+        append32(6);  // enhanced packet block
+        append32(len);
+        append32(iface);
+        append32(static_cast<uint32_t>(ns >> 32));
+        append32(static_cast<uint32_t>(ns));
+        append32(caplen);
+        append32(orig_len);
+        data_.append(static_cast<const char *>(frame), caplen);
+        data_.append(padded - caplen, '\0');
+        append32(len);
+        ++count_;
+    }
+
+    size_t count() const { return count_; }
+
+    const std::string &data() const { return data_; }
+
+    int save(const char *path) const { return pcap_save(data_, path); }
+
+private:
+    void append32(uint32_t v) { data_.append(reinterpret_cast<const char *>(&v), sizeof(v)); }
+
+    std::string data_;
+    uint32_t    interfaces_ = 0;
+    size_t      count_      = 0;
+};
+
+static const char kSyntheticRequest[] = "GET /accounts/filter/?limit=10 HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+
+// Client side of `flows` keep-alive connections to `port`: SYN, ACK, `requests` kSyntheticRequest GETs, FIN and the
+// last ACK, played round robin over groups of `concurrency` flows. The server's initial sequence number is taken
+// as 0 and every reply as `response_len` bytes, so acknowledgements need rebasing onto the real server's numbers
+// by the replayer.
+static inline void synthetic_flows(PcapWriter &out, uint32_t flows, uint32_t concurrency, uint32_t requests, uint16_t port, uint32_t response_len) {
+    static const uint16_t kRequestLen = sizeof(kSyntheticRequest) - 1;
+
+    struct {
+        ethhdr eth;
+        iphdr  iph;
+        tcphdr tcph;
+        char   payload[kRequestLen];
+    } __attribute__((packed)) f;
+
+    uint32_t steps = requests + 4;
+    uint64_t usec  = 0;  // one frame per microsecond
+    for (uint32_t first = 0; first < flows; first += concurrency) {
+        uint32_t last = std::min(flows, first + concurrency);
+        for (uint32_t step = 0; step < steps; ++step) {
+            for (uint32_t i = first; i < last; ++i) {
+                memset(&f, 0, sizeof(f));
+                memcpy(f.eth.h_dest, "\x02\x00\x00\x00\x00\x01", ETH_ALEN);
+                memcpy(f.eth.h_source, "\x02\x00\x00\x00\x00\x02", ETH_ALEN);
+                f.eth.h_proto = htons(ETH_P_IP);
+
+                f.iph.ihl      = 5;
+                f.iph.version  = 4;
+                f.iph.ttl      = 64;
+                f.iph.protocol = IPPROTO_TCP;
+                f.iph.saddr    = htonl(0x0a000000 | (i >> 14));  // 10.0.0.0/8, 16k ports per address
+                f.iph.daddr    = htonl(0x0a000001);
+
+                uint32_t isn   = i * 0x10001u;
+                uint32_t done  = step < 2 ? 0 : std::min(step - 2, requests);  // requests answered before this one
+                f.tcph.source  = htons(static_cast<uint16_t>(0x8000 + (i & 0x3fff)));
+                f.tcph.dest    = htons(port);
+                f.tcph.doff    = 5;
+                f.tcph.window  = htons(65535);
+                f.tcph.seq     = htonl(isn + 1 + done * kRequestLen);
+                f.tcph.ack_seq = htonl(1 + done * response_len);
+                f.tcph.ack     = 1;
+
+                uint16_t payload = 0;
+                if (step == 0) {
+                    f.tcph.seq = htonl(isn);
+                    f.tcph.syn = 1;
+                    f.tcph.ack = 0;
+                    f.tcph.ack_seq = 0;
+                } else if (step >= 2 && step < requests + 2) {
+                    f.tcph.psh = 1;
+                    memcpy(f.payload, kSyntheticRequest, kRequestLen);
+                    payload = kRequestLen;
+                } else if (step == requests + 2) {
+                    f.tcph.fin = 1;
+                } else if (step == requests + 3) {
+                    // After our FIN and the server's
+                    f.tcph.seq     = htonl(isn + 2 + requests * kRequestLen);
+                    f.tcph.ack_seq = htonl(2 + requests * response_len);
+                }
+
+                uint16_t len  = static_cast<uint16_t>(sizeof(iphdr) + sizeof(tcphdr) + payload);
+                f.iph.tot_len = htons(len);
+                f.iph.check   = htons(cksum_generic(reinterpret_cast<unsigned char *>(&f.iph), sizeof(iphdr), 0));
+                f.tcph.check  = compute_tcp_checksum(&f.iph, &f.tcph);
+
+                out.add(&f, ETH_HLEN + len, static_cast<uint32_t>(usec / 1000000), static_cast<uint32_t>(usec % 1000000) * 1000);
+                ++usec;
+            }
+        }
+    }
+}
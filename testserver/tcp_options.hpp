@@ -0,0 +1,125 @@
+#pragma once
+
+#include <arpa/inet.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// The TCP options the raw-packet stack negotiates: MSS (RFC 793), window scale and timestamps (RFC 7323) and
+// SACK-permitted (RFC 2018). SACK blocks themselves are skipped, a retransmission resends everything unacked.
+
+static const uint8_t kTcpOptEnd       = 0;
+static const uint8_t kTcpOptNop       = 1;
+static const uint8_t kTcpOptMss       = 2;
+static const uint8_t kTcpOptWscale    = 3;
+static const uint8_t kTcpOptSackPerm  = 4;
+static const uint8_t kTcpOptTimestamp = 8;
+
+static const uint8_t  kTcpMaxWscale  = 14;
+static const uint16_t kTcpDefaultMss = 536;  // assumed when the SYN carries none
+
+struct TcpOptions {
+    static constexpr uint8_t kNoWscale = 0xff;
+
+    uint16_t mss     = 0;  // 0 when absent
+    uint8_t  wscale  = kNoWscale;
+    bool     sack_ok = false;
+    bool     has_ts  = false;
+    uint32_t ts_val  = 0;  // host byte order
+    uint32_t ts_ecr  = 0;
+};
+
+// Returns false on a malformed list, options before the bad one are kept
+static inline bool parse_tcp_options(const uint8_t *p, size_t len, TcpOptions &opts) {
+    // NOP NOP TIMESTAMP is all an established Linux peer sends
+    if (len == 12 && p[0] == kTcpOptNop && p[1] == kTcpOptNop && p[2] == kTcpOptTimestamp && p[3] == 10) {
+        uint32_t ts[2];
+        memcpy(ts, p + 4, sizeof(ts));
+        opts.has_ts = true;
+        opts.ts_val = ntohl(ts[0]);
+        opts.ts_ecr = ntohl(ts[1]);
+        return true;
+    }
+
+    size_t i = 0;
+    while (i < len) {
+        uint8_t kind = p[i];
+        if (kind == kTcpOptEnd) break;
+        if (kind == kTcpOptNop) {
+            ++i;
+            continue;
+        }
+
+        if (i + 1 >= len) return false;
+        uint8_t olen = p[i + 1];
+        if (olen < 2 || i + olen > len) return false;
+
+        switch (kind) {
+            case kTcpOptMss:
+                if (olen == 4) opts.mss = static_cast<uint16_t>(p[i + 2] << 8 | p[i + 3]);
+                break;
+            case kTcpOptWscale:
+                if (olen == 3) opts.wscale = p[i + 2] < kTcpMaxWscale ? p[i + 2] : kTcpMaxWscale;
+                break;
+            case kTcpOptSackPerm:
+                if (olen == 2) opts.sack_ok = true;
+                break;
+            case kTcpOptTimestamp:
+                if (olen == 10) {
+                    uint32_t ts[2];
+                    memcpy(ts, p + i + 2, sizeof(ts));
+                    opts.has_ts = true;
+                    opts.ts_val = ntohl(ts[0]);
+                    opts.ts_ecr = ntohl(ts[1]);
+                }
+                break;
+            default:
+                break;
+        }
+        i += olen;
+    }
+    return true;
+}
+
+// Writes the options present in `opts` in the order Linux uses and returns their length: a multiple of 4, at most
+// 20 bytes
+static inline uint8_t emit_tcp_options(uint8_t *p, const TcpOptions &opts) {
+    uint8_t *start = p;
+
+    if (opts.mss != 0) {
+        p[0] = kTcpOptMss;
+        p[1] = 4;
+        p[2] = static_cast<uint8_t>(opts.mss >> 8);
+        p[3] = static_cast<uint8_t>(opts.mss);
+        p += 4;
+    }
+
+    if (opts.has_ts) {
+        // SACK-permitted takes the place of the two NOPs
+        p[0] = opts.sack_ok ? kTcpOptSackPerm : kTcpOptNop;
+        p[1] = opts.sack_ok ? 2 : kTcpOptNop;
+        p[2] = kTcpOptTimestamp;
+        p[3] = 10;
+
+        uint32_t ts[2] = {htonl(opts.ts_val), htonl(opts.ts_ecr)};
+        memcpy(p + 4, ts, sizeof(ts));
+        p += 12;
+    } else if (opts.sack_ok) {
+        p[0] = kTcpOptNop;
+        p[1] = kTcpOptNop;
+        p[2] = kTcpOptSackPerm;
+        p[3] = 2;
+        p += 4;
+    }
+
+    if (opts.wscale != TcpOptions::kNoWscale) {
+        p[0] = kTcpOptNop;
+        p[1] = kTcpOptWscale;
+        p[2] = 3;
+        p[3] = opts.wscale;
+        p += 4;
+    }
+
+    return static_cast<uint8_t>(p - start);
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Userspace TCP state for the raw-packet path. Connections are keyed by the peer's address and port (our side
+// is always the same address and kPort), live in an open-addressing table and carry just enough state to
+// answer keep-alive traffic in order and to retransmit what the peer has not acknowledged yet.
+
+enum class TcpState : uint8_t {
+    kClosed = 0,
+    kSynRcvd,
+    kEstablished,
+    kCloseWait,  // the peer's FIN came while answers were still queued, our FIN follows the last of them
+    kLastAck,
+    kFinWait1,  // we closed an idle connection
+    kFinWait2,
+    kTimeWait,
+};
+
+static inline const char *tcp_state_name(TcpState state) {
+    static const char *const kNames[] = {"CLOSED", "SYN_RCVD", "ESTABLISHED", "CLOSE_WAIT", "LAST_ACK", "FIN_WAIT1", "FIN_WAIT2", "TIME_WAIT"};
+    return kNames[static_cast<int>(state)];
+}
+
+// Sequence space comparisons, modulo 2^32
+static inline bool seq_lt(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) < 0; }
+static inline bool seq_le(uint32_t a, uint32_t b) { return static_cast<int32_t>(a - b) <= 0; }
+
+struct FlowKey {
+    uint32_t addr;  // peer address and port, network byte order
+    uint16_t port;
+
+    bool operator==(const FlowKey &o) const { return addr == o.addr && port == o.port; }
+};
+
+// A segment we have in flight. Payloads are static (or owned by the caller until acked), so a retransmission
+// rebuilds the frame from this descriptor instead of keeping a copy of it. Data without a payload pointer lives
+// in the owner's send queue and is found there by sequence number.
+struct TcpSegment {
+    const char *payload = nullptr;
+    uint16_t    len     = 0;
+    uint8_t     flags   = 0;  // kTcpSyn / kTcpFin / kTcpPsh, ACK is always set
+    uint32_t    seq     = 0;
+};
+
+static const uint8_t kTcpFin = 0x01;
+static const uint8_t kTcpSyn = 0x02;
+static const uint8_t kTcpRst = 0x04;
+static const uint8_t kTcpPsh = 0x08;
+static const uint8_t kTcpAck = 0x10;
+
+// Per-connection timers, see TcpConn::armed_ms
+enum TcpTimer : uint8_t {
+    kTimerRto = 0,  // retransmission, deadline in rto_deadline_ms
+    kTimerAck,      // delayed ACK, ack_deadline_ms
+    kTimerAge,      // idle close and TIME_WAIT expiry, counted from last_active_ms
+    kTimerCount,
+};
+
+// Segments unacked at a time. Queued answers wait for acks to free a slot, the static answer is one segment per
+// request and data beyond the limit is left unacked for the peer to resend later
+static const uint8_t kMaxInFlight = 8;
+
+struct TcpConn {
+    FlowKey  key;
+    TcpState state;
+    uint8_t  retries;
+
+    uint8_t peer_mac[6];
+    uint8_t local_mac[6];
+    uint32_t local_addr;
+
+    uint32_t snd_una;  // oldest unacknowledged sequence number
+    uint32_t snd_nxt;  // next sequence number we send
+    uint32_t snd_wnd;  // peer's receive window
+    uint32_t rcv_nxt;  // next sequence number we expect
+
+    // Negotiated on the SYN, see tcp_options.hpp
+    uint16_t peer_mss;    // largest payload the peer takes
+    uint8_t  snd_wscale;  // shift of the peer's advertised window
+    uint8_t  rcv_wscale;  // shift of ours, 0 unless the peer offered scaling
+    bool     sack_ok;
+    bool     ts_ok;
+    uint32_t ts_recent;  // peer's latest ts_val, echoed in our ts_ecr
+
+    uint32_t session;  // owner's per-connection state, index + 1 or 0 when none is attached
+
+    TcpSegment unacked[kMaxInFlight];  // oldest first, n_unacked of them cover [snd_una, snd_nxt)
+    uint8_t    n_unacked;
+    uint64_t   rto_deadline_ms;  // 0 when nothing is in flight
+    uint32_t   rto_ms;
+    uint64_t   last_active_ms;
+    uint64_t   ack_deadline_ms;  // 0 unless an ACK is being held back
+
+    // Deadline of the timer wheel entry pending for each TcpTimer, 0 when there is none. Deadlines above move
+    // without touching the wheel: an entry that fires early re-arms itself, a new one is added only when a
+    // deadline comes before the pending entry
+    uint64_t armed_ms[kTimerCount];
+
+    bool inFlight() const { return snd_una != snd_nxt; }
+
+    // Drops segments fully covered by `ack`, returns how many send queue bytes they carried
+    uint32_t ackSegments(uint32_t ack) {
+        uint8_t  n      = 0;
+        uint32_t queued = 0;
+        for (; n < n_unacked && seq_le(unacked[n].seq + segmentLen(unacked[n]), ack); ++n) {
+            if (unacked[n].payload == nullptr) queued += unacked[n].len;
+        }
+        if (n == 0) return 0;
+        std::memmove(unacked, unacked + n, (n_unacked - n) * sizeof(TcpSegment));
+        n_unacked = static_cast<uint8_t>(n_unacked - n);
+        return queued;
+    }
+
+    static uint32_t segmentLen(const TcpSegment &seg) { return seg.len + ((seg.flags & kTcpSyn) != 0) + ((seg.flags & kTcpFin) != 0); }
+};
+
+struct TcpTable {
+    static const uint32_t kInitialRtoMs = 200;
+    static const uint32_t kMaxRtoMs     = 3000;
+    static const uint8_t  kMaxRetries   = 6;
+
+    explicit TcpTable(uint32_t capacity_pow2 = 1u << 16) : slots_(capacity_pow2), mask_(capacity_pow2 - 1) {}
+
+    TcpConn *find(const FlowKey &key) {
+        for (uint32_t i = hash(key);; i = (i + 1) & mask_) {
+            TcpConn &c = slots_[i];
+            if (c.state == TcpState::kClosed) return nullptr;
+            if (c.key == key) return &c;
+        }
+    }
+
+    // Returns nullptr when the table is full. A new entry is zeroed and kClosed until the caller sets its state
+    TcpConn *insert(const FlowKey &key) {
+        if (size_ >= mask_ - mask_ / 8) return nullptr;
+
+        for (uint32_t i = hash(key);; i = (i + 1) & mask_) {
+            TcpConn &c = slots_[i];
+            if (c.state == TcpState::kClosed) {
+                c        = TcpConn{};
+                c.key    = key;
+                c.rto_ms = kInitialRtoMs;
+                ++size_;
+                return &c;
+            }
+            if (c.key == key) return &c;
+        }
+    }
+
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    void erase(TcpConn *conn) {
+        uint32_t i = static_cast<uint32_t>(conn - slots_.data());
+        uint32_t j = i;
+        while (true) {
+            j = (j + 1) & mask_;
+            TcpConn &next = slots_[j];
+            if (next.state == TcpState::kClosed) break;
+
+            uint32_t home = hash(next.key);
+            // next may move into the hole at i only if its home slot is not in (i, j]
+            if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+                slots_[i] = next;
+                i         = j;
+            }
+        }
+        slots_[i].state = TcpState::kClosed;
+        --size_;
+    }
+
+    template <typename F>
+    void forEach(F &&f) {
+        for (TcpConn &c : slots_) {
+            if (c.state != TcpState::kClosed) f(c);
+        }
+    }
+
+    uint32_t size() const { return size_; }
+
+private:
+    uint32_t hash(const FlowKey &key) const {
+        uint64_t h = (static_cast<uint64_t>(key.addr) << 16 | key.port) * 0x9E3779B97F4A7C15ull;
+        return static_cast<uint32_t>(h >> 32) & mask_;
+    }
+
+    std::vector<TcpConn> slots_;
+    uint32_t             mask_;
+    uint32_t             size_ = 0;
+};
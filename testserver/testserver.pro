@@ -17,9 +17,38 @@ SOURCES += \
         main.cpp
 
 INCLUDEPATH = \
+  .. \
   ../platform/x86_64 \
   ../platform/linux
 
 HEADERS += \
     virtio_net.hpp \
+    af_xdp.hpp \
+    checksum.hpp \
+    pcap.hpp \
+    tcp_options.hpp \
+    tcp_table.hpp \
+    timer_wheel.hpp \
+    trace.hpp \
     utils.hpp
+
+# USE_HTTP links the request and account parsers of the main server
+RAGEL_FILES += \
+    ../HttpParser.cpp.rl
+
+RE2C_FILES += \
+    ../AccountParser.cpp.re
+
+ragel.output = $$OUT_PWD/ragel_${QMAKE_FILE_IN_BASE}
+ragel.input = RAGEL_FILES
+ragel.commands = ragel -G2 ${QMAKE_FILE_IN} -o ${QMAKE_FILE_OUT}
+ragel.variable_out = SOURCES
+ragel.name = RAGEL
+QMAKE_EXTRA_COMPILERS += ragel
+
+re2c.output = $$OUT_PWD/re2c_${QMAKE_FILE_IN_BASE}.cpp
+re2c.input = RE2C_FILES
+re2c.commands = re2c -cfo ${QMAKE_FILE_OUT} ${QMAKE_FILE_NAME}
+re2c.variable_out = SOURCES
+re2c.name = RE2C
+QMAKE_EXTRA_COMPILERS += re2c
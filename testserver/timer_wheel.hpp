@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Hierarchical timing wheel (Varghese & Lauck). kLevels wheels of kSlots slots each, a slot of level l spans
+// kSlots^l ticks: a timer goes to the lowest level that reaches its deadline and moves down when the wheel below
+// wraps into its slot. Insert and expiry are O(1) per timer, advancing is O(1) per tick plus the timers cascaded,
+// and nothing ever walks the whole set.
+//
+// There is no cancel: the owner keeps the authoritative deadline and checks it when a timer fires, so cancelling
+// or pushing a deadline out is a store on the owner's side and the stale entry is dropped when it comes up.
+template <typename T>
+class TimerWheel {
+public:
+    static const unsigned kBits   = 6;
+    static const unsigned kSlots  = 1u << kBits;
+    static const unsigned kLevels = 4;  // 2^24 ticks ahead, later deadlines take a few more cascades
+
+    explicit TimerWheel(uint64_t now = 0) : now_(now) {}
+
+    // Ticks before now() have been expired
+    uint64_t now() const { return now_; }
+    size_t   size() const { return size_; }
+
+    // Deadlines in the past fire on the next advance()
+    void schedule(uint64_t deadline, const T &item) {
+        place(Entry{deadline, item});
+        ++size_;
+    }
+
+    // Fires fn(item, deadline) for every timer due before `to`, in tick order, with the deadline it was scheduled
+    // for. fn may schedule new timers, those due by then fire in the same call
+    template <typename F>
+    void advance(uint64_t to, F &&fn) {
+        while (now_ < to) {
+            if (size_ == 0) {
+                // Nothing to cascade either, skip the empty ticks
+                now_ = to;
+                break;
+            }
+
+            fired_.swap(slots_[0][now_ & kMask]);
+            ++now_;
+            for (unsigned l = kLevels - 1; l > 0; --l) {
+                if ((now_ & ((uint64_t(1) << (kBits * l)) - 1)) == 0) cascade(l);
+            }
+
+            size_ -= fired_.size();
+            for (const Entry &e : fired_) fn(e.item, e.deadline);
+            fired_.clear();
+        }
+    }
+
+private:
+    static const uint64_t kMask = kSlots - 1;
+    static const uint64_t kSpan = uint64_t(1) << (kBits * kLevels);
+
+    struct Entry {
+        uint64_t deadline;
+        T        item;
+    };
+
+    void place(const Entry &e) {
+        uint64_t delta = e.deadline > now_ ? e.deadline - now_ : 0;
+        if (delta >= kSpan) delta = kSpan - 1;  // parked at the far end of the top wheel, placed again from there
+
+        unsigned level = 0;
+        while (level < kLevels - 1 && delta >= (uint64_t(1) << (kBits * (level + 1)))) ++level;
+        slots_[level][((now_ + delta) >> (kBits * level)) & kMask].push_back(e);
+    }
+
+    // Level l just wrapped into a new slot: its timers are due within the next revolution of the level below
+    void cascade(unsigned l) {
+        std::vector<Entry> &slot = slots_[l][(now_ >> (kBits * l)) & kMask];
+        pending_.swap(slot);
+        for (const Entry &e : pending_) place(e);
+        pending_.clear();
+    }
+
+    std::vector<Entry> slots_[kLevels][kSlots];
+    std::vector<Entry> fired_;
+    std::vector<Entry> pending_;
+    uint64_t           now_;
+    size_t             size_ = 0;
+};
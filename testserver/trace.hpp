@@ -0,0 +1,242 @@
+#pragma once
+
+#include <fcntl.h>
+#include <linux/if_ether.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "../fmt/format.hpp"
+
+#include "utils.hpp"
+
+// Binary packet trace. Every worker appends one fixed-size event per handled or sent segment to its own ring in a
+// shared memory file, with no locks, syscalls or formatting: the writer fills the slot and publishes the new head
+// with a release store. The files outlive the process and `testserver --trace` decodes them to text or pcapng.
+
+static const uint64_t kTraceMagic   = 0x3165636172747374ull;  // "tstrace1"
+static const uint8_t  kTraceRx      = 0;
+static const uint8_t  kTraceTx      = 1;
+static const size_t   kTraceEventSz = 64;
+
+// Header fields are copied in network byte order, as they are on the wire
+struct TraceEvent {
+    uint64_t tsc;
+    uint32_t status;  // tp_status of the rx frame, or what was set on the tx frame
+    uint8_t  dir;     // kTraceRx / kTraceTx
+    uint8_t  tcp_flags;
+    uint8_t  tcp_doff;
+    uint8_t  reserved0;
+    uint8_t  src_mac[6];
+    uint8_t  dst_mac[6];
+    uint32_t saddr;
+    uint32_t daddr;
+    uint16_t sport;
+    uint16_t dport;
+    uint32_t seq;
+    uint32_t ack;
+    uint16_t window;
+    uint16_t ip_len;
+    uint16_t ip_id;
+    uint8_t  reserved1[10];
+};
+static_assert(sizeof(TraceEvent) == kTraceEventSz, "one event per cache line");
+
+// First cache line of the file, the ring follows. tsc0/ns0 are taken at open, tsc1/ns1 refreshed by calibrate(),
+// the decoder converts tsc to CLOCK_REALTIME nanoseconds along that line.
+struct TraceHeader {
+    uint64_t magic;
+    uint32_t capacity;  // events, a power of two
+    uint32_t core;
+    uint64_t head;  // events written so far, the newest `capacity` of them are in the ring
+    uint64_t tsc0;
+    uint64_t ns0;
+    uint64_t tsc1;
+    uint64_t ns1;
+    uint64_t reserved;
+};
+static_assert(sizeof(TraceHeader) == kTraceEventSz, "events stay cache line aligned");
+
+static inline uint64_t trace_realtime_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Writer side, one per worker thread. record() does nothing until open() succeeds
+class TraceRing {
+public:
+    TraceRing() = default;
+    TraceRing(const TraceRing &) = delete;
+    TraceRing &operator=(const TraceRing &) = delete;
+
+    ~TraceRing() {
+        if (hdr_ != nullptr) munmap(hdr_, size_);
+    }
+
+    // Creates or truncates `path`, returns 0 or -errno
+    int open(const char *path, uint32_t capacity_pow2, uint32_t core) {
+        int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return -errno;
+
+        size_t size = sizeof(TraceHeader) + size_t(capacity_pow2) * sizeof(TraceEvent);
+        if (ftruncate(fd, static_cast<off_t>(size)) < 0) {
+            int err = -errno;
+            ::close(fd);
+            return err;
+        }
+
+        void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+        int   err = mem == MAP_FAILED ? -errno : 0;
+        ::close(fd);
+        if (err < 0) return err;
+
+        hdr_           = static_cast<TraceHeader *>(mem);
+        events_        = reinterpret_cast<TraceEvent *>(hdr_ + 1);
+        size_          = size;
+        mask_          = capacity_pow2 - 1;
+        head_          = 0;
+        hdr_->magic    = kTraceMagic;
+        hdr_->capacity = capacity_pow2;
+        hdr_->core     = core;
+        hdr_->tsc0 = hdr_->tsc1 = rdtsc();
+        hdr_->ns0 = hdr_->ns1 = trace_realtime_ns();
+        return 0;
+    }
+
+    void record(uint8_t dir, uint32_t status, const ethhdr *eth, const iphdr *iph, const tcphdr *tcph) {
+        if (events_ == nullptr) return;
+
+        TraceEvent &e = events_[head_ & mask_];
+        e.tsc         = rdtsc();
+        e.status      = status;
+        e.dir         = dir;
+        e.tcp_flags   = reinterpret_cast<const uint8_t *>(tcph)[13];
+        e.tcp_doff    = tcph->doff;
+        memcpy(e.src_mac, eth->h_source, ETH_ALEN);
+        memcpy(e.dst_mac, eth->h_dest, ETH_ALEN);
+        e.saddr  = iph->saddr;
+        e.daddr  = iph->daddr;
+        e.sport  = tcph->source;
+        e.dport  = tcph->dest;
+        e.seq    = tcph->seq;
+        e.ack    = tcph->ack_seq;
+        e.window = tcph->window;
+        e.ip_len = iph->tot_len;
+        e.ip_id  = iph->id;
+
+        __atomic_store_n(&hdr_->head, ++head_, __ATOMIC_RELEASE);
+    }
+
+    // Moves the second calibration point, call it every now and then from the idle path
+    void calibrate() {
+        if (hdr_ == nullptr) return;
+        __atomic_store_n(&hdr_->tsc1, rdtsc(), __ATOMIC_RELAXED);
+        __atomic_store_n(&hdr_->ns1, trace_realtime_ns(), __ATOMIC_RELAXED);
+    }
+
+private:
+    TraceHeader *hdr_    = nullptr;
+    TraceEvent * events_ = nullptr;
+    size_t       size_   = 0;
+    uint64_t     mask_   = 0;
+    uint64_t     head_   = 0;
+};
+
+// Reader side, works on a live file too: the slot the writer may be filling is left out
+struct TraceFile {
+    TraceHeader             hdr{};
+    std::vector<TraceEvent> events;  // oldest first
+
+    int load(const char *path) {
+        FILE *f = std::fopen(path, "rb");
+        if (f == nullptr) return -errno;
+
+        std::string data;
+        char        buf[1 << 16];
+        size_t      n;
+        while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+        std::fclose(f);
+
+        if (data.size() < sizeof(TraceHeader)) return -EINVAL;
+        memcpy(&hdr, data.data(), sizeof(hdr));
+        if (hdr.magic != kTraceMagic || hdr.capacity == 0 || (hdr.capacity & (hdr.capacity - 1)) != 0) return -EINVAL;
+        if (data.size() < sizeof(TraceHeader) + size_t(hdr.capacity) * sizeof(TraceEvent)) return -EINVAL;
+
+        const TraceEvent *ring  = reinterpret_cast<const TraceEvent *>(data.data() + sizeof(TraceHeader));
+        uint64_t          first = hdr.head > hdr.capacity - 1 ? hdr.head - (hdr.capacity - 1) : 0;
+        events.clear();
+        for (uint64_t i = first; i < hdr.head; ++i) events.push_back(ring[i & (hdr.capacity - 1)]);
+        return 0;
+    }
+
+    uint64_t ns(uint64_t tsc) const {
+        if (hdr.tsc1 <= hdr.tsc0) return hdr.ns0;
+        double rate = double(hdr.ns1 - hdr.ns0) / double(hdr.tsc1 - hdr.tsc0);
+        return hdr.ns0 + static_cast<uint64_t>(double(int64_t(tsc - hdr.tsc0)) * rate);
+    }
+};
+
+static inline std::string trace_format(const TraceEvent &e, uint64_t ns, uint32_t core) {
+    static const char kFlags[] = "FSRPAUEC";
+
+    char flags[9];
+    int  n = 0;
+    for (int i = 0; i < 8; ++i) {
+        if (e.tcp_flags & (1 << i)) flags[n++] = kFlags[i];
+    }
+    flags[n] = 0;
+
+    uint32_t s = ntohl(e.saddr), d = ntohl(e.daddr);
+    int      payload = ntohs(e.ip_len) - int(sizeof(iphdr)) - e.tcp_doff * 4;
+    return fmt::format("{}.{:09} core {} {} {}.{}.{}.{}:{} > {}.{}.{}.{}:{} [{}] seq {} ack {} win {} len {} status {:#x}", ns / 1000000000,
+                       ns % 1000000000, core, e.dir == kTraceRx ? "rx" : "tx", s >> 24, (s >> 16) & 0xff, (s >> 8) & 0xff, s & 0xff, ntohs(e.sport),
+                       d >> 24, (d >> 16) & 0xff, (d >> 8) & 0xff, d & 0xff, ntohs(e.dport), flags, ntohl(e.seq), ntohl(e.ack), ntohs(e.window), payload,
+                       e.status);
+}
+
+// Rebuilds the ethernet, ip and tcp headers into `buf` (54 bytes). Options were not recorded and are dropped from
+// the lengths, the payload was not either and shows up as truncated by the capture
+static inline uint32_t trace_frame(const TraceEvent &e, uint8_t *buf, uint32_t *orig_len) {
+    struct {
+        ethhdr eth;
+        iphdr  iph;
+        tcphdr tcph;
+    } __attribute__((packed)) f;
+    memset(&f, 0, sizeof(f));
+
+    memcpy(f.eth.h_source, e.src_mac, ETH_ALEN);
+    memcpy(f.eth.h_dest, e.dst_mac, ETH_ALEN);
+    f.eth.h_proto = htons(ETH_P_IP);
+
+    f.iph.ihl      = 5;
+    f.iph.version  = 4;
+    f.iph.ttl      = 64;
+    f.iph.protocol = IPPROTO_TCP;
+    uint16_t opt_len = e.tcp_doff > 5 ? static_cast<uint16_t>((e.tcp_doff - 5) * 4) : 0;
+    f.iph.tot_len    = htons(static_cast<uint16_t>(ntohs(e.ip_len) - opt_len));
+    f.iph.id       = e.ip_id;
+    f.iph.saddr    = e.saddr;
+    f.iph.daddr    = e.daddr;
+
+    f.tcph.source  = e.sport;
+    f.tcph.dest    = e.dport;
+    f.tcph.seq     = e.seq;
+    f.tcph.ack_seq = e.ack;
+    f.tcph.doff    = 5;
+    f.tcph.window  = e.window;
+    reinterpret_cast<uint8_t *>(&f.tcph)[13] = e.tcp_flags;
+
+    memcpy(buf, &f, sizeof(f));
+    *orig_len = ETH_HLEN + ntohs(f.iph.tot_len);
+    return sizeof(f);
+}